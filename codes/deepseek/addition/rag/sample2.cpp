@@ -3,15 +3,173 @@
 #include <vector>
 #include <memory>
 #include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
 #include "seal/seal.h"
 
 using namespace std;
 using namespace seal;
 using namespace chrono;
 
+// Circuit-aware parameter planner: picks the smallest N and modulus chain that
+// fit the circuit at the requested security level, then confirms the estimate
+// by running a short calibration of the circuit's multiplications and rotations.
+struct CircuitDescription {
+    int multiplicative_depth = 1;
+    int modulus_switches = 0;  // Primes dropped by mod switches, beyond the rescales
+    vector<int> rotation_steps;
+    int precision_bits = 20;   // Required bits after the last operation
+    int integer_bits = 4;      // Bits needed for |value| before the binary point
+    size_t slot_demand = 1;
+};
+
+struct ParameterPlan {
+    size_t poly_modulus_degree = 0;
+    vector<int> moduli_bits;
+    int scale_bits = 0;
+    double measured_precision_bits = 0.0;
+    double calibration_ms = 0.0;
+};
+
+class CKKSParameterPlanner {
+private:
+    sec_level_type security;
+    bool run_calibration;
+
+    // log2 of the rescale rounding error for a ternary secret (HEAAN bound)
+    static double rounding_error_bits(size_t n) {
+        double h = 2.0 * n / 3.0;
+        return log2(sqrt(n / 3.0) * (3.0 + 8.0 * sqrt(h)));
+    }
+
+    double calibrate(const ParameterPlan& plan, const CircuitDescription& circuit,
+                     double& elapsed_ms) const {
+        EncryptionParameters parms(scheme_type::ckks);
+        parms.set_poly_modulus_degree(plan.poly_modulus_degree);
+        parms.set_coeff_modulus(CoeffModulus::Create(plan.poly_modulus_degree, plan.moduli_bits));
+        SEALContext context(parms, true, security);
+        if (!context.parameters_set()) {
+            return 0.0;
+        }
+
+        KeyGenerator keygen(context);
+        PublicKey public_key;
+        keygen.create_public_key(public_key);
+        RelinKeys relin_keys;
+        keygen.create_relin_keys(relin_keys);
+        GaloisKeys gal_keys;
+        if (!circuit.rotation_steps.empty()) {
+            keygen.create_galois_keys(circuit.rotation_steps, gal_keys);
+        }
+        CKKSEncoder encoder(context);
+        Encryptor encryptor(context, public_key);
+        Evaluator evaluator(context);
+        Decryptor decryptor(context, keygen.secret_key());
+
+        size_t slots = encoder.slot_count();
+        vector<double> expected(slots);
+        for (size_t i = 0; i < slots; i++) {
+            expected[i] = sin(0.01 * static_cast<double>(i));
+        }
+        Plaintext plain;
+        encoder.encode(expected, pow(2.0, plan.scale_bits), plain);
+        Ciphertext cipher;
+        encryptor.encrypt(plain, cipher);
+
+        auto start = chrono::high_resolution_clock::now();
+        for (int d = 0; d < circuit.multiplicative_depth; d++) {
+            evaluator.square_inplace(cipher);
+            evaluator.relinearize_inplace(cipher, relin_keys);
+            evaluator.rescale_to_next_inplace(cipher);
+            for (auto& v : expected) v *= v;
+        }
+        for (int s = 0; s < circuit.modulus_switches; s++) {
+            evaluator.mod_switch_to_next_inplace(cipher);
+        }
+        for (int step : circuit.rotation_steps) {
+            evaluator.rotate_vector_inplace(cipher, step, gal_keys);
+            size_t shift = static_cast<size_t>((step % static_cast<int>(slots) + slots) % slots);
+            rotate(expected.begin(), expected.begin() + shift, expected.end());
+        }
+        elapsed_ms = chrono::duration<double, milli>(
+            chrono::high_resolution_clock::now() - start).count();
+
+        decryptor.decrypt(cipher, plain);
+        vector<double> decoded;
+        encoder.decode(plain, decoded);
+        double max_error = 0.0;
+        for (size_t i = 0; i < slots; i++) {
+            max_error = max(max_error, fabs(decoded[i] - expected[i]));
+        }
+        return max_error > 0.0 ? -log2(max_error) : 64.0;
+    }
+
+public:
+    explicit CKKSParameterPlanner(sec_level_type security = sec_level_type::tc128,
+                                  bool run_calibration = true)
+        : security(security), run_calibration(run_calibration) {}
+
+    ParameterPlan plan(const CircuitDescription& circuit) const {
+        int max_step = 0;
+        for (int step : circuit.rotation_steps) {
+            max_step = max(max_step, abs(step));
+        }
+
+        for (size_t n = 2048; n <= 32768; n *= 2) {
+            if (n / 2 < circuit.slot_demand || static_cast<size_t>(max_step) >= n / 2) {
+                continue;
+            }
+            int max_bits = CoeffModulus::MaxBitCount(n, security);
+
+            // Calibration may show the estimate was optimistic; widen the scale
+            for (int extra_bits = 0; extra_bits < 4; extra_bits++) {
+                int scale_bits = circuit.precision_bits
+                               + static_cast<int>(ceil(rounding_error_bits(n)
+                                                       + log2(circuit.multiplicative_depth + 1.0)))
+                               + extra_bits;
+                int first_bits = scale_bits + circuit.integer_bits + 1;
+                if (first_bits > 60) {
+                    break;
+                }
+
+                ParameterPlan candidate;
+                candidate.poly_modulus_degree = n;
+                candidate.scale_bits = scale_bits;
+                candidate.moduli_bits.push_back(first_bits);
+                // A switched-away prime may be dropped where a rescale would
+                // otherwise land, so it is sized like the scale primes
+                for (int d = 0; d < circuit.multiplicative_depth + circuit.modulus_switches; d++) {
+                    candidate.moduli_bits.push_back(scale_bits);
+                }
+                candidate.moduli_bits.push_back(first_bits); // Special prime for key switching
+
+                int total_bits = 0;
+                for (int bits : candidate.moduli_bits) total_bits += bits;
+                if (total_bits > max_bits) {
+                    break;
+                }
+
+                try {
+                    if (!run_calibration) {
+                        candidate.measured_precision_bits = scale_bits - rounding_error_bits(n);
+                        return candidate;
+                    }
+                    candidate.measured_precision_bits = calibrate(candidate, circuit, candidate.calibration_ms);
+                } catch (const exception&) {
+                    break; // Not enough NTT-friendly primes of these sizes for this N
+                }
+                if (candidate.measured_precision_bits >= circuit.precision_bits) {
+                    return candidate;
+                }
+            }
+        }
+        throw invalid_argument("No CKKS parameters satisfy the circuit at this security level");
+    }
+};
+
 class CKKSOptimizer {
 private:
-    // Knowledge graph of packing strategies
     struct PackingStrategy {
         size_t poly_degree;
         vector<int> moduli_bits;
@@ -20,29 +178,28 @@ private:
         string strategy_name;
     };
 
-    vector<PackingStrategy> strategy_graph;
+    CKKSParameterPlanner planner;
 
 public:
-    CKKSOptimizer() {
-        // Initialize knowledge graph with packing strategies (would normally come from a DB)
-        strategy_graph = {
-            {8192, {60, 40, 40, 60}, 40, 4096, "Balanced-8192"},
-            {16384, {60, 60, 60, 60}, 50, 8192, "High-Capacity-16384"},
-            {32768, {60, 60, 60, 60, 60}, 60, 16384, "Max-Capacity-32768"}
-        };
-    }
+    explicit CKKSOptimizer(sec_level_type security = sec_level_type::tc128)
+        : planner(security) {}
 
-    // RAG Feature 1: Retrieve optimal packing strategy
-    PackingStrategy get_optimal_strategy(size_t data_size, const string& hw_profile) {
-        // In a real system, this would query the knowledge graph with hardware capabilities
-        for (const auto& strategy : strategy_graph) {
-            if (data_size <= strategy.poly_degree / 2) {
-                cout << "Selected strategy: " << strategy.strategy_name 
-                     << " with batch size " << strategy.optimal_batch_size << endl;
-                return strategy;
-            }
-        }
-        return strategy_graph.back(); // Default to largest
+    // RAG Feature 1: Plan the smallest parameters for the circuit and data size
+    PackingStrategy get_optimal_strategy(size_t data_size, const CircuitDescription& circuit) {
+        CircuitDescription sized = circuit;
+        sized.slot_demand = max(sized.slot_demand, data_size);
+        ParameterPlan plan = planner.plan(sized);
+
+        PackingStrategy strategy{
+            plan.poly_modulus_degree, plan.moduli_bits, plan.scale_bits,
+            plan.poly_modulus_degree / 2,
+            "Planned-" + to_string(plan.poly_modulus_degree)
+        };
+        cout << "Selected strategy: " << strategy.strategy_name
+             << " with batch size " << strategy.optimal_batch_size
+             << " (calibrated " << fixed << setprecision(1) << plan.measured_precision_bits
+             << " bits in " << plan.calibration_ms << " ms)" << endl;
+        return strategy;
     }
 
     // RAG Feature 2: Selective extraction helper
@@ -58,12 +215,12 @@ public:
     }
 
     // RAG Feature 3: Hardware-aware batch size recommendation
-    size_t recommend_batch_size(const string& hw_profile) {
-        // Simulate hardware detection - in reality would use system profiling
+    size_t recommend_batch_size(const PackingStrategy& strategy, const string& hw_profile) {
+        // Low-memory hosts process half a ciphertext per batch
         if (hw_profile.find("highmem") != string::npos) {
-            return strategy_graph.back().optimal_batch_size;
+            return strategy.optimal_batch_size;
         }
-        return strategy_graph.front().optimal_batch_size;
+        return strategy.optimal_batch_size / 2;
     }
 };
 
@@ -76,9 +233,12 @@ int main() {
     const string hw_profile = "highmem_xeon";
     vector<size_t> extract_indices = {0, 100, 1000, 4095}; // Positions to verify
 
-    // Get optimal strategy from knowledge graph
-    auto strategy = optimizer.get_optimal_strategy(data_size, hw_profile);
-    size_t batch_size = optimizer.recommend_batch_size(hw_profile);
+    // Plan parameters for a single addition (no multiplications or rotations)
+    CircuitDescription circuit;
+    circuit.multiplicative_depth = 0;
+    circuit.precision_bits = 20;
+    auto strategy = optimizer.get_optimal_strategy(data_size, circuit);
+    size_t batch_size = optimizer.recommend_batch_size(strategy, hw_profile);
 
     // SEAL setup with optimal parameters
     EncryptionParameters parms(scheme_type::ckks);
@@ -3,11 +3,170 @@
 #include <vector>
 #include <map>
 #include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
 #include "seal/seal.h"
 
 using namespace std;
 using namespace seal;
 
+// Circuit-aware parameter planner: picks the smallest N and modulus chain that
+// fit the circuit at the requested security level, then confirms the estimate
+// by running a short calibration of the circuit's multiplications and rotations.
+struct CircuitDescription {
+    int multiplicative_depth = 1;
+    int modulus_switches = 0;  // Primes dropped by mod switches, beyond the rescales
+    vector<int> rotation_steps;
+    int precision_bits = 20;   // Required bits after the last operation
+    int integer_bits = 4;      // Bits needed for |value| before the binary point
+    size_t slot_demand = 1;
+};
+
+struct ParameterPlan {
+    size_t poly_modulus_degree = 0;
+    vector<int> moduli_bits;
+    int scale_bits = 0;
+    double measured_precision_bits = 0.0;
+    double calibration_ms = 0.0;
+};
+
+class CKKSParameterPlanner {
+private:
+    sec_level_type security;
+    bool run_calibration;
+
+    // log2 of the rescale rounding error for a ternary secret (HEAAN bound)
+    static double rounding_error_bits(size_t n) {
+        double h = 2.0 * n / 3.0;
+        return log2(sqrt(n / 3.0) * (3.0 + 8.0 * sqrt(h)));
+    }
+
+    double calibrate(const ParameterPlan& plan, const CircuitDescription& circuit,
+                     double& elapsed_ms) const {
+        EncryptionParameters parms(scheme_type::ckks);
+        parms.set_poly_modulus_degree(plan.poly_modulus_degree);
+        parms.set_coeff_modulus(CoeffModulus::Create(plan.poly_modulus_degree, plan.moduli_bits));
+        SEALContext context(parms, true, security);
+        if (!context.parameters_set()) {
+            return 0.0;
+        }
+
+        KeyGenerator keygen(context);
+        PublicKey public_key;
+        keygen.create_public_key(public_key);
+        RelinKeys relin_keys;
+        keygen.create_relin_keys(relin_keys);
+        GaloisKeys gal_keys;
+        if (!circuit.rotation_steps.empty()) {
+            keygen.create_galois_keys(circuit.rotation_steps, gal_keys);
+        }
+        CKKSEncoder encoder(context);
+        Encryptor encryptor(context, public_key);
+        Evaluator evaluator(context);
+        Decryptor decryptor(context, keygen.secret_key());
+
+        size_t slots = encoder.slot_count();
+        vector<double> expected(slots);
+        for (size_t i = 0; i < slots; i++) {
+            expected[i] = sin(0.01 * static_cast<double>(i));
+        }
+        Plaintext plain;
+        encoder.encode(expected, pow(2.0, plan.scale_bits), plain);
+        Ciphertext cipher;
+        encryptor.encrypt(plain, cipher);
+
+        auto start = chrono::high_resolution_clock::now();
+        for (int d = 0; d < circuit.multiplicative_depth; d++) {
+            evaluator.square_inplace(cipher);
+            evaluator.relinearize_inplace(cipher, relin_keys);
+            evaluator.rescale_to_next_inplace(cipher);
+            for (auto& v : expected) v *= v;
+        }
+        for (int s = 0; s < circuit.modulus_switches; s++) {
+            evaluator.mod_switch_to_next_inplace(cipher);
+        }
+        for (int step : circuit.rotation_steps) {
+            evaluator.rotate_vector_inplace(cipher, step, gal_keys);
+            size_t shift = static_cast<size_t>((step % static_cast<int>(slots) + slots) % slots);
+            rotate(expected.begin(), expected.begin() + shift, expected.end());
+        }
+        elapsed_ms = chrono::duration<double, milli>(
+            chrono::high_resolution_clock::now() - start).count();
+
+        decryptor.decrypt(cipher, plain);
+        vector<double> decoded;
+        encoder.decode(plain, decoded);
+        double max_error = 0.0;
+        for (size_t i = 0; i < slots; i++) {
+            max_error = max(max_error, fabs(decoded[i] - expected[i]));
+        }
+        return max_error > 0.0 ? -log2(max_error) : 64.0;
+    }
+
+public:
+    explicit CKKSParameterPlanner(sec_level_type security = sec_level_type::tc128,
+                                  bool run_calibration = true)
+        : security(security), run_calibration(run_calibration) {}
+
+    ParameterPlan plan(const CircuitDescription& circuit) const {
+        int max_step = 0;
+        for (int step : circuit.rotation_steps) {
+            max_step = max(max_step, abs(step));
+        }
+
+        for (size_t n = 2048; n <= 32768; n *= 2) {
+            if (n / 2 < circuit.slot_demand || static_cast<size_t>(max_step) >= n / 2) {
+                continue;
+            }
+            int max_bits = CoeffModulus::MaxBitCount(n, security);
+
+            // Calibration may show the estimate was optimistic; widen the scale
+            for (int extra_bits = 0; extra_bits < 4; extra_bits++) {
+                int scale_bits = circuit.precision_bits
+                               + static_cast<int>(ceil(rounding_error_bits(n)
+                                                       + log2(circuit.multiplicative_depth + 1.0)))
+                               + extra_bits;
+                int first_bits = scale_bits + circuit.integer_bits + 1;
+                if (first_bits > 60) {
+                    break;
+                }
+
+                ParameterPlan candidate;
+                candidate.poly_modulus_degree = n;
+                candidate.scale_bits = scale_bits;
+                candidate.moduli_bits.push_back(first_bits);
+                // A switched-away prime may be dropped where a rescale would
+                // otherwise land, so it is sized like the scale primes
+                for (int d = 0; d < circuit.multiplicative_depth + circuit.modulus_switches; d++) {
+                    candidate.moduli_bits.push_back(scale_bits);
+                }
+                candidate.moduli_bits.push_back(first_bits); // Special prime for key switching
+
+                int total_bits = 0;
+                for (int bits : candidate.moduli_bits) total_bits += bits;
+                if (total_bits > max_bits) {
+                    break;
+                }
+
+                try {
+                    if (!run_calibration) {
+                        candidate.measured_precision_bits = scale_bits - rounding_error_bits(n);
+                        return candidate;
+                    }
+                    candidate.measured_precision_bits = calibrate(candidate, circuit, candidate.calibration_ms);
+                } catch (const exception&) {
+                    break; // Not enough NTT-friendly primes of these sizes for this N
+                }
+                if (candidate.measured_precision_bits >= circuit.precision_bits) {
+                    return candidate;
+                }
+            }
+        }
+        throw invalid_argument("No CKKS parameters satisfy the circuit at this security level");
+    }
+};
+
 class NoiseAwareCKKS {
 private:
     shared_ptr<SEALContext> context;
@@ -23,46 +182,57 @@ private:
     double scale;
     size_t poly_modulus_degree;
 
-    // RAG Feature 1: Graph of modulus switching paths
+    // RAG Feature 1: Modulus switching path derived from the planned chain
     struct ModulusSwitchPath {
         vector<int> moduli_bits;
         vector<size_t> optimal_switch_points;
         string path_name;
     };
-    vector<ModulusSwitchPath> modulus_paths;
+    ModulusSwitchPath modulus_path;
 
     // RAG Feature 2: Noise tracking system
     struct OperationRecord {
         string op_name;
         int level;
-        double noise_estimate;
+        double log2_scale;
+        double error_bound;
+        double observed_error; // < 0 when not measured (debug mode off)
     };
     vector<OperationRecord> noise_history;
 
+    // Error model constants (SEAL samples errors with sigma = 3.2 and uses a
+    // uniform ternary secret, so about 2N/3 coefficients are non-zero)
+    static constexpr double noise_sigma = 3.2;
+    bool debug_mode;
+
 public:
-    NoiseAwareCKKS(size_t poly_degree = 8192, int security_level = 128) {
-        initialize_context(poly_degree, security_level);
-        initialize_modulus_paths();
+    // Ciphertext plus the metadata needed to propagate an analytic error bound.
+    // Scale and level are read from the ciphertext itself, so they are exact;
+    // message_bound and error_bound are in slot (decoded value) units.
+    struct TrackedCiphertext {
+        Ciphertext cipher;
+        double message_bound = 0.0;
+        double error_bound = 0.0;
+        vector<double> shadow; // Plaintext reference, only kept in debug mode
+    };
+
+    NoiseAwareCKKS(const CircuitDescription& circuit,
+                   sec_level_type security = sec_level_type::tc128, bool debug = false)
+        : debug_mode(debug) {
+        ParameterPlan plan = CKKSParameterPlanner(security).plan(circuit);
+        initialize_context(plan, security);
+        initialize_modulus_path(plan);
     }
 
-    void initialize_context(size_t poly_degree, int security_level) {
-        poly_modulus_degree = poly_degree;
-        
-        // Select parameters based on security level
-        vector<int> moduli_bits;
-        if (security_level == 128) {
-            moduli_bits = {50, 40, 40, 50};
-            scale = pow(2.0, 40);
-        } else { // 192-bit
-            moduli_bits = {60, 50, 50, 60};
-            scale = pow(2.0, 50);
-        }
+    void initialize_context(const ParameterPlan& plan, sec_level_type security) {
+        poly_modulus_degree = plan.poly_modulus_degree;
+        scale = pow(2.0, plan.scale_bits);
 
         EncryptionParameters parms(scheme_type::ckks);
-        parms.set_poly_modulus_degree(poly_degree);
-        parms.set_coeff_modulus(CoeffModulus::Create(poly_degree, moduli_bits));
+        parms.set_poly_modulus_degree(poly_modulus_degree);
+        parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, plan.moduli_bits));
 
-        context = make_shared<SEALContext>(parms);
+        context = make_shared<SEALContext>(parms, true, security);
         keygen = make_unique<KeyGenerator>(*context);
         keygen->create_public_key(public_key);
         secret_key = keygen->secret_key();
@@ -75,96 +245,187 @@ public:
         encoder = make_unique<CKKSEncoder>(*context);
     }
 
-    void initialize_modulus_paths() {
-        // Predefined modulus switching paths (would come from knowledge graph)
-        modulus_paths = {
-            {{50, 40, 40, 50}, {2, 1}, "Balanced-4Level"},
-            {{60, 50, 40, 40, 50}, {3, 2, 1}, "Extended-5Level"},
-            {{60, 50, 40, 40, 40, 50}, {4, 3, 2, 1}, "Deep-6Level"}
-        };
+    // One switch point per data level below the top, in the order they are reached
+    void initialize_modulus_path(const ParameterPlan& plan) {
+        size_t data_levels = plan.moduli_bits.size() - 2;
+        modulus_path.moduli_bits = plan.moduli_bits;
+        modulus_path.path_name = "Planned-" + to_string(plan.moduli_bits.size()) + "Level";
+        for (size_t level = data_levels; level >= 1; level--) {
+            modulus_path.optimal_switch_points.push_back(level);
+        }
     }
 
     // RAG Feature 3: Retrieve optimal switching points
-    vector<size_t> get_optimal_switch_points(const string& path_name) {
-        for (const auto& path : modulus_paths) {
-            if (path.path_name == path_name) {
-                return path.optimal_switch_points;
-            }
-        }
-        return modulus_paths[0].optimal_switch_points; // Default
+    const ModulusSwitchPath& get_modulus_path() const {
+        return modulus_path;
     }
 
-    // Noise estimation functions
-    double estimate_noise(const Ciphertext& cipher) {
-        // Simplified noise estimation - in practice would use more accurate methods
-        auto context_data = context->get_context_data(cipher.parms_id());
-        size_t level = context_data->chain_index();
-        double noise_est = 100.0 / (level + 1);
-        return noise_est;
+    // Canonical-embedding error bounds in coefficient units (HEAAN-style
+    // high-probability bounds); dividing by the scale gives slot-level error
+    double hamming_weight() const {
+        return 2.0 * poly_modulus_degree / 3.0;
+    }
+
+    double fresh_error_coeff() const {
+        double n = static_cast<double>(poly_modulus_degree);
+        return 8.0 * sqrt(2.0) * noise_sigma * n + 6.0 * noise_sigma * sqrt(n)
+             + 16.0 * noise_sigma * sqrt(hamming_weight() * n);
+    }
+
+    double rounding_error_coeff() const {
+        double n = static_cast<double>(poly_modulus_degree);
+        return sqrt(n / 3.0) * (3.0 + 8.0 * sqrt(hamming_weight()));
+    }
+
+    double encode_error_coeff() const {
+        return sqrt(static_cast<double>(poly_modulus_degree) / 3.0) * 3.0;
     }
 
-    void record_operation(const string& op_name, const Ciphertext& cipher) {
+    // Key switching uses one special prime P and one digit per remaining prime
+    double keyswitch_error_coeff(const Ciphertext& cipher) const {
         auto context_data = context->get_context_data(cipher.parms_id());
+        const auto& moduli = context_data->parms().coeff_modulus();
+        double special_prime = static_cast<double>(
+            context->key_context_data()->parms().coeff_modulus().back().value());
+        double max_prime = 0.0;
+        for (const auto& q : moduli) {
+            max_prime = max(max_prime, static_cast<double>(q.value()));
+        }
+        double n = static_cast<double>(poly_modulus_degree);
+        double digit_error = 8.0 * noise_sigma * n / sqrt(3.0);
+        return moduli.size() * max_prime * digit_error / special_prime + rounding_error_coeff();
+    }
+
+    size_t level_of(const Ciphertext& cipher) const {
+        return context->get_context_data(cipher.parms_id())->chain_index();
+    }
+
+    // Bits of precision left: log2(|message| / error)
+    double precision_bits(const TrackedCiphertext& tc) const {
+        double message = max(tc.message_bound, 1.0);
+        return log2(message / tc.error_bound);
+    }
+
+    bool meets_precision(const TrackedCiphertext& tc, double required_bits) const {
+        return precision_bits(tc) >= required_bits;
+    }
+
+    // Debug mode: compare the analytic bound against the actual decryption error
+    double measure_error(const TrackedCiphertext& tc) {
+        vector<double> decoded = decrypt_vector(tc);
+        double observed = 0.0;
+        for (size_t i = 0; i < tc.shadow.size(); i++) {
+            observed = max(observed, fabs(decoded[i] - tc.shadow[i]));
+        }
+        if (observed > tc.error_bound) {
+            cerr << "Warning: observed error " << observed
+                 << " exceeds analytic bound " << tc.error_bound << endl;
+        }
+        return observed;
+    }
+
+    void record_operation(const string& op_name, const TrackedCiphertext& tc) {
+        double observed = debug_mode ? measure_error(tc) : -1.0;
         noise_history.push_back({
             op_name,
-            static_cast<int>(context_data->chain_index()),
-            estimate_noise(cipher)
+            static_cast<int>(level_of(tc.cipher)),
+            log2(tc.cipher.scale()),
+            tc.error_bound,
+            observed
         });
     }
 
     // RAG Feature 4: Visual progress tracking
     void print_noise_history() {
         cout << "\nNoise Budget Tracking:\n";
-        cout << "-------------------------------------------------\n";
-        cout << "| Operation       | Level | Noise Estimate |\n";
-        cout << "-------------------------------------------------\n";
+        cout << "------------------------------------------------------------------\n";
+        cout << "| Operation       | Level | log2(scale) | Error Bound | Observed    |\n";
+        cout << "------------------------------------------------------------------\n";
         
         for (const auto& record : noise_history) {
             cout << "| " << setw(15) << left << record.op_name
                  << " | " << setw(5) << record.level
-                 << " | " << setw(13) << fixed << setprecision(2) << record.noise_estimate
-                 << " |\n";
+                 << " | " << setw(11) << fixed << setprecision(2) << record.log2_scale
+                 << " | " << setw(11) << scientific << setprecision(3) << record.error_bound
+                 << " | ";
+            if (record.observed_error >= 0) {
+                cout << setw(11) << record.observed_error;
+            } else {
+                cout << setw(11) << "-";
+            }
+            cout << " |\n" << defaultfloat;
         }
-        cout << "-------------------------------------------------\n";
+        cout << "------------------------------------------------------------------\n";
     }
 
     // CKKS Operations with noise tracking
-    Ciphertext encrypt_vector(const vector<double>& values) {
+    TrackedCiphertext encrypt_vector(const vector<double>& values) {
+        TrackedCiphertext tc;
         Plaintext plain;
         encoder->encode(values, scale, plain);
-        Ciphertext cipher;
-        encryptor->encrypt(plain, cipher);
-        record_operation("Encrypt", cipher);
-        return cipher;
+        encryptor->encrypt(plain, tc.cipher);
+        for (double v : values) {
+            tc.message_bound = max(tc.message_bound, fabs(v));
+        }
+        tc.error_bound = (fresh_error_coeff() + encode_error_coeff()) / tc.cipher.scale();
+        if (debug_mode) {
+            tc.shadow = values;
+        }
+        record_operation("Encrypt", tc);
+        return tc;
     }
 
-    Ciphertext add_vectors(const Ciphertext& a, const Ciphertext& b) {
-        Ciphertext result;
-        evaluator->add(a, b, result);
+    TrackedCiphertext add_vectors(const TrackedCiphertext& a, const TrackedCiphertext& b) {
+        TrackedCiphertext result;
+        evaluator->add(a.cipher, b.cipher, result.cipher);
+        result.message_bound = a.message_bound + b.message_bound;
+        result.error_bound = a.error_bound + b.error_bound;
+        if (debug_mode) {
+            result.shadow.resize(min(a.shadow.size(), b.shadow.size()));
+            for (size_t i = 0; i < result.shadow.size(); i++) {
+                result.shadow[i] = a.shadow[i] + b.shadow[i];
+            }
+        }
         record_operation("Add", result);
         return result;
     }
 
-    Ciphertext multiply_vectors(const Ciphertext& a, const Ciphertext& b) {
-        Ciphertext result;
-        evaluator->multiply(a, b, result);
-        evaluator->relinearize_inplace(result, relin_keys);
-        evaluator->rescale_to_next_inplace(result);
+    TrackedCiphertext multiply_vectors(const TrackedCiphertext& a, const TrackedCiphertext& b) {
+        TrackedCiphertext result;
+        evaluator->multiply(a.cipher, b.cipher, result.cipher);
+        evaluator->relinearize_inplace(result.cipher, relin_keys);
+        double product_scale = result.cipher.scale();
+        double relin_error = keyswitch_error_coeff(result.cipher) / product_scale;
+        evaluator->rescale_to_next_inplace(result.cipher);
+
+        result.message_bound = a.message_bound * b.message_bound;
+        result.error_bound = a.message_bound * b.error_bound
+                           + b.message_bound * a.error_bound
+                           + a.error_bound * b.error_bound
+                           + relin_error
+                           + rounding_error_coeff() / result.cipher.scale();
+        if (debug_mode) {
+            result.shadow.resize(min(a.shadow.size(), b.shadow.size()));
+            for (size_t i = 0; i < result.shadow.size(); i++) {
+                result.shadow[i] = a.shadow[i] * b.shadow[i];
+            }
+        }
         record_operation("Multiply", result);
         return result;
     }
 
-    vector<double> decrypt_vector(const Ciphertext& cipher) {
+    vector<double> decrypt_vector(const TrackedCiphertext& tc) {
         Plaintext plain;
-        decryptor->decrypt(cipher, plain);
+        decryptor->decrypt(tc.cipher, plain);
         vector<double> result;
         encoder->decode(plain, result);
         return result;
     }
 
-    void modulus_switch_to_next(Ciphertext& cipher) {
-        evaluator->mod_switch_to_next_inplace(cipher);
-        record_operation("ModSwitch", cipher);
+    // Dropping primes in CKKS keeps the scale and adds no error
+    void modulus_switch_to_next(TrackedCiphertext& tc) {
+        evaluator->mod_switch_to_next_inplace(tc.cipher);
+        record_operation("ModSwitch", tc);
     }
 };
 
@@ -172,8 +433,15 @@ int main() {
     cout << "Noise-Aware CKKS System with RAG Features\n";
     cout << "=========================================\n";
 
-    // Initialize system with RAG capabilities
-    NoiseAwareCKKS ckks(8192, 128);
+    // Plan for one multiplication followed by two modulus switches
+    CircuitDescription circuit;
+    circuit.multiplicative_depth = 1;
+    circuit.modulus_switches = 2;
+    circuit.precision_bits = 20;
+    circuit.slot_demand = 4;
+
+    // Initialize system with RAG capabilities (debug mode checks error bounds)
+    NoiseAwareCKKS ckks(circuit, sec_level_type::tc128, true);
 
     // Input data
     vector<double> vec1 = {1.0, 2.0, 3.0, 4.0};
@@ -192,8 +460,9 @@ int main() {
     ckks.modulus_switch_to_next(cipher_mult);
 
     // Retrieve optimal switching points from knowledge graph
-    auto switch_points = ckks.get_optimal_switch_points("Balanced-4Level");
-    cout << "\nOptimal switching points from RAG: ";
+    const auto& path = ckks.get_modulus_path();
+    const auto& switch_points = path.optimal_switch_points;
+    cout << "\nOptimal switching points for " << path.path_name << ": ";
     for (auto pt : switch_points) cout << pt << " ";
     cout << endl;
 
@@ -210,6 +479,11 @@ int main() {
     for (auto val : result_mult) cout << val << " ";
     cout << "]\n";
 
+    cout << "\nPrecision bits (add/mult): " << ckks.precision_bits(cipher_add)
+         << " / " << ckks.precision_bits(cipher_mult) << endl;
+    cout << "Meets 20-bit requirement: "
+         << (ckks.meets_precision(cipher_mult, 20.0) ? "yes" : "no") << endl;
+
     // Display noise tracking history
     ckks.print_noise_history();
 
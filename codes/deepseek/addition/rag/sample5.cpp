@@ -7,6 +7,16 @@
 #include <unordered_map>
 #include <unistd.h>
 #include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <future>
+#include <iterator>
+#include <cstdint>
+#include <string>
 #include "seal/seal.h"
 
 #ifdef _WIN32
@@ -19,14 +29,276 @@
 using namespace std;
 using namespace seal;
 
+// Circuit-aware parameter planner: picks the smallest N and modulus chain that
+// fit the circuit at the requested security level, then confirms the estimate
+// by running a short calibration of the circuit's multiplications and rotations.
+struct CircuitDescription {
+    int multiplicative_depth = 1;
+    int modulus_switches = 0;  // Primes dropped by mod switches, beyond the rescales
+    vector<int> rotation_steps;
+    int precision_bits = 20;   // Required bits after the last operation
+    int integer_bits = 4;      // Bits needed for |value| before the binary point
+    size_t slot_demand = 1;
+};
+
+struct ParameterPlan {
+    size_t poly_modulus_degree = 0;
+    vector<int> moduli_bits;
+    int scale_bits = 0;
+    double measured_precision_bits = 0.0;
+    double calibration_ms = 0.0;
+};
+
+class CKKSParameterPlanner {
+private:
+    sec_level_type security;
+    bool run_calibration;
+
+    // log2 of the rescale rounding error for a ternary secret (HEAAN bound)
+    static double rounding_error_bits(size_t n) {
+        double h = 2.0 * n / 3.0;
+        return log2(sqrt(n / 3.0) * (3.0 + 8.0 * sqrt(h)));
+    }
+
+    double calibrate(const ParameterPlan& plan, const CircuitDescription& circuit,
+                     double& elapsed_ms) const {
+        EncryptionParameters parms(scheme_type::ckks);
+        parms.set_poly_modulus_degree(plan.poly_modulus_degree);
+        parms.set_coeff_modulus(CoeffModulus::Create(plan.poly_modulus_degree, plan.moduli_bits));
+        SEALContext context(parms, true, security);
+        if (!context.parameters_set()) {
+            return 0.0;
+        }
+
+        KeyGenerator keygen(context);
+        PublicKey public_key;
+        keygen.create_public_key(public_key);
+        RelinKeys relin_keys;
+        keygen.create_relin_keys(relin_keys);
+        GaloisKeys gal_keys;
+        if (!circuit.rotation_steps.empty()) {
+            keygen.create_galois_keys(circuit.rotation_steps, gal_keys);
+        }
+        CKKSEncoder encoder(context);
+        Encryptor encryptor(context, public_key);
+        Evaluator evaluator(context);
+        Decryptor decryptor(context, keygen.secret_key());
+
+        size_t slots = encoder.slot_count();
+        vector<double> expected(slots);
+        for (size_t i = 0; i < slots; i++) {
+            expected[i] = sin(0.01 * static_cast<double>(i));
+        }
+        Plaintext plain;
+        encoder.encode(expected, pow(2.0, plan.scale_bits), plain);
+        Ciphertext cipher;
+        encryptor.encrypt(plain, cipher);
+
+        auto start = chrono::high_resolution_clock::now();
+        for (int d = 0; d < circuit.multiplicative_depth; d++) {
+            evaluator.square_inplace(cipher);
+            evaluator.relinearize_inplace(cipher, relin_keys);
+            evaluator.rescale_to_next_inplace(cipher);
+            for (auto& v : expected) v *= v;
+        }
+        for (int s = 0; s < circuit.modulus_switches; s++) {
+            evaluator.mod_switch_to_next_inplace(cipher);
+        }
+        for (int step : circuit.rotation_steps) {
+            evaluator.rotate_vector_inplace(cipher, step, gal_keys);
+            size_t shift = static_cast<size_t>((step % static_cast<int>(slots) + slots) % slots);
+            rotate(expected.begin(), expected.begin() + shift, expected.end());
+        }
+        elapsed_ms = chrono::duration<double, milli>(
+            chrono::high_resolution_clock::now() - start).count();
+
+        decryptor.decrypt(cipher, plain);
+        vector<double> decoded;
+        encoder.decode(plain, decoded);
+        double max_error = 0.0;
+        for (size_t i = 0; i < slots; i++) {
+            max_error = max(max_error, fabs(decoded[i] - expected[i]));
+        }
+        return max_error > 0.0 ? -log2(max_error) : 64.0;
+    }
+
+public:
+    explicit CKKSParameterPlanner(sec_level_type security = sec_level_type::tc128,
+                                  bool run_calibration = true)
+        : security(security), run_calibration(run_calibration) {}
+
+    ParameterPlan plan(const CircuitDescription& circuit) const {
+        int max_step = 0;
+        for (int step : circuit.rotation_steps) {
+            max_step = max(max_step, abs(step));
+        }
+
+        for (size_t n = 2048; n <= 32768; n *= 2) {
+            if (n / 2 < circuit.slot_demand || static_cast<size_t>(max_step) >= n / 2) {
+                continue;
+            }
+            int max_bits = CoeffModulus::MaxBitCount(n, security);
+
+            // Calibration may show the estimate was optimistic; widen the scale
+            for (int extra_bits = 0; extra_bits < 4; extra_bits++) {
+                int scale_bits = circuit.precision_bits
+                               + static_cast<int>(ceil(rounding_error_bits(n)
+                                                       + log2(circuit.multiplicative_depth + 1.0)))
+                               + extra_bits;
+                int first_bits = scale_bits + circuit.integer_bits + 1;
+                if (first_bits > 60) {
+                    break;
+                }
+
+                ParameterPlan candidate;
+                candidate.poly_modulus_degree = n;
+                candidate.scale_bits = scale_bits;
+                candidate.moduli_bits.push_back(first_bits);
+                // A switched-away prime may be dropped where a rescale would
+                // otherwise land, so it is sized like the scale primes
+                for (int d = 0; d < circuit.multiplicative_depth + circuit.modulus_switches; d++) {
+                    candidate.moduli_bits.push_back(scale_bits);
+                }
+                candidate.moduli_bits.push_back(first_bits); // Special prime for key switching
+
+                int total_bits = 0;
+                for (int bits : candidate.moduli_bits) total_bits += bits;
+                if (total_bits > max_bits) {
+                    break;
+                }
+
+                try {
+                    if (!run_calibration) {
+                        candidate.measured_precision_bits = scale_bits - rounding_error_bits(n);
+                        return candidate;
+                    }
+                    candidate.measured_precision_bits = calibrate(candidate, circuit, candidate.calibration_ms);
+                } catch (const exception&) {
+                    break; // Not enough NTT-friendly primes of these sizes for this N
+                }
+                if (candidate.measured_precision_bits >= circuit.precision_bits) {
+                    return candidate;
+                }
+            }
+        }
+        throw invalid_argument("No CKKS parameters satisfy the circuit at this security level");
+    }
+};
+
+// Blocking FIFO with a fixed capacity. close() wakes every waiter: push then
+// fails, while pop keeps draining what is left before reporting the end.
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(max<size_t>(capacity, 1)) {}
+
+    bool push(T item) {
+        unique_lock<mutex> lock(queue_mutex);
+        not_full.wait(lock, [&] { return closed || items.size() < capacity; });
+        if (closed) return false;
+        items.push_back(move(item));
+        not_empty.notify_one();
+        return true;
+    }
+
+    bool pop(T& item) {
+        unique_lock<mutex> lock(queue_mutex);
+        not_empty.wait(lock, [&] { return closed || !items.empty(); });
+        if (items.empty()) return false;
+        item = move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        lock_guard<mutex> lock(queue_mutex);
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+private:
+    size_t capacity;
+    deque<T> items;
+    bool closed = false;
+    mutex queue_mutex;
+    condition_variable not_full;
+    condition_variable not_empty;
+};
+
+// Ordered three-stage pipeline. produce() runs on its own thread, transform()
+// on `workers` threads and consume() on the calling thread in input order.
+// Every item's future is queued in order before its work is queued, so at
+// most `depth` items are in flight and memory stays bounded for any stream
+// length. The first exception from any stage stops the pipeline and is
+// rethrown here.
+template<typename In, typename Out, typename Produce, typename Transform, typename Consume>
+void run_ordered_pipeline(Produce produce, Transform transform, Consume consume,
+                          size_t workers, size_t depth) {
+    struct Task {
+        In input;
+        promise<Out> output;
+    };
+    BoundedQueue<Task> tasks(depth);
+    BoundedQueue<future<Out>> ordered(depth);
+
+    thread reader([&] {
+        try {
+            In input;
+            while (produce(input)) {
+                Task task{move(input), promise<Out>()};
+                if (!ordered.push(task.output.get_future()) || !tasks.push(move(task))) break;
+                input = In();
+            }
+        } catch (...) {
+            promise<Out> failed;
+            failed.set_exception(current_exception());
+            ordered.push(failed.get_future());
+        }
+        tasks.close();
+        ordered.close();
+    });
+
+    vector<thread> pool;
+    for (size_t w = 0; w < max<size_t>(workers, 1); w++) {
+        pool.emplace_back([&] {
+            Task task;
+            while (tasks.pop(task)) {
+                try {
+                    task.output.set_value(transform(task.input));
+                } catch (...) {
+                    task.output.set_exception(current_exception());
+                }
+            }
+        });
+    }
+
+    exception_ptr error;
+    future<Out> next;
+    while (ordered.pop(next)) {
+        try {
+            Out output = next.get();
+            consume(output);
+        } catch (...) {
+            error = current_exception();
+            break;
+        }
+    }
+    tasks.close();
+    ordered.close();
+    reader.join();
+    for (auto& t : pool) t.join();
+    if (error) rethrow_exception(error);
+}
+
 class MemoryOptimizedCKKS {
 private:
     struct MemoryProfile {
         string platform;
         size_t total_memory;
         size_t available_memory;
-        size_t optimal_chunk_size;
-        vector<int> recommended_moduli;
+        size_t max_poly_degree;
     };
 
     vector<MemoryProfile> memory_graph;
@@ -54,33 +326,31 @@ private:
         size_t system_mem = get_system_memory();
         cout << "Detected system memory: " << system_mem << " MB\n";
 
+        // Profiles only cap N; the moduli come from the parameter planner
         memory_graph = {
-            {"Low-Memory", 4096, static_cast<size_t>(4096 * 0.75), 4096, {40, 30, 40}},
-            {"Standard", 8192, static_cast<size_t>(8192 * 0.75), 8192, {50, 40, 50}},
-            {"High-Memory", 16384, static_cast<size_t>(16384 * 0.75), 16384, {60, 50, 60}},
-            {"Server-Grade", 32768, static_cast<size_t>(32768 * 0.75), 32768, {60, 50, 40, 50, 60}}
+            {"Low-Memory", 4096, static_cast<size_t>(4096 * 0.75), 4096},
+            {"Standard", 8192, static_cast<size_t>(8192 * 0.75), 8192},
+            {"High-Memory", 16384, static_cast<size_t>(16384 * 0.75), 16384},
+            {"Server-Grade", 32768, static_cast<size_t>(32768 * 0.75), 32768}
         };
-
-        memory_graph.push_back({
-            "Current-System",
-            system_mem,
-            static_cast<size_t>(system_mem * 0.75),
-            0,
-            {}
-        });
     }
 
-    vector<vector<double>> split_into_chunks(const vector<double>& data, size_t chunk_size) {
-        vector<vector<double>> chunks;
-        for (size_t i = 0; i < data.size(); i += chunk_size) {
-            size_t end = min(i + chunk_size, data.size());
-            chunks.emplace_back(data.begin() + i, data.begin() + end);
-        }
-        return chunks;
+    // Stream record: value count, byte count, then the serialized ciphertext.
+    // The count lets decryption drop the padding slots of the last chunk.
+    struct StreamRecord {
+        uint32_t value_count = 0;
+        vector<seal_byte> bytes;
+    };
+
+    static size_t default_workers() {
+        // The reader and the writer each keep a core busy
+        unsigned cores = thread::hardware_concurrency();
+        return cores > 2 ? cores - 2 : 1;
     }
 
 public:
-    MemoryOptimizedCKKS(size_t poly_degree = 0) {
+    MemoryOptimizedCKKS(const CircuitDescription& circuit = CircuitDescription(),
+                        sec_level_type security = sec_level_type::tc128) {
         init_memory_graph();
         
         const MemoryProfile* best_profile = &memory_graph[0];
@@ -93,74 +363,120 @@ public:
             }
         }
 
-        poly_modulus_degree = poly_degree ? poly_degree : best_profile->optimal_chunk_size;
+        ParameterPlan plan = CKKSParameterPlanner(security).plan(circuit);
+        if (plan.poly_modulus_degree > best_profile->max_poly_degree) {
+            throw runtime_error("Planned N = " + to_string(plan.poly_modulus_degree) +
+                                " exceeds the " + best_profile->platform + " memory profile");
+        }
+
+        poly_modulus_degree = plan.poly_modulus_degree;
         slot_count = poly_modulus_degree / 2;
+        vector<int> moduli_bits = plan.moduli_bits;
         
         cout << "Selected memory profile: " << best_profile->platform 
-             << " with chunk size " << poly_modulus_degree 
+             << " with planned chunk size " << poly_modulus_degree 
              << " (" << slot_count << " slots)\n";
 
-        vector<int> moduli_bits;
-        if (best_profile->recommended_moduli.empty()) {
-            if (poly_modulus_degree <= 4096) {
-                moduli_bits = {40, 30, 40};
-            } else if (poly_modulus_degree <= 8192) {
-                moduli_bits = {50, 40, 50};
-            } else {
-                moduli_bits = {60, 50, 60};
-            }
-        } else {
-            moduli_bits = best_profile->recommended_moduli;
-        }
-
         EncryptionParameters parms(scheme_type::ckks);
         parms.set_poly_modulus_degree(poly_modulus_degree);
         parms.set_coeff_modulus(CoeffModulus::Create(
             poly_modulus_degree, moduli_bits));
 
-        context = make_shared<SEALContext>(parms);
+        context = make_shared<SEALContext>(parms, true, security);
         encoder = make_unique<CKKSEncoder>(*context);
         
         // Generate keys during construction
         KeyGenerator keygen(*context);
         secret_key = keygen.secret_key();
         
-        scale = pow(2.0, moduli_bits[0] - 10);
+        scale = pow(2.0, plan.scale_bits);
     }
 
-    vector<Ciphertext> encrypt_data(const vector<double>& data) {
-        auto chunks = split_into_chunks(data, slot_count);
-        vector<Ciphertext> ciphertexts;
+    // Streams values from [first, last) through encode, encrypt and serialize
+    // into sink, one slot_count chunk at a time. Encryption is symmetric, so
+    // each record is a seeded ciphertext of about half the usual size. Memory
+    // is bounded by `depth` chunks in flight. Returns the records written.
+    template<typename InputIt>
+    size_t encrypt_stream(InputIt first, InputIt last, ostream& sink,
+                          size_t workers = default_workers(), size_t depth = 0) {
+        Encryptor encryptor(*context, secret_key);
+        size_t records = 0;
 
-        PublicKey public_key;
-        KeyGenerator keygen(*context, secret_key);
-        keygen.create_public_key(public_key);
-        Encryptor encryptor(*context, public_key);
+        run_ordered_pipeline<vector<double>, StreamRecord>(
+            [&](vector<double>& chunk) {
+                chunk.reserve(slot_count);
+                while (chunk.size() < slot_count && first != last) {
+                    chunk.push_back(*first);
+                    ++first;
+                }
+                return !chunk.empty();
+            },
+            [&](vector<double>& chunk) {
+                Plaintext plain;
+                encoder->encode(chunk, scale, plain);
+                auto cipher = encryptor.encrypt_symmetric(plain);
+                StreamRecord record;
+                record.value_count = static_cast<uint32_t>(chunk.size());
+                record.bytes.resize(static_cast<size_t>(cipher.save_size()));
+                record.bytes.resize(static_cast<size_t>(cipher.save(record.bytes.data(), record.bytes.size())));
+                return record;
+            },
+            [&](StreamRecord& record) {
+                uint64_t size = record.bytes.size();
+                sink.write(reinterpret_cast<const char*>(&record.value_count), sizeof(record.value_count));
+                sink.write(reinterpret_cast<const char*>(&size), sizeof(size));
+                sink.write(reinterpret_cast<const char*>(record.bytes.data()), record.bytes.size());
+                if (!sink) throw runtime_error("encrypt_stream: write failed");
+                records++;
+            },
+            workers, depth ? depth : 2 * workers);
+        return records;
+    }
 
-        for (const auto& chunk : chunks) {
-            Plaintext plain;
-            encoder->encode(chunk, scale, plain);
-            Ciphertext cipher;
-            encryptor.encrypt(plain, cipher);
-            ciphertexts.push_back(std::move(cipher));
-        }
-        
-        return ciphertexts;
+    // Whitespace-separated values from a text stream or file
+    size_t encrypt_stream(istream& source, ostream& sink) {
+        return encrypt_stream(istream_iterator<double>(source), istream_iterator<double>(), sink);
     }
 
-    vector<double> decrypt_data(const vector<Ciphertext>& ciphertexts) {
-        vector<double> result;
+    // Reads records written by encrypt_stream and emits exactly the encrypted
+    // values, without padding slots, to out in order. Returns the value count.
+    template<typename OutputIt>
+    size_t decrypt_stream(istream& source, OutputIt out,
+                          size_t workers = default_workers(), size_t depth = 0) {
         Decryptor decryptor(*context, secret_key);
+        size_t values = 0;
 
-        for (const auto& cipher : ciphertexts) {
-            Plaintext plain;
-            decryptor.decrypt(cipher, plain);
-            vector<double> chunk;
-            encoder->decode(plain, chunk);
-            result.insert(result.end(), chunk.begin(), chunk.end());
-        }
-        
-        return result;
+        run_ordered_pipeline<StreamRecord, vector<double>>(
+            [&](StreamRecord& record) {
+                uint64_t size = 0;
+                if (!source.read(reinterpret_cast<char*>(&record.value_count), sizeof(record.value_count))) {
+                    return false;
+                }
+                if (!source.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+                    throw runtime_error("decrypt_stream: truncated record header");
+                }
+                record.bytes.resize(size);
+                if (!source.read(reinterpret_cast<char*>(record.bytes.data()), size)) {
+                    throw runtime_error("decrypt_stream: truncated ciphertext");
+                }
+                return true;
+            },
+            [&](StreamRecord& record) {
+                Ciphertext cipher;
+                cipher.load(*context, record.bytes.data(), record.bytes.size());
+                Plaintext plain;
+                decryptor.decrypt(cipher, plain);
+                vector<double> chunk;
+                encoder->decode(plain, chunk);
+                chunk.resize(min<size_t>(record.value_count, chunk.size()));
+                return chunk;
+            },
+            [&](vector<double>& chunk) {
+                out = copy(chunk.begin(), chunk.end(), out);
+                values += chunk.size();
+            },
+            workers, depth ? depth : 2 * workers);
+        return values;
     }
 
     void print_memory_stats() const {
@@ -185,18 +501,40 @@ int main() {
     cout << "=========================================\n";
 
     try {
-        MemoryOptimizedCKKS ckks;
+        // Encrypt/decrypt only: no multiplications, values below 2^4
+        CircuitDescription circuit;
+        circuit.multiplicative_depth = 0;
+        circuit.precision_bits = 20;
+        circuit.slot_demand = 1024;
+        MemoryOptimizedCKKS ckks(circuit);
 
         vector<double> test_data(10000);
         for (size_t i = 0; i < test_data.size(); i++) {
             test_data[i] = (i % 100) / 10.0;
         }
 
-        auto ciphertexts = ckks.encrypt_data(test_data);
-        cout << "Encrypted data into " << ciphertexts.size() << " ciphertexts\n";
+        // Encode, encrypt and serialize overlap on separate threads; only a
+        // few chunks are ever held in memory
+        const string stream_path = "encrypted_data.ctstream";
+        auto start = chrono::high_resolution_clock::now();
+        size_t records;
+        {
+            ofstream sink(stream_path, ios::binary | ios::trunc);
+            records = ckks.encrypt_stream(test_data.begin(), test_data.end(), sink);
+        }
+        auto mid = chrono::high_resolution_clock::now();
+        cout << "Encrypted data into " << records << " ciphertexts in "
+             << chrono::duration<double, milli>(mid - start).count() << " ms\n";
 
-        auto decrypted = ckks.decrypt_data(ciphertexts);
-        cout << "Decrypted data contains " << decrypted.size() << " values\n";
+        vector<double> decrypted;
+        decrypted.reserve(test_data.size());
+        {
+            ifstream source(stream_path, ios::binary);
+            ckks.decrypt_stream(source, back_inserter(decrypted));
+        }
+        auto end = chrono::high_resolution_clock::now();
+        cout << "Decrypted data contains " << decrypted.size() << " values in "
+             << chrono::duration<double, milli>(end - mid).count() << " ms\n";
 
         // Verify first and last few values
         cout << "First values: ";
@@ -204,7 +542,7 @@ int main() {
             cout << decrypted[i] << " ";
         }
         cout << "\nLast values: ";
-        for (size_t i = max(size_t(0), decrypted.size() - 5); i < decrypted.size(); i++) {
+        for (size_t i = decrypted.size() - min(size_t(5), decrypted.size()); i < decrypted.size(); i++) {
             cout << decrypted[i] << " ";
         }
         cout << endl;
@@ -1,7 +1,24 @@
 #include <iostream>
 #include <vector>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <tuple>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
 #include <seal/seal.h>
+#include <seal/util/uintarithsmallmod.h>
 
 using namespace std;
 using namespace seal;
@@ -31,84 +48,441 @@ shared_ptr<SEALContext> setup_context(size_t poly_modulus_degree = 16384) {
     return context;
 }
 
-vector<Ciphertext> packed_convolution(
+// Fused multiply-accumulate: accumulator += encrypted * plain, computed in the
+// NTT domain in one pass over the RNS limbs. An empty accumulator is
+// initialized with the product, so the inner loops of the kernels never create
+// a temporary ciphertext; a non-empty one must already be at the level of
+// encrypted. Callers rescale once at the end.
+void multiply_plain_accumulate(const SEALContext &context, const Ciphertext &encrypted,
+                               const Plaintext &plain, Ciphertext &accumulator) {
+    if (!encrypted.is_ntt_form() || !plain.is_ntt_form()) {
+        throw invalid_argument("multiply_plain_accumulate requires NTT-form operands");
+    }
+    if (encrypted.parms_id() != plain.parms_id()) {
+        throw invalid_argument("multiply_plain_accumulate: plaintext is at a different level");
+    }
+
+    auto context_data = context.get_context_data(encrypted.parms_id());
+    const auto &coeff_modulus = context_data->parms().coeff_modulus();
+    const size_t coeff_count = encrypted.poly_modulus_degree();
+    const double product_scale = encrypted.scale() * plain.scale();
+
+    bool overwrite = accumulator.size() == 0;
+    if (!overwrite && accumulator.parms_id() != encrypted.parms_id()) {
+        throw invalid_argument("multiply_plain_accumulate: accumulator is at a different level");
+    }
+    if (overwrite) {
+        accumulator.resize(context, encrypted.parms_id(), encrypted.size());
+        accumulator.is_ntt_form() = true;
+        accumulator.scale() = product_scale;
+    } else if (accumulator.size() != encrypted.size() || fabs(accumulator.scale() / product_scale - 1.0) > 1e-9) {
+        throw invalid_argument("multiply_plain_accumulate: accumulator size or scale mismatch");
+    }
+
+    const uint64_t *pt = plain.data();
+    for (size_t j = 0; j < encrypted.size(); j++) {
+        const uint64_t *src = encrypted.data(j);
+        uint64_t *dst = accumulator.data(j);
+        for (size_t i = 0; i < coeff_modulus.size(); i++) {
+            const Modulus &q = coeff_modulus[i];
+            const size_t offset = i * coeff_count;
+            if (overwrite) {
+                for (size_t k = offset; k < offset + coeff_count; k++) {
+                    dst[k] = util::multiply_uint_mod(src[k], pt[k], q);
+                }
+            } else {
+                for (size_t k = offset; k < offset + coeff_count; k++) {
+                    dst[k] = util::add_uint_mod(dst[k], util::multiply_uint_mod(src[k], pt[k], q), q);
+                }
+            }
+        }
+    }
+}
+
+// Galois keys paged per rotation step. A step's key is generated the first
+// time a rotation needs it (when the secret key is available), appended to a
+// keyed file (a private temp file unless a path is given), and held in a
+// bounded LRU; evicted steps are reloaded from the file. Nothing is
+// generated for rotations that never happen, and resident key memory is
+// proportional to the steps actually in use.
+class GaloisKeyPager {
+public:
+    // Key owner: keys go to a private file from mkstemp, removed on destruction
+    GaloisKeyPager(const SEALContext &context, const SecretKey &secret_key, size_t capacity = 4)
+        : GaloisKeyPager(context, secret_key, create_temp_file(), capacity) {
+        owns_file = true;
+    }
+
+    // Key owner: starts a fresh key file at a caller-chosen path, which is
+    // kept so evaluator-side pagers can serve it
+    GaloisKeyPager(const SEALContext &context, const SecretKey &secret_key,
+                   const string &path, size_t capacity = 4)
+        : context(context), keygen(make_unique<KeyGenerator>(context, secret_key)),
+          path(path), capacity(capacity) {
+        ofstream out(path, ios::binary | ios::trunc);
+        if (!out) {
+            throw runtime_error("Cannot create Galois key file: " + path);
+        }
+    }
+
+    ~GaloisKeyPager() {
+        if (owns_file) remove(path.c_str());
+    }
+
+    GaloisKeyPager(const GaloisKeyPager &) = delete;
+    GaloisKeyPager & operator=(const GaloisKeyPager &) = delete;
+
+    // Evaluator side: serves a key file written by a key owner, read-only
+    GaloisKeyPager(const SEALContext &context, const string &path, size_t capacity = 4)
+        : context(context), path(path), capacity(capacity) {
+        ifstream in(path, ios::binary);
+        if (!in) {
+            throw runtime_error("Cannot open Galois key file: " + path);
+        }
+        int32_t step;
+        uint64_t size;
+        while (in.read(reinterpret_cast<char *>(&step), sizeof(step)) &&
+               in.read(reinterpret_cast<char *>(&size), sizeof(size))) {
+            offsets[step] = {static_cast<streamoff>(in.tellg()), size};
+            in.seekg(static_cast<streamoff>(size), ios::cur);
+        }
+    }
+
+    // Keys for one rotation step; the pointer stays valid after eviction
+    shared_ptr<const GaloisKeys> get(int step) {
+        lock_guard<mutex> lock(pager_mutex);
+        auto cached = cache.find(step);
+        if (cached != cache.end()) {
+            lru.splice(lru.begin(), lru, cached->second.second);
+            return cached->second.first;
+        }
+
+        if (!offsets.count(step)) {
+            if (!keygen) {
+                throw invalid_argument("No Galois key stored for step " + to_string(step));
+            }
+            append(step);
+        }
+
+        auto keys = make_shared<GaloisKeys>();
+        ifstream in(path, ios::binary);
+        in.seekg(offsets[step].first);
+        keys->load(context, in);
+        disk_loads++;
+
+        lru.push_front(step);
+        cache[step] = {keys, lru.begin()};
+        if (cache.size() > capacity) {
+            cache.erase(lru.back());
+            lru.pop_back();
+        }
+        return keys;
+    }
+
+    size_t resident_steps() const { return cache.size(); }
+    size_t stored_steps() const { return offsets.size(); }
+    size_t loads() const { return disk_loads; }
+
+private:
+    // Unique file under $TMPDIR (or /tmp), so concurrent pagers never share one
+    static string create_temp_file() {
+        const char *dir = getenv("TMPDIR");
+        string pattern = string(dir && *dir ? dir : "/tmp") + "/galois_keys.XXXXXX";
+        vector<char> name(pattern.begin(), pattern.end());
+        name.push_back('\0');
+        int fd = mkstemp(name.data());
+        if (fd < 0) {
+            throw runtime_error("Cannot create Galois key file: " + pattern);
+        }
+        ::close(fd);
+        return name.data();
+    }
+
+    // Record layout: int32 step, uint64 byte count, seeded GaloisKeys bytes
+    void append(int step) {
+        stringstream buffer;
+        keygen->create_galois_keys(vector<int>{step}).save(buffer);
+        string bytes = buffer.str();
+
+        ofstream out(path, ios::binary | ios::app);
+        out.seekp(0, ios::end);
+        int32_t key = step;
+        uint64_t size = bytes.size();
+        out.write(reinterpret_cast<const char *>(&key), sizeof(key));
+        out.write(reinterpret_cast<const char *>(&size), sizeof(size));
+        streamoff offset = out.tellp();
+        out.write(bytes.data(), bytes.size());
+        if (!out) {
+            throw runtime_error("Failed to write Galois key file: " + path);
+        }
+        offsets[step] = {offset, size};
+    }
+
+    const SEALContext &context;
+    unique_ptr<KeyGenerator> keygen;
+    string path;
+    bool owns_file = false;
+    size_t capacity;
+    map<int, pair<streamoff, uint64_t>> offsets;
+    list<int> lru;
+    unordered_map<int, pair<shared_ptr<const GaloisKeys>, list<int>::iterator>> cache;
+    size_t disk_loads = 0;
+    mutex pager_mutex;
+};
+
+// Slot layouts for EncryptedTensor. For a rows x cols tensor with a
+// power-of-two stride S, element (r, c) lives at global slot
+//   RowMajor            r * S + c                      (S >= cols)
+//   Diagonal            ((c - r) mod cols) * S + r     (S >= rows)
+//   InterleavedChannels c * S + r                      (S >= rows; rows are
+//                       channels, interleaved at every position c)
+// Global slot g is slot g % slot_count of ciphertext g / slot_count. S divides
+// the slot count, so no row, diagonal or position straddles two ciphertexts.
+enum class TensorLayout { RowMajor, Diagonal, InterleavedChannels };
+
+// Price of a layout conversion in the operations kernels budget for
+struct LayoutCost {
+    size_t rotations = 0;        // key switches
+    size_t plain_multiplies = 0; // mask multiplications
+    size_t levels = 0;           // rescales consumed
+
+    bool is_free() const { return rotations == 0 && plain_multiplies == 0 && levels == 0; }
+};
+
+// Shape-aware CKKS tensor: a rows x cols matrix spread over as many
+// ciphertexts as its layout needs, with its stride, padding, level and scale
+// carried alongside. With cyclic padding (row-major only) each row's padding
+// repeats the row periodically, so rotating by d < S - cols reads every row
+// cyclically. Layout changes only happen through convert(), whose price is
+// known up front from conversion_cost().
+class EncryptedTensor {
+public:
+    EncryptedTensor() = default;
+
+    // min_stride lets a kernel keep its output lanes where its input lanes were
+    EncryptedTensor(size_t rows, size_t cols, TensorLayout layout, size_t slot_count,
+                    bool cyclic_padding = false, size_t min_stride = 1)
+        : rows_(rows), cols_(cols), layout_(layout), cyclic_(cyclic_padding), slot_count_(slot_count) {
+        if (rows == 0 || cols == 0) {
+            throw invalid_argument("EncryptedTensor: empty shape");
+        }
+        if (cyclic_padding && layout != TensorLayout::RowMajor) {
+            throw invalid_argument("EncryptedTensor: cyclic padding requires a row-major layout");
+        }
+        size_t needed = layout == TensorLayout::RowMajor ? (cyclic_padding ? 2 * cols : cols) : rows;
+        stride_ = 1;
+        while (stride_ < max(needed, min_stride)) stride_ <<= 1;
+        if (stride_ > slot_count) {
+            throw invalid_argument("EncryptedTensor: a single row does not fit in one ciphertext");
+        }
+        size_t lanes = layout == TensorLayout::RowMajor ? rows : cols;
+        ciphertexts_.resize((lanes * stride_ + slot_count - 1) / slot_count);
+    }
+
+    static EncryptedTensor encrypt(const vector<vector<double>> &values, TensorLayout layout,
+                                   bool cyclic_padding, CKKSEncoder &encoder, Encryptor &encryptor,
+                                   double scale) {
+        EncryptedTensor tensor(values.size(), values.empty() ? 0 : values[0].size(), layout,
+                               encoder.slot_count(), cyclic_padding);
+        vector<vector<double>> slots(tensor.ciphertexts_.size(), vector<double>(tensor.slot_count_, 0.0));
+        for (size_t r = 0; r < tensor.rows_; r++) {
+            for (size_t c = 0; c < tensor.cols_; c++) {
+                for (size_t g : tensor.slots_of(r, c)) {
+                    slots[g / tensor.slot_count_][g % tensor.slot_count_] = values[r][c];
+                }
+            }
+        }
+        Plaintext plain;
+        for (size_t i = 0; i < slots.size(); i++) {
+            encoder.encode(slots[i], scale, plain);
+            encryptor.encrypt(plain, tensor.ciphertexts_[i]);
+        }
+        return tensor;
+    }
+
+    vector<vector<double>> decrypt(CKKSEncoder &encoder, Decryptor &decryptor) const {
+        vector<vector<double>> decoded(ciphertexts_.size());
+        Plaintext plain;
+        for (size_t i = 0; i < ciphertexts_.size(); i++) {
+            decryptor.decrypt(ciphertexts_[i], plain);
+            encoder.decode(plain, decoded[i]);
+        }
+        vector<vector<double>> values(rows_, vector<double>(cols_));
+        for (size_t r = 0; r < rows_; r++) {
+            for (size_t c = 0; c < cols_; c++) {
+                size_t g = primary_slot(r, c);
+                values[r][c] = decoded[g / slot_count_][g % slot_count_];
+            }
+        }
+        return values;
+    }
+
+    size_t primary_slot(size_t r, size_t c) const {
+        switch (layout_) {
+        case TensorLayout::RowMajor:
+            return r * stride_ + c;
+        case TensorLayout::Diagonal:
+            return ((c + cols_ - r % cols_) % cols_) * stride_ + r;
+        default:
+            return c * stride_ + r;
+        }
+    }
+
+    // Every global slot holding (r, c): the primary one plus, with cyclic
+    // padding, its periodic copies in the row padding
+    vector<size_t> slots_of(size_t r, size_t c) const {
+        vector<size_t> slots{primary_slot(r, c)};
+        if (cyclic_) {
+            for (size_t p = c + cols_; p < stride_; p += cols_) {
+                slots.push_back(r * stride_ + p);
+            }
+        }
+        return slots;
+    }
+
+    LayoutCost conversion_cost(TensorLayout target, bool target_cyclic) const {
+        if (target == layout_ && target_cyclic == cyclic_) {
+            return {};
+        }
+        EncryptedTensor shape(rows_, cols_, target, slot_count_, target_cyclic);
+        LayoutCost cost;
+        for (const auto &group : moves_to(shape)) {
+            cost.plain_multiplies++;
+            if (get<2>(group.first) != 0) cost.rotations++;
+        }
+        cost.levels = 1;
+        return cost;
+    }
+
+    // Repack into another layout by masking, rotating and summing: one
+    // mask multiply per (source, destination, shift) group and one rescale.
+    // Masks are encoded at the last prime of the current level, so the
+    // rescale brings the scale back to where it was.
+    EncryptedTensor convert(TensorLayout target, bool target_cyclic, const SEALContext &context,
+                            CKKSEncoder &encoder, Evaluator &evaluator, GaloisKeyPager &galois_keys) const {
+        if (target == layout_ && target_cyclic == cyclic_) {
+            return *this;
+        }
+        EncryptedTensor result(rows_, cols_, target, slot_count_, target_cyclic);
+        auto context_data = context.get_context_data(ciphertexts_[0].parms_id());
+        double mask_scale = static_cast<double>(context_data->parms().coeff_modulus().back().value());
+
+        Plaintext mask_plain;
+        Ciphertext moved;
+        vector<bool> started(result.ciphertexts_.size(), false);
+        for (const auto &group : moves_to(result)) {
+            size_t src = get<0>(group.first);
+            size_t dst = get<1>(group.first);
+            int shift = get<2>(group.first);
+
+            vector<double> mask(slot_count_, 0.0);
+            for (size_t slot : group.second) mask[slot] = 1.0;
+            encoder.encode(mask, ciphertexts_[src].parms_id(), mask_scale, mask_plain);
+            evaluator.multiply_plain(ciphertexts_[src], mask_plain, moved);
+            if (shift != 0) {
+                evaluator.rotate_vector_inplace(moved, shift, *galois_keys.get(shift));
+            }
+            if (started[dst]) {
+                evaluator.add_inplace(result.ciphertexts_[dst], moved);
+            } else {
+                result.ciphertexts_[dst] = moved;
+                started[dst] = true;
+            }
+        }
+        // Every destination ciphertext holds at least one lane, so all were written
+        for (auto &ct : result.ciphertexts_) {
+            evaluator.rescale_to_next_inplace(ct);
+        }
+        return result;
+    }
+
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    TensorLayout layout() const { return layout_; }
+    bool cyclic_padding() const { return cyclic_; }
+    size_t stride() const { return stride_; }
+    size_t slot_count() const { return slot_count_; }
+    size_t size() const { return ciphertexts_.size(); }
+    vector<Ciphertext> &ciphertexts() { return ciphertexts_; }
+    const vector<Ciphertext> &ciphertexts() const { return ciphertexts_; }
+    double scale() const { return ciphertexts_[0].scale(); }
+
+    size_t level(const SEALContext &context) const {
+        return context.get_context_data(ciphertexts_[0].parms_id())->chain_index();
+    }
+
+private:
+    // Source slots grouped by (source ciphertext, destination ciphertext,
+    // left-rotation step) for every element copy the target layout needs
+    map<tuple<size_t, size_t, int>, vector<size_t>> moves_to(const EncryptedTensor &target) const {
+        map<tuple<size_t, size_t, int>, vector<size_t>> groups;
+        long long n = static_cast<long long>(slot_count_);
+        for (size_t r = 0; r < rows_; r++) {
+            for (size_t c = 0; c < cols_; c++) {
+                size_t from = primary_slot(r, c);
+                for (size_t to : target.slots_of(r, c)) {
+                    long long step = (static_cast<long long>(from % slot_count_) -
+                                      static_cast<long long>(to % slot_count_) + n) % n;
+                    if (step > n / 2) step -= n;
+                    groups[make_tuple(from / slot_count_, to / slot_count_, static_cast<int>(step))]
+                        .push_back(from % slot_count_);
+                }
+            }
+        }
+        return groups;
+    }
+
+    size_t rows_ = 0;
+    size_t cols_ = 0;
+    TensorLayout layout_ = TensorLayout::RowMajor;
+    bool cyclic_ = false;
+    size_t slot_count_ = 0;
+    size_t stride_ = 1;
+    vector<Ciphertext> ciphertexts_;
+};
+
+// out[t] = sum_i in[t + i] * kernel[i], computed as sum_i rot(in, i) * kernel[i]
+// with one fused multiply-accumulate per tap and a single rescale per
+// ciphertext. Each input is one row of a row-major tensor; rotations stay
+// inside a row for every valid output t < cols - kernel_size + 1.
+EncryptedTensor packed_convolution(
+    const SEALContext &context,
     const CKKSEncoder &encoder, 
     Evaluator &evaluator, 
-    const RelinKeys &relin_keys,
-    const GaloisKeys &galois_keys,
-    const vector<Ciphertext> &packed_inputs,
+    GaloisKeyPager &galois_keys,
+    const EncryptedTensor &packed_inputs,
     const vector<double> &kernel,
-    size_t input_size,
     size_t kernel_size,
     double scale) {
     
-    size_t poly_modulus_degree = encoder.slot_count();
-    vector<Ciphertext> results;
+    if (packed_inputs.layout() != TensorLayout::RowMajor || kernel_size > packed_inputs.cols()) {
+        throw invalid_argument("packed_convolution: expects row-major inputs longer than the kernel");
+    }
+    size_t output_size = packed_inputs.cols() - kernel_size + 1;
+    EncryptedTensor results(packed_inputs.rows(), output_size, TensorLayout::RowMajor,
+                            packed_inputs.slot_count(), false, packed_inputs.stride());
     
-    // Encode kernel
-    Plaintext kernel_pt;
-    encoder.encode(kernel, scale, kernel_pt);
+    // Encode each kernel tap once as a constant plaintext
+    vector<Plaintext> tap_pts(kernel_size);
+    for (size_t i = 0; i < kernel_size; i++) {
+        encoder.encode(kernel[i], scale, tap_pts[i]);
+    }
     
-    for (const auto &input_ct : packed_inputs) {
-        Ciphertext conv_result;
-        evaluator.multiply_plain(input_ct, kernel_pt, conv_result);
-        evaluator.relinearize_inplace(conv_result, relin_keys);
-        evaluator.rescale_to_next_inplace(conv_result);
-        
-        Ciphertext sum_result = conv_result;
+    Ciphertext shifted;
+    for (size_t n = 0; n < packed_inputs.size(); n++) {
+        const Ciphertext &input = packed_inputs.ciphertexts()[n];
+        Ciphertext &output = results.ciphertexts()[n];
+        multiply_plain_accumulate(context, input, tap_pts[0], output);
         for (size_t i = 1; i < kernel_size; i++) {
-            Ciphertext shifted;
-            evaluator.rotate_vector(conv_result, -static_cast<int>(i), galois_keys, shifted);
-            evaluator.add_inplace(sum_result, shifted);
+            evaluator.rotate_vector(input, static_cast<int>(i), *galois_keys.get(static_cast<int>(i)), shifted);
+            multiply_plain_accumulate(context, shifted, tap_pts[i], output);
         }
-        
-        results.push_back(sum_result);
+        evaluator.rescale_to_next_inplace(output);
     }
     
     return results;
 }
 
-vector<double> extract_results(
-    const CKKSEncoder &encoder,
-    Evaluator &evaluator,
-    Decryptor &decryptor,
-    const RelinKeys &relin_keys,
-    const Ciphertext &packed_result,
-    size_t output_size,
-    size_t num_parallel_convolutions,
-    size_t convolution_idx,
-    double scale) {
-    
-    size_t poly_modulus_degree = encoder.slot_count();
-    size_t slots_per_convolution = poly_modulus_degree / num_parallel_convolutions;
-    size_t start_slot = convolution_idx * slots_per_convolution;
-    
-    vector<double> mask(poly_modulus_degree, 0.0);
-    for (size_t i = 0; i < output_size; i++) {
-        mask[start_slot + i] = 1.0;
-    }
-    
-    Plaintext mask_pt;
-    encoder.encode(mask, scale, mask_pt);
-    
-    Ciphertext masked_result;
-    evaluator.multiply_plain(packed_result, mask_pt, masked_result);
-    evaluator.relinearize_inplace(masked_result, relin_keys);
-    
-    Plaintext decrypted;
-    decryptor.decrypt(masked_result, decrypted);
-    
-    vector<double> result;
-    encoder.decode(decrypted, result);
-    
-    vector<double> extracted_result;
-    for (size_t i = 0; i < output_size; i++) {
-        extracted_result.push_back(result[start_slot + i]);
-    }
-    
-    return extracted_result;
-}
-
 int main() {
     try {
         // Setup parameters
@@ -120,10 +494,6 @@ int main() {
         auto secret_key = keygen.secret_key();
         PublicKey public_key;
         keygen.create_public_key(public_key);
-        RelinKeys relin_keys;
-        keygen.create_relin_keys(relin_keys);
-        GaloisKeys galois_keys;
-        keygen.create_galois_keys(galois_keys);
         
         Encryptor encryptor(*context, public_key);
         Evaluator evaluator(*context);
@@ -133,12 +503,11 @@ int main() {
         // Parameters
         size_t input_size = 4096;
         size_t kernel_size = 5;
-        size_t output_size = input_size - kernel_size + 1;
         size_t num_inputs = 4;
-        size_t num_parallel_convolutions = poly_modulus_degree / input_size;
         double scale = pow(2.0, 40);
         
-        cout << "\nNumber of parallel convolutions per ciphertext: " << num_parallel_convolutions << endl;
+        // Only the kernel_size - 1 tap rotations are ever generated or resident
+        GaloisKeyPager galois_keys(*context, secret_key, kernel_size);
         
         // Generate random data
         vector<vector<double>> inputs(num_inputs, vector<double>(input_size));
@@ -154,37 +523,26 @@ int main() {
             val = static_cast<double>(rand()) / RAND_MAX;
         }
         
-        // Pack inputs
-        vector<Ciphertext> packed_inputs;
-        for (size_t i = 0; i < num_inputs; i += num_parallel_convolutions) {
-            vector<double> packed_data(poly_modulus_degree, 0.0);
-            
-            for (size_t j = 0; j < min(num_parallel_convolutions, num_inputs - i); j++) {
-                size_t start_pos = j * input_size;
-                copy(inputs[i + j].begin(), inputs[i + j].end(), packed_data.begin() + start_pos);
-            }
-            
-            Plaintext pt;
-            encoder.encode(packed_data, scale, pt);
-            Ciphertext ct;
-            encryptor.encrypt(pt, ct);
-            packed_inputs.push_back(ct);
-        }
+        // Pack inputs, one per row; the tensor spreads them over ciphertexts
+        auto packed_inputs = EncryptedTensor::encrypt(inputs, TensorLayout::RowMajor, false,
+                                                      encoder, encryptor, scale);
+        cout << "\nNumber of parallel convolutions per ciphertext: "
+             << packed_inputs.slot_count() / packed_inputs.stride()
+             << " (" << packed_inputs.size() << " ciphertexts)" << endl;
         
         // Run packed convolution
         cout << "\nRunning packed convolution..." << endl;
         auto start_packed = high_resolution_clock::now();
         auto packed_results = packed_convolution(
-            encoder, evaluator, relin_keys, galois_keys, 
-            packed_inputs, kernel, input_size, kernel_size, scale);
+            *context, encoder, evaluator, galois_keys, 
+            packed_inputs, kernel, kernel_size, scale);
         auto stop_packed = high_resolution_clock::now();
         
         // Extract results
         size_t convolution_to_extract = 1;
         cout << "Extracting results..." << endl;
-        auto extracted_results = extract_results(
-            encoder, evaluator, decryptor, relin_keys, packed_results[0],
-            output_size, num_parallel_convolutions, convolution_to_extract, scale);
+        auto outputs = packed_results.decrypt(encoder, decryptor);
+        const auto &extracted_results = outputs[convolution_to_extract];
         
         cout << "\nFirst 5 extracted results: ";
         for (int i = 0; i < 5 && i < extracted_results.size(); i++) {
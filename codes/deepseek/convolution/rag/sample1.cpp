@@ -6,6 +6,18 @@
 #include <random>
 #include <algorithm>
 #include <unordered_set>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+#include <numeric>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
 #include "seal/seal.h"
 
 using namespace std;
@@ -32,6 +44,9 @@ public:
         if (embedding.size() != embedding_size) {
             throw invalid_argument("Embedding size mismatch");
         }
+        if (id_to_index.count(id)) {
+            throw invalid_argument("Duplicate node ID");
+        }
         nodes.push_back({id, embedding, {}});
         id_to_index[id] = nodes.size() - 1;
     }
@@ -94,6 +109,331 @@ public:
     size_t get_embedding_size() const { return embedding_size; }
 };
 
+// Galois keys paged per rotation step. A step's key is generated the first
+// time a rotation needs it (when the secret key is available), appended to a
+// keyed file (a private temp file unless a path is given), and held in a
+// bounded LRU; evicted steps are reloaded from the file. Nothing is
+// generated for rotations that never happen, and resident key memory is
+// proportional to the steps actually in use.
+class GaloisKeyPager {
+public:
+    // Key owner: keys go to a private file from mkstemp, removed on destruction
+    GaloisKeyPager(const SEALContext& context, const SecretKey& secret_key, size_t capacity = 4)
+        : GaloisKeyPager(context, secret_key, create_temp_file(), capacity) {
+        owns_file = true;
+    }
+
+    // Key owner: starts a fresh key file at a caller-chosen path, which is
+    // kept so evaluator-side pagers can serve it
+    GaloisKeyPager(const SEALContext& context, const SecretKey& secret_key,
+                   const string& path, size_t capacity = 4)
+        : context(context), keygen(make_unique<KeyGenerator>(context, secret_key)),
+          path(path), capacity(capacity) {
+        ofstream out(path, ios::binary | ios::trunc);
+        if (!out) {
+            throw runtime_error("Cannot create Galois key file: " + path);
+        }
+    }
+
+    ~GaloisKeyPager() {
+        if (owns_file) remove(path.c_str());
+    }
+
+    GaloisKeyPager(const GaloisKeyPager&) = delete;
+    GaloisKeyPager& operator=(const GaloisKeyPager&) = delete;
+
+    // Evaluator side: serves a key file written by a key owner, read-only
+    GaloisKeyPager(const SEALContext& context, const string& path, size_t capacity = 4)
+        : context(context), path(path), capacity(capacity) {
+        ifstream in(path, ios::binary);
+        if (!in) {
+            throw runtime_error("Cannot open Galois key file: " + path);
+        }
+        int32_t step;
+        uint64_t size;
+        while (in.read(reinterpret_cast<char*>(&step), sizeof(step)) &&
+               in.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+            offsets[step] = {static_cast<streamoff>(in.tellg()), size};
+            in.seekg(static_cast<streamoff>(size), ios::cur);
+        }
+    }
+
+    // Keys for one rotation step; the pointer stays valid after eviction
+    shared_ptr<const GaloisKeys> get(int step) {
+        lock_guard<mutex> lock(pager_mutex);
+        auto cached = cache.find(step);
+        if (cached != cache.end()) {
+            lru.splice(lru.begin(), lru, cached->second.second);
+            return cached->second.first;
+        }
+
+        if (!offsets.count(step)) {
+            if (!keygen) {
+                throw invalid_argument("No Galois key stored for step " + to_string(step));
+            }
+            append(step);
+        }
+
+        auto keys = make_shared<GaloisKeys>();
+        ifstream in(path, ios::binary);
+        in.seekg(offsets[step].first);
+        keys->load(context, in);
+        disk_loads++;
+
+        lru.push_front(step);
+        cache[step] = {keys, lru.begin()};
+        if (cache.size() > capacity) {
+            cache.erase(lru.back());
+            lru.pop_back();
+        }
+        return keys;
+    }
+
+    size_t resident_steps() const { return cache.size(); }
+    size_t stored_steps() const { return offsets.size(); }
+    size_t loads() const { return disk_loads; }
+
+private:
+    // Unique file under $TMPDIR (or /tmp), so concurrent pagers never share one
+    static string create_temp_file() {
+        const char* dir = getenv("TMPDIR");
+        string pattern = string(dir && *dir ? dir : "/tmp") + "/galois_keys.XXXXXX";
+        vector<char> name(pattern.begin(), pattern.end());
+        name.push_back('\0');
+        int fd = mkstemp(name.data());
+        if (fd < 0) {
+            throw runtime_error("Cannot create Galois key file: " + pattern);
+        }
+        ::close(fd);
+        return name.data();
+    }
+
+    // Record layout: int32 step, uint64 byte count, seeded GaloisKeys bytes
+    void append(int step) {
+        stringstream buffer;
+        keygen->create_galois_keys(vector<int>{step}).save(buffer);
+        string bytes = buffer.str();
+
+        ofstream out(path, ios::binary | ios::app);
+        out.seekp(0, ios::end);
+        int32_t key = step;
+        uint64_t size = bytes.size();
+        out.write(reinterpret_cast<const char*>(&key), sizeof(key));
+        out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        streamoff offset = out.tellp();
+        out.write(bytes.data(), bytes.size());
+        if (!out) {
+            throw runtime_error("Failed to write Galois key file: " + path);
+        }
+        offsets[step] = {offset, size};
+    }
+
+    const SEALContext& context;
+    unique_ptr<KeyGenerator> keygen;
+    string path;
+    bool owns_file = false;
+    size_t capacity;
+    map<int, pair<streamoff, uint64_t>> offsets;
+    list<int> lru;
+    unordered_map<int, pair<shared_ptr<const GaloisKeys>, list<int>::iterator>> cache;
+    size_t disk_loads = 0;
+    mutex pager_mutex;
+};
+
+// Node database packed for one encrypted matrix-vector product per query.
+// With block = next power of two >= dim, the query is replicated with period
+// block across all slots, and generalized diagonal j of a group of up to
+// slot_count nodes holds E[n][(n + j) mod block] in slot n. Then
+// sum_j diag_j * rot(query, j) leaves every node's score in its own slot:
+// one output ciphertext per slot_count nodes. Baby-step giant-step splits
+// j = g * baby + b. The query is rotated baby - 1 times and those rotations
+// are shared by every group. Diagonals are stored shifted right by g * baby,
+// so each partial sum over b needs one left rotation by g * baby. Each group
+// then adds only giant - 1 rotations. That is about 2 * sqrt(block) key
+// switches per query instead of one per node.
+class PackedScoreMatrix {
+public:
+    // Rows are cosine-normalized, so scores are cosine similarities
+    template<typename Node>
+    void pack(const vector<Node>& nodes, const CKKSEncoder& encoder, parms_id_type parms_id, double scale) {
+        slots = encoder.slot_count();
+        dim = nodes.empty() ? 0 : nodes[0].embedding.size();
+        block = 1;
+        while (block < dim) block <<= 1;
+        baby = 1;
+        while (baby * baby < block) baby <<= 1;
+        giant = block / baby;
+
+        ids.clear();
+        groups.clear();
+        vector<double> inv_norms(nodes.size());
+        for (size_t i = 0; i < nodes.size(); i++) {
+            const auto& embedding = nodes[i].embedding;
+            if (embedding.size() != dim) throw invalid_argument("PackedScoreMatrix: embedding size mismatch");
+            double norm = sqrt(inner_product(embedding.begin(), embedding.end(), embedding.begin(), 0.0));
+            inv_norms[i] = norm > 0 ? 1.0 / norm : 0.0;
+            ids.push_back(nodes[i].id);
+        }
+
+        vector<double> diagonal(slots);
+        for (size_t first = 0; first < nodes.size(); first += slots) {
+            size_t count = min(slots, nodes.size() - first);
+            auto& group = groups.emplace_back(block);
+            for (size_t j = 0; j < block; j++) {
+                size_t shift = (j / baby) * baby;
+                fill(diagonal.begin(), diagonal.end(), 0.0);
+                for (size_t n = 0; n < count; n++) {
+                    size_t d = (n + j) % block;
+                    if (d < dim) {
+                        diagonal[(n + shift) % slots] = nodes[first + n].embedding[d] * inv_norms[first + n];
+                    }
+                }
+                // multiply_plain by a zero plaintext would give a transparent ciphertext
+                group[j].zero = all_of(diagonal.begin(), diagonal.end(), [](double v) { return v == 0.0; });
+                if (!group[j].zero) encoder.encode(diagonal, parms_id, scale, group[j].plain);
+            }
+        }
+    }
+
+    // Appends one node in place. Its row touches one slot of each diagonal
+    // of the last group, so only those entries are encoded (one sparse
+    // plaintext per diagonal) and added into the stored plaintexts. The cost
+    // depends on the dimension, not on the number of packed nodes, and the
+    // rotation steps do not change.
+    template<typename Node>
+    void insert(const Node& node, const SEALContext& context, const CKKSEncoder& encoder,
+                parms_id_type parms_id, double scale) {
+        if (ids.empty()) {
+            pack(vector<Node>(1, node), encoder, parms_id, scale);
+            return;
+        }
+        const auto& embedding = node.embedding;
+        if (embedding.size() != dim) throw invalid_argument("PackedScoreMatrix: embedding size mismatch");
+        double norm = sqrt(inner_product(embedding.begin(), embedding.end(), embedding.begin(), 0.0));
+        double inv_norm = norm > 0 ? 1.0 / norm : 0.0;
+
+        size_t n = ids.size() % slots;
+        if (n == 0) groups.emplace_back(block);
+        auto& group = groups.back();
+        vector<double> sparse(slots, 0.0);
+        Plaintext row;
+        for (size_t j = 0; j < block; j++) {
+            size_t d = (n + j) % block;
+            if (d >= dim || embedding[d] == 0.0) continue;
+            size_t slot = (n + (j / baby) * baby) % slots;
+            sparse[slot] = embedding[d] * inv_norm;
+            if (group[j].zero) {
+                encoder.encode(sparse, parms_id, scale, group[j].plain);
+                group[j].zero = false;
+            } else {
+                encoder.encode(sparse, parms_id, scale, row);
+                add_plain_inplace(group[j].plain, row, context);
+            }
+            sparse[slot] = 0.0;
+        }
+        ids.push_back(node.id);
+    }
+
+    // Galois steps score() rotates by
+    vector<int> rotation_steps() const {
+        vector<int> steps;
+        for (size_t b = 1; b < baby; b++) steps.push_back(static_cast<int>(b));
+        for (size_t g = 1; g < giant; g++) steps.push_back(static_cast<int>(g * baby));
+        return steps;
+    }
+
+    // Client side: normalized query replicated with period block
+    void encode_query(const vector<double>& query, const CKKSEncoder& encoder, parms_id_type parms_id,
+                      double scale, Plaintext& destination) const {
+        if (query.size() > block) throw invalid_argument("PackedScoreMatrix: query is wider than the database");
+        double norm = sqrt(inner_product(query.begin(), query.end(), query.begin(), 0.0));
+        vector<double> replicated(slots, 0.0);
+        for (size_t i = 0; i < slots; i++) {
+            size_t d = i % block;
+            if (d < query.size() && norm > 0) replicated[i] = query[d] / norm;
+        }
+        encoder.encode(replicated, parms_id, scale, destination);
+    }
+
+    // Server side: destination[g] holds the scores of nodes g*slots.. in its
+    // slots. keys_for(step) returns a pointer-like handle to Galois keys
+    // covering step. A group with no nonzero entry is left empty.
+    template<typename KeysFor>
+    void score(const Ciphertext& encrypted_query, const Evaluator& evaluator, KeysFor keys_for,
+               vector<Ciphertext>& destination) const {
+        vector<Ciphertext> baby_rotations(baby);
+        baby_rotations[0] = encrypted_query;
+        for (size_t b = 1; b < baby; b++) {
+            int step = static_cast<int>(b);
+            evaluator.rotate_vector(encrypted_query, step, *keys_for(step), baby_rotations[b]);
+        }
+
+        destination.assign(groups.size(), Ciphertext());
+        Ciphertext inner, term;
+        for (size_t g = 0; g < groups.size(); g++) {
+            Ciphertext& scores = destination[g];
+            for (size_t gi = 0; gi < giant; gi++) {
+                bool has_inner = false;
+                for (size_t b = 0; b < baby; b++) {
+                    const Diagonal& diagonal = groups[g][gi * baby + b];
+                    if (diagonal.zero) continue;
+                    if (!has_inner) {
+                        evaluator.multiply_plain(baby_rotations[b], diagonal.plain, inner);
+                        has_inner = true;
+                    } else {
+                        evaluator.multiply_plain(baby_rotations[b], diagonal.plain, term);
+                        evaluator.add_inplace(inner, term);
+                    }
+                }
+                if (!has_inner) continue;
+                if (gi > 0) {
+                    int step = static_cast<int>(gi * baby);
+                    evaluator.rotate_vector_inplace(inner, step, *keys_for(step));
+                }
+                if (scores.size() == 0) {
+                    scores = move(inner);
+                } else {
+                    evaluator.add_inplace(scores, inner);
+                }
+            }
+            if (scores.size() != 0) evaluator.rescale_to_next_inplace(scores);
+        }
+    }
+
+    size_t node_count() const { return ids.size(); }
+    int node_id(size_t i) const { return ids[i]; }
+
+private:
+    struct Diagonal {
+        Plaintext plain;
+        bool zero = true;
+    };
+
+    // Encoding is linear, so two NTT-form plaintexts at one level add limb
+    // by limb modulo each prime
+    static void add_plain_inplace(Plaintext& destination, const Plaintext& other, const SEALContext& context) {
+        const auto& coeff_modulus = context.get_context_data(destination.parms_id())->parms().coeff_modulus();
+        size_t degree = destination.coeff_count() / coeff_modulus.size();
+        uint64_t* a = destination.data();
+        const uint64_t* b = other.data();
+        for (size_t i = 0; i < coeff_modulus.size(); i++) {
+            uint64_t q = coeff_modulus[i].value();
+            for (size_t c = i * degree; c < (i + 1) * degree; c++) {
+                uint64_t sum = a[c] + b[c];
+                a[c] = sum >= q ? sum - q : sum;
+            }
+        }
+    }
+
+    size_t slots = 0;
+    size_t dim = 0;
+    size_t block = 1;
+    size_t baby = 1;
+    size_t giant = 1;
+    vector<int> ids;
+    vector<vector<Diagonal>> groups;
+};
+
 // Graph Retriever with CKKS Operations
 class GraphRetriever {
 private:
@@ -106,18 +446,11 @@ private:
     unique_ptr<Evaluator> evaluator;
     PublicKey public_key;
     SecretKey secret_key;
-    RelinKeys relin_keys;
-    GaloisKeys galois_keys;
+    unique_ptr<GaloisKeyPager> galois_keys;
+    PackedScoreMatrix score_matrix;
+    double scale = pow(2.0, 40);
     size_t top_k;
 
-    // Modified sum elements function to be more robust
-    void sum_elements(const Ciphertext& encrypted_vec, Ciphertext& encrypted_sum) {
-        encrypted_sum = encrypted_vec;
-        Ciphertext rotated;
-        evaluator->rotate_vector(encrypted_sum, 1, galois_keys, rotated);
-        evaluator->add_inplace(encrypted_sum, rotated);
-    }
-
 public:
     GraphRetriever(const KnowledgeGraph& g, GraphEmbedder& e, size_t k = 3) 
         : graph(g), embedder(e), top_k(k) {
@@ -134,50 +467,62 @@ public:
         
         secret_key = keygen.secret_key();
         keygen.create_public_key(public_key);
-        keygen.create_relin_keys(relin_keys);
-        keygen.create_galois_keys(galois_keys);
-        
+        repack();
+
         encryptor = make_unique<Encryptor>(*context, public_key);
         decryptor = make_unique<Decryptor>(*context, secret_key);
         evaluator = make_unique<Evaluator>(*context);
     }
 
+    // Packs the node embeddings into the scoring matrix; call again after
+    // the graph's nodes change. Every rotation step stays resident.
+    void repack() {
+        score_matrix.pack(graph.get_nodes(), *encoder, context->first_parms_id(), scale);
+        size_t steps = score_matrix.rotation_steps().size();
+        galois_keys = make_unique<GaloisKeyPager>(*context, secret_key, max<size_t>(steps, 1));
+    }
+
+    // Inserts a node the graph has just gained into the packed database in
+    // place, at a cost independent of the graph size; repack() is only
+    // needed when existing embeddings change
+    void insert_node(int node_id) {
+        bool first = score_matrix.node_count() == 0;
+        score_matrix.insert(graph.get_node(node_id), *context, *encoder, context->first_parms_id(), scale);
+        if (first) repack();
+    }
+
     vector<int> retrieve(const string& query) {
         try {
             // Embed the query
             auto query_embedding = embedder.embed_query(query);
 
-            // Encrypt the query embedding with proper scale
-            double scale = pow(2.0, 40);
+            // Encrypt the query, replicated to match the packed database
             Plaintext plain_query;
-            encoder->encode(query_embedding, scale, plain_query);
+            score_matrix.encode_query(query_embedding, *encoder, context->first_parms_id(), scale, plain_query);
             Ciphertext encrypted_query;
             encryptor->encrypt(plain_query, encrypted_query);
 
-            // Find most similar nodes
+            // One matrix-vector product scores every node
+            vector<Ciphertext> encrypted_scores;
+            score_matrix.score(encrypted_query, *evaluator,
+                               [this](int step) { return galois_keys->get(step); }, encrypted_scores);
+
+            size_t slots = encoder->slot_count();
             vector<pair<double, int>> scores;
-            for (const auto& node : graph.get_nodes()) {
-                // Encode node embedding
-                Plaintext plain_node;
-                encoder->encode(node.embedding, scale, plain_node);
-                
-                // Compute dot product homomorphically
-                Ciphertext encrypted_result;
-                evaluator->multiply_plain(encrypted_query, plain_node, encrypted_result);
-                evaluator->relinearize_inplace(encrypted_result, relin_keys);
-                evaluator->rescale_to_next_inplace(encrypted_result);
-                
-                // Sum all elements
-                Ciphertext encrypted_sum;
-                sum_elements(encrypted_result, encrypted_sum);
-                
-                // Decrypt the result
-                Plaintext plain_result;
-                decryptor->decrypt(encrypted_sum, plain_result);
-                vector<double> result;
-                encoder->decode(plain_result, result);
-                
-                scores.emplace_back(result[0], node.id);
+            Plaintext plain_result;
+            vector<double> result;
+            for (size_t g = 0; g < encrypted_scores.size(); g++) {
+                size_t first = g * slots;
+                size_t count = min(slots, score_matrix.node_count() - first);
+                if (encrypted_scores[g].size() == 0) {
+                    result.assign(count, 0.0);
+                } else {
+                    decryptor->decrypt(encrypted_scores[g], plain_result);
+                    encoder->decode(plain_result, result);
+                }
+                for (size_t n = 0; n < count; n++) {
+                    scores.emplace_back(result[n], score_matrix.node_id(first + n));
+                }
             }
 
             // Sort by score and get top-k
@@ -254,15 +599,15 @@ public:
     }
 
     void initialize_sample_graph() {
-        // Initialize with more meaningful embeddings
-        embedder.initialize_embeddings(graph);
-        
         // Create a simple graph with 10 nodes
         for (int i = 0; i < 10; ++i) {
             vector<double> embedding(embedder.get_embedding_size());
             graph.add_node(i, embedding);
         }
 
+        // Initialize with more meaningful embeddings once the nodes exist
+        embedder.initialize_embeddings(graph);
+
         // Create a simple graph structure
         graph.add_edge(0, 1);
         graph.add_edge(0, 2);
@@ -279,6 +624,17 @@ public:
         graph.add_edge(4, 2);
     }
 
+    // Adds a node and its edges and indexes it for retrieval right away
+    void add_node(int id, const vector<double>& embedding, const vector<int>& neighbors = {}) {
+        graph.add_node(id, embedding);
+        for (int neighbor : neighbors) {
+            graph.add_edge(id, neighbor);
+        }
+        retriever->insert_node(id);
+    }
+
+    size_t embedding_size() const { return embedder.get_embedding_size(); }
+
     string query(const string& question) {
         try {
             auto relevant_nodes = retriever->retrieve(question);
@@ -312,6 +668,11 @@ int main() {
         cout << rag_system.query("Node connections") << endl;
         cout << rag_system.query("Graph structure") << endl;
 
+        // Nodes added later are indexed without repacking the graph
+        vector<double> embedding(rag_system.embedding_size(), 0.1);
+        rag_system.add_node(10, embedding, {9});
+        cout << rag_system.query("Newly added concepts") << endl;
+
     } catch (const exception& e) {
         cerr << "Error: " << e.what() << endl;
         return 1;
@@ -9,11 +9,362 @@
 #include <cmath>          // Added for pow()
 #include <algorithm>      // Added for min(), fill()
 #include <stdexcept>      // Added for exception handling
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <list>
+#include <cstdint>
+#include <tuple>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
 #include <seal/seal.h>
 
 using namespace std;
 using namespace seal;
 
+// Galois keys paged per rotation step. A step's key is generated the first
+// time a rotation needs it (when the secret key is available), appended to a
+// keyed file (a private temp file unless a path is given), and held in a
+// bounded LRU; evicted steps are reloaded from the file. Nothing is
+// generated for rotations that never happen, and resident key memory is
+// proportional to the steps actually in use.
+class GaloisKeyPager {
+public:
+    // Key owner: keys go to a private file from mkstemp, removed on destruction
+    GaloisKeyPager(const SEALContext& context, const SecretKey& secret_key, size_t capacity = 4)
+        : GaloisKeyPager(context, secret_key, create_temp_file(), capacity) {
+        owns_file = true;
+    }
+
+    // Key owner: starts a fresh key file at a caller-chosen path, which is
+    // kept so evaluator-side pagers can serve it
+    GaloisKeyPager(const SEALContext& context, const SecretKey& secret_key,
+                   const string& path, size_t capacity = 4)
+        : context(context), keygen(make_unique<KeyGenerator>(context, secret_key)),
+          path(path), capacity(capacity) {
+        ofstream out(path, ios::binary | ios::trunc);
+        if (!out) {
+            throw runtime_error("Cannot create Galois key file: " + path);
+        }
+    }
+
+    ~GaloisKeyPager() {
+        if (owns_file) remove(path.c_str());
+    }
+
+    GaloisKeyPager(const GaloisKeyPager&) = delete;
+    GaloisKeyPager& operator=(const GaloisKeyPager&) = delete;
+
+    // Evaluator side: serves a key file written by a key owner, read-only
+    GaloisKeyPager(const SEALContext& context, const string& path, size_t capacity = 4)
+        : context(context), path(path), capacity(capacity) {
+        ifstream in(path, ios::binary);
+        if (!in) {
+            throw runtime_error("Cannot open Galois key file: " + path);
+        }
+        int32_t step;
+        uint64_t size;
+        while (in.read(reinterpret_cast<char*>(&step), sizeof(step)) &&
+               in.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+            offsets[step] = {static_cast<streamoff>(in.tellg()), size};
+            in.seekg(static_cast<streamoff>(size), ios::cur);
+        }
+    }
+
+    // Keys for one rotation step; the pointer stays valid after eviction
+    shared_ptr<const GaloisKeys> get(int step) {
+        lock_guard<mutex> lock(pager_mutex);
+        auto cached = cache.find(step);
+        if (cached != cache.end()) {
+            lru.splice(lru.begin(), lru, cached->second.second);
+            return cached->second.first;
+        }
+
+        if (!offsets.count(step)) {
+            if (!keygen) {
+                throw invalid_argument("No Galois key stored for step " + to_string(step));
+            }
+            append(step);
+        }
+
+        auto keys = make_shared<GaloisKeys>();
+        ifstream in(path, ios::binary);
+        in.seekg(offsets[step].first);
+        keys->load(context, in);
+        disk_loads++;
+
+        lru.push_front(step);
+        cache[step] = {keys, lru.begin()};
+        if (cache.size() > capacity) {
+            cache.erase(lru.back());
+            lru.pop_back();
+        }
+        return keys;
+    }
+
+    size_t resident_steps() const { return cache.size(); }
+    size_t stored_steps() const { return offsets.size(); }
+    size_t loads() const { return disk_loads; }
+
+private:
+    // Unique file under $TMPDIR (or /tmp), so concurrent pagers never share one
+    static string create_temp_file() {
+        const char* dir = getenv("TMPDIR");
+        string pattern = string(dir && *dir ? dir : "/tmp") + "/galois_keys.XXXXXX";
+        vector<char> name(pattern.begin(), pattern.end());
+        name.push_back('\0');
+        int fd = mkstemp(name.data());
+        if (fd < 0) {
+            throw runtime_error("Cannot create Galois key file: " + pattern);
+        }
+        ::close(fd);
+        return name.data();
+    }
+
+    // Record layout: int32 step, uint64 byte count, seeded GaloisKeys bytes
+    void append(int step) {
+        stringstream buffer;
+        keygen->create_galois_keys(vector<int>{step}).save(buffer);
+        string bytes = buffer.str();
+
+        ofstream out(path, ios::binary | ios::app);
+        out.seekp(0, ios::end);
+        int32_t key = step;
+        uint64_t size = bytes.size();
+        out.write(reinterpret_cast<const char*>(&key), sizeof(key));
+        out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        streamoff offset = out.tellp();
+        out.write(bytes.data(), bytes.size());
+        if (!out) {
+            throw runtime_error("Failed to write Galois key file: " + path);
+        }
+        offsets[step] = {offset, size};
+    }
+
+    const SEALContext& context;
+    unique_ptr<KeyGenerator> keygen;
+    string path;
+    bool owns_file = false;
+    size_t capacity;
+    map<int, pair<streamoff, uint64_t>> offsets;
+    list<int> lru;
+    unordered_map<int, pair<shared_ptr<const GaloisKeys>, list<int>::iterator>> cache;
+    size_t disk_loads = 0;
+    mutex pager_mutex;
+};
+
+// Slot layouts for EncryptedTensor. For a rows x cols tensor with a
+// power-of-two stride S, element (r, c) lives at global slot
+//   RowMajor            r * S + c                      (S >= cols)
+//   Diagonal            ((c - r) mod cols) * S + r     (S >= rows)
+//   InterleavedChannels c * S + r                      (S >= rows; rows are
+//                       channels, interleaved at every position c)
+// Global slot g is slot g % slot_count of ciphertext g / slot_count. S divides
+// the slot count, so no row, diagonal or position straddles two ciphertexts.
+enum class TensorLayout { RowMajor, Diagonal, InterleavedChannels };
+
+// Price of a layout conversion in the operations kernels budget for
+struct LayoutCost {
+    size_t rotations = 0;        // key switches
+    size_t plain_multiplies = 0; // mask multiplications
+    size_t levels = 0;           // rescales consumed
+
+    bool is_free() const { return rotations == 0 && plain_multiplies == 0 && levels == 0; }
+};
+
+// Shape-aware CKKS tensor: a rows x cols matrix spread over as many
+// ciphertexts as its layout needs, with its stride, padding, level and scale
+// carried alongside. With cyclic padding (row-major only) each row's padding
+// repeats the row periodically, so rotating by d < S - cols reads every row
+// cyclically. Layout changes only happen through convert(), whose price is
+// known up front from conversion_cost().
+class EncryptedTensor {
+public:
+    EncryptedTensor() = default;
+
+    // min_stride lets a kernel keep its output lanes where its input lanes were
+    EncryptedTensor(size_t rows, size_t cols, TensorLayout layout, size_t slot_count,
+                    bool cyclic_padding = false, size_t min_stride = 1)
+        : rows_(rows), cols_(cols), layout_(layout), cyclic_(cyclic_padding), slot_count_(slot_count) {
+        if (rows == 0 || cols == 0) {
+            throw invalid_argument("EncryptedTensor: empty shape");
+        }
+        if (cyclic_padding && layout != TensorLayout::RowMajor) {
+            throw invalid_argument("EncryptedTensor: cyclic padding requires a row-major layout");
+        }
+        size_t needed = layout == TensorLayout::RowMajor ? (cyclic_padding ? 2 * cols : cols) : rows;
+        stride_ = 1;
+        while (stride_ < max(needed, min_stride)) stride_ <<= 1;
+        if (stride_ > slot_count) {
+            throw invalid_argument("EncryptedTensor: a single row does not fit in one ciphertext");
+        }
+        size_t lanes = layout == TensorLayout::RowMajor ? rows : cols;
+        ciphertexts_.resize((lanes * stride_ + slot_count - 1) / slot_count);
+    }
+
+    static EncryptedTensor encrypt(const vector<vector<double>>& values, TensorLayout layout,
+                                   bool cyclic_padding, CKKSEncoder& encoder, Encryptor& encryptor,
+                                   double scale) {
+        EncryptedTensor tensor(values.size(), values.empty() ? 0 : values[0].size(), layout,
+                               encoder.slot_count(), cyclic_padding);
+        vector<vector<double>> slots(tensor.ciphertexts_.size(), vector<double>(tensor.slot_count_, 0.0));
+        for (size_t r = 0; r < tensor.rows_; r++) {
+            for (size_t c = 0; c < tensor.cols_; c++) {
+                for (size_t g : tensor.slots_of(r, c)) {
+                    slots[g / tensor.slot_count_][g % tensor.slot_count_] = values[r][c];
+                }
+            }
+        }
+        Plaintext plain;
+        for (size_t i = 0; i < slots.size(); i++) {
+            encoder.encode(slots[i], scale, plain);
+            encryptor.encrypt(plain, tensor.ciphertexts_[i]);
+        }
+        return tensor;
+    }
+
+    vector<vector<double>> decrypt(CKKSEncoder& encoder, Decryptor& decryptor) const {
+        vector<vector<double>> decoded(ciphertexts_.size());
+        Plaintext plain;
+        for (size_t i = 0; i < ciphertexts_.size(); i++) {
+            decryptor.decrypt(ciphertexts_[i], plain);
+            encoder.decode(plain, decoded[i]);
+        }
+        vector<vector<double>> values(rows_, vector<double>(cols_));
+        for (size_t r = 0; r < rows_; r++) {
+            for (size_t c = 0; c < cols_; c++) {
+                size_t g = primary_slot(r, c);
+                values[r][c] = decoded[g / slot_count_][g % slot_count_];
+            }
+        }
+        return values;
+    }
+
+    size_t primary_slot(size_t r, size_t c) const {
+        switch (layout_) {
+        case TensorLayout::RowMajor:
+            return r * stride_ + c;
+        case TensorLayout::Diagonal:
+            return ((c + cols_ - r % cols_) % cols_) * stride_ + r;
+        default:
+            return c * stride_ + r;
+        }
+    }
+
+    // Every global slot holding (r, c): the primary one plus, with cyclic
+    // padding, its periodic copies in the row padding
+    vector<size_t> slots_of(size_t r, size_t c) const {
+        vector<size_t> slots{primary_slot(r, c)};
+        if (cyclic_) {
+            for (size_t p = c + cols_; p < stride_; p += cols_) {
+                slots.push_back(r * stride_ + p);
+            }
+        }
+        return slots;
+    }
+
+    LayoutCost conversion_cost(TensorLayout target, bool target_cyclic) const {
+        if (target == layout_ && target_cyclic == cyclic_) {
+            return {};
+        }
+        EncryptedTensor shape(rows_, cols_, target, slot_count_, target_cyclic);
+        LayoutCost cost;
+        for (const auto& group : moves_to(shape)) {
+            cost.plain_multiplies++;
+            if (get<2>(group.first) != 0) cost.rotations++;
+        }
+        cost.levels = 1;
+        return cost;
+    }
+
+    // Repack into another layout by masking, rotating and summing: one
+    // mask multiply per (source, destination, shift) group and one rescale.
+    // Masks are encoded at the last prime of the current level, so the
+    // rescale brings the scale back to where it was.
+    EncryptedTensor convert(TensorLayout target, bool target_cyclic, const SEALContext& context,
+                            CKKSEncoder& encoder, Evaluator& evaluator, GaloisKeyPager& galois_keys) const {
+        if (target == layout_ && target_cyclic == cyclic_) {
+            return *this;
+        }
+        EncryptedTensor result(rows_, cols_, target, slot_count_, target_cyclic);
+        auto context_data = context.get_context_data(ciphertexts_[0].parms_id());
+        double mask_scale = static_cast<double>(context_data->parms().coeff_modulus().back().value());
+
+        Plaintext mask_plain;
+        Ciphertext moved;
+        vector<bool> started(result.ciphertexts_.size(), false);
+        for (const auto& group : moves_to(result)) {
+            size_t src = get<0>(group.first);
+            size_t dst = get<1>(group.first);
+            int shift = get<2>(group.first);
+
+            vector<double> mask(slot_count_, 0.0);
+            for (size_t slot : group.second) mask[slot] = 1.0;
+            encoder.encode(mask, ciphertexts_[src].parms_id(), mask_scale, mask_plain);
+            evaluator.multiply_plain(ciphertexts_[src], mask_plain, moved);
+            if (shift != 0) {
+                evaluator.rotate_vector_inplace(moved, shift, *galois_keys.get(shift));
+            }
+            if (started[dst]) {
+                evaluator.add_inplace(result.ciphertexts_[dst], moved);
+            } else {
+                result.ciphertexts_[dst] = moved;
+                started[dst] = true;
+            }
+        }
+        // Every destination ciphertext holds at least one lane, so all were written
+        for (auto& ct : result.ciphertexts_) {
+            evaluator.rescale_to_next_inplace(ct);
+        }
+        return result;
+    }
+
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    TensorLayout layout() const { return layout_; }
+    bool cyclic_padding() const { return cyclic_; }
+    size_t stride() const { return stride_; }
+    size_t slot_count() const { return slot_count_; }
+    size_t size() const { return ciphertexts_.size(); }
+    vector<Ciphertext>& ciphertexts() { return ciphertexts_; }
+    const vector<Ciphertext>& ciphertexts() const { return ciphertexts_; }
+    double scale() const { return ciphertexts_[0].scale(); }
+
+    size_t level(const SEALContext& context) const {
+        return context.get_context_data(ciphertexts_[0].parms_id())->chain_index();
+    }
+
+private:
+    // Source slots grouped by (source ciphertext, destination ciphertext,
+    // left-rotation step) for every element copy the target layout needs
+    map<tuple<size_t, size_t, int>, vector<size_t>> moves_to(const EncryptedTensor& target) const {
+        map<tuple<size_t, size_t, int>, vector<size_t>> groups;
+        long long n = static_cast<long long>(slot_count_);
+        for (size_t r = 0; r < rows_; r++) {
+            for (size_t c = 0; c < cols_; c++) {
+                size_t from = primary_slot(r, c);
+                for (size_t to : target.slots_of(r, c)) {
+                    long long step = (static_cast<long long>(from % slot_count_) -
+                                      static_cast<long long>(to % slot_count_) + n) % n;
+                    if (step > n / 2) step -= n;
+                    groups[make_tuple(from / slot_count_, to / slot_count_, static_cast<int>(step))]
+                        .push_back(from % slot_count_);
+                }
+            }
+        }
+        return groups;
+    }
+
+    size_t rows_ = 0;
+    size_t cols_ = 0;
+    TensorLayout layout_ = TensorLayout::RowMajor;
+    bool cyclic_ = false;
+    size_t slot_count_ = 0;
+    size_t stride_ = 1;
+    vector<Ciphertext> ciphertexts_;
+};
+
 class BatchGraphEmbeddings {
 private:
     // Graph data structures
@@ -29,7 +380,7 @@ private:
     PublicKey public_key;
     SecretKey secret_key;
     RelinKeys relin_keys;
-    GaloisKeys galois_keys;
+    unique_ptr<GaloisKeyPager> galois_keys;
     
     // Parallel processing and memory management
     mutex mtx;
@@ -37,15 +388,10 @@ private:
     double scale;
     size_t slot_count;
     size_t embedding_size;
-    size_t padded_size;
-    double padding_value = 0.0;
     
-    // Encrypted data storage
-    struct NodeEncryptionData {
-        size_t plain_idx;
-        Ciphertext batch_cipher;
-    };
-    unordered_map<size_t, NodeEncryptionData> edge_embeddings;
+    // Encrypted data storage: one tensor row per node
+    EncryptedTensor embeddings;
+    unordered_map<size_t, size_t> node_rows;
 
 public:
     BatchGraphEmbeddings(const map<pair<size_t, size_t>, vector<double>>& graph, 
@@ -67,7 +413,7 @@ public:
         secret_key = keygen.secret_key();
         keygen.create_public_key(public_key);
         keygen.create_relin_keys(relin_keys);
-        keygen.create_galois_keys(galois_keys);
+        galois_keys = make_unique<GaloisKeyPager>(*context, secret_key);
         
         encryptor = make_unique<Encryptor>(*context, public_key);
         evaluator = make_unique<Evaluator>(*context);
@@ -86,39 +432,19 @@ private:
             adjacency_list[src].emplace_back(tgt, edge.second);
         }
         
-        // Determine embedding size and padding
+        // Determine embedding size; padding is chosen by the tensor layout
         if (!graph_data.empty()) {
             embedding_size = graph_data.begin()->second.size();
-            padded_size = ((embedding_size + slot_count - 1) / slot_count) * slot_count;
         }
     }
 
-    Plaintext encode_batch(const vector<vector<double>>& vectors) {
-        // Flatten and pad the vectors
-        vector<double> flat_data;
-        for (const auto& vec : vectors) {
-            vector<double> padded_vec = vec;
-            padded_vec.resize(padded_size, padding_value);
-            flat_data.insert(flat_data.end(), padded_vec.begin(), padded_vec.end());
-        }
-        
-        // Pad to full slot count if needed
-        if (flat_data.size() < slot_count) {
-            flat_data.resize(slot_count, padding_value);
-        }
-        
-        Plaintext plain;
-        encoder->encode(flat_data, scale, plain);
-        return plain;
-    }
-
     vector<vector<double>> decode_batch(const Plaintext& plain, size_t expected_vectors) {
         vector<double> decoded;
         encoder->decode(plain, decoded);
         
         vector<vector<double>> result;
         for (size_t i = 0; i < expected_vectors; ++i) {
-            size_t start = i * padded_size;
+            size_t start = i * embeddings.stride();
             size_t end = start + embedding_size;
             if (end > decoded.size()) break;
             
@@ -138,35 +464,28 @@ public:
             unique_nodes.insert(edge.first.second);
         }
         
-        // Process in batches
-        size_t batch_size = slot_count / padded_size;
         vector<size_t> node_list(unique_nodes.begin(), unique_nodes.end());
-        
-        for (size_t i = 0; i < node_list.size(); i += batch_size) {
-            size_t end = min(i + batch_size, node_list.size());
-            vector<size_t> batch_nodes(node_list.begin() + i, node_list.begin() + end);
-            
-            // Get embeddings for this batch
-            vector<vector<double>> embeddings;
-            for (size_t node : batch_nodes) {
-                if (!adjacency_list[node].empty()) {
-                    embeddings.push_back(adjacency_list[node][0].second);
-                } else {
-                    embeddings.emplace_back(embedding_size, 0.0);
-                }
-            }
-            
-            // Encode and encrypt
-            Plaintext plain = encode_batch(embeddings);
-            Ciphertext cipher;
-            encryptor->encrypt(plain, cipher);
-            
-            // Store with thread-safe access
-            lock_guard<mutex> lock(mtx);
-            for (size_t j = 0; j < batch_nodes.size(); ++j) {
-                edge_embeddings[batch_nodes[j]] = {j, cipher};
+        vector<vector<double>> rows;
+        rows.reserve(node_list.size());
+        for (size_t node : node_list) {
+            if (!adjacency_list[node].empty()) {
+                rows.push_back(adjacency_list[node][0].second);
+            } else {
+                rows.emplace_back(embedding_size, 0.0);
             }
         }
+        
+        // One row per node; the tensor packs slot_count / stride rows into
+        // each ciphertext and spreads the rest over as many as needed
+        EncryptedTensor tensor = EncryptedTensor::encrypt(rows, TensorLayout::RowMajor, false,
+                                                          *encoder, *encryptor, scale);
+        
+        // Store with thread-safe access
+        lock_guard<mutex> lock(mtx);
+        embeddings = move(tensor);
+        for (size_t i = 0; i < node_list.size(); ++i) {
+            node_rows[node_list[i]] = i;
+        }
     }
 
     Ciphertext aggregate_neighbors(size_t node, size_t depth = 1) {
@@ -174,29 +493,31 @@ public:
             throw invalid_argument("Node not found in graph");
         }
         
-        auto node_data = edge_embeddings.find(node);
-        if (node_data == edge_embeddings.end()) {
+        auto row = node_rows.find(node);
+        if (row == node_rows.end()) {
             throw invalid_argument("Encrypted embeddings not found for node");
         }
         
-        Ciphertext cipher = node_data->second.batch_cipher;
-        size_t idx = node_data->second.plain_idx;
+        size_t slot = embeddings.primary_slot(row->second, 0);
+        const Ciphertext& batch = embeddings.ciphertexts()[slot / slot_count];
+        slot %= slot_count;
         
-        // Create mask to select the target node's embedding
+        // Plaintext mask over the node's row, encoded at the batch's level
         vector<double> mask(slot_count, 0.0);
-        size_t start_pos = idx * padded_size;
-        size_t end_pos = start_pos + padded_size;
-        fill(mask.begin() + start_pos, mask.begin() + end_pos, 1.0);
-        
-        // Encode and encrypt the mask
+        fill(mask.begin() + slot, mask.begin() + slot + embeddings.cols(), 1.0);
         Plaintext mask_plain;
-        encoder->encode(mask, scale, mask_plain);
-        Ciphertext mask_cipher;
-        encryptor->encrypt(mask_plain, mask_cipher);
+        encoder->encode(mask, batch.parms_id(), scale, mask_plain);
         
         // Multiply to isolate the target embedding
-        evaluator->multiply_inplace(cipher, mask_cipher);
-        evaluator->relinearize_inplace(cipher, relin_keys);
+        Ciphertext cipher;
+        evaluator->multiply_plain(batch, mask_plain, cipher);
+        evaluator->rescale_to_next_inplace(cipher);
+        
+        // Move the row to the front so the result decodes as row 0
+        if (slot != 0) {
+            int step = static_cast<int>(slot);
+            evaluator->rotate_vector_inplace(cipher, step, *galois_keys->get(step));
+        }
         
         // For multi-hop aggregation, we would add neighbor traversal here
         if (depth > 1) {
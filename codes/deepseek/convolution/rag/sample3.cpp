@@ -3,15 +3,153 @@
 #include <memory>
 #include <cmath>
 #include <chrono>
+#include <fstream>
+#include <string>
+#include <map>
+#include <mutex>
+#include <algorithm>
 #include "seal/seal.h"
 
 using namespace std;
 using namespace seal;
 
+// Memory instrumentation: SEAL global pool usage, process RSS and peak RSS
+// from /proc/self/status, exact footprints of SEAL objects, and per-phase
+// high-water marks (the kernel's peak RSS counter is reset at each phase start).
 class MemoryTracker {
 public:
+    struct Snapshot {
+        size_t seal_pool_bytes = 0;
+        size_t rss_bytes = 0;
+        size_t peak_rss_bytes = 0;
+    };
+
+    struct PhaseRecord {
+        string name;
+        Snapshot start;
+        Snapshot end;
+        bool finished = false; // Set by end_phase
+    };
+
+    static Snapshot snapshot() {
+        Snapshot s;
+        s.seal_pool_bytes = MemoryManager::GetPool().alloc_byte_count();
+        s.rss_bytes = read_status_kb("VmRSS:") * 1024;
+        s.peak_rss_bytes = read_status_kb("VmHWM:") * 1024;
+        return s;
+    }
+
+    // Bytes held by the object's coefficient data (allocated capacity)
+    static size_t footprint(const Ciphertext& ct) {
+        return ct.size_capacity() * ct.poly_modulus_degree() * ct.coeff_modulus_size() * sizeof(uint64_t);
+    }
+
+    static size_t footprint(const Plaintext& pt) {
+        return pt.capacity() * sizeof(uint64_t);
+    }
+
+    static size_t footprint(const PublicKey& key) {
+        return footprint(key.data());
+    }
+
+    static size_t footprint(const SecretKey& key) {
+        return footprint(key.data());
+    }
+
+    static size_t footprint(const KSwitchKeys& keys) {
+        size_t bytes = 0;
+        for (const auto& key_set : keys.data()) {
+            for (const auto& key : key_set) {
+                bytes += footprint(key);
+            }
+        }
+        return bytes;
+    }
+
+    template <class T>
+    static size_t footprint(const vector<T>& objects) {
+        size_t bytes = 0;
+        for (const auto& object : objects) {
+            bytes += footprint(object);
+        }
+        return bytes;
+    }
+
+    void add_footprint(const string& label, size_t bytes) {
+        lock_guard<mutex> lock(memory_mutex);
+        footprints[label] += bytes;
+    }
+
+    void remove_footprint(const string& label, size_t bytes) {
+        lock_guard<mutex> lock(memory_mutex);
+        auto& entry = footprints[label];
+        entry -= min(entry, bytes);
+    }
+
+    void begin_phase(const string& name) {
+        reset_peak_rss();
+        lock_guard<mutex> lock(memory_mutex);
+        phases.push_back({name, snapshot(), Snapshot(), false});
+    }
+
+    void end_phase() {
+        lock_guard<mutex> lock(memory_mutex);
+        if (!phases.empty()) {
+            phases.back().end = snapshot();
+            phases.back().finished = true;
+        }
+    }
+
+    void print_report() const {
+        lock_guard<mutex> lock(memory_mutex);
+        auto mb = [](size_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); };
+        Snapshot now = snapshot();
+        cout << "Memory: RSS " << mb(now.rss_bytes) << " MB, SEAL pool "
+             << mb(now.seal_pool_bytes) << " MB" << endl;
+        for (const auto& entry : footprints) {
+            cout << "  " << entry.first << ": " << mb(entry.second) << " MB" << endl;
+        }
+        for (const auto& phase : phases) {
+            if (!phase.finished) continue;
+            // The pool can shrink within a phase, so the change is signed
+            int64_t pool_delta = static_cast<int64_t>(phase.end.seal_pool_bytes)
+                               - static_cast<int64_t>(phase.start.seal_pool_bytes);
+            cout << "  phase " << phase.name << ": peak RSS " << mb(phase.end.peak_rss_bytes)
+                 << " MB, SEAL pool " << showpos << pool_delta / (1024.0 * 1024.0) << noshowpos
+                 << " MB" << endl;
+        }
+    }
+
     static void print_memory_stats(const string& label = "") {
-        cout << label << " - Memory stats (simulated)" << endl;
+        Snapshot s = snapshot();
+        cout << label << " - RSS " << s.rss_bytes / 1024 << " KB, peak "
+             << s.peak_rss_bytes / 1024 << " KB, SEAL pool "
+             << s.seal_pool_bytes / 1024 << " KB" << endl;
+    }
+
+private:
+    mutable mutex memory_mutex;
+    map<string, size_t> footprints;
+    vector<PhaseRecord> phases;
+
+    // Returns 0 where /proc is unavailable
+    static size_t read_status_kb(const string& key) {
+        ifstream status("/proc/self/status");
+        string line;
+        while (getline(status, line)) {
+            if (line.compare(0, key.size(), key) == 0) {
+                return stoul(line.substr(key.size()));
+            }
+        }
+        return 0;
+    }
+
+    // Writing 5 to clear_refs resets VmHWM to the current RSS (Linux >= 4.0)
+    static void reset_peak_rss() {
+        ofstream clear_refs("/proc/self/clear_refs");
+        if (clear_refs) {
+            clear_refs << "5";
+        }
     }
 };
 
@@ -28,6 +166,7 @@ class ChunkedGraphProcessor {
     size_t chunk_size;
     size_t poly_modulus_degree;
     double scale;
+    MemoryTracker memory_tracker;
 
 public:
     ChunkedGraphProcessor(shared_ptr<SEALContext> ctx, 
@@ -68,10 +207,14 @@ public:
                 size_t start = chunk_idx * chunk_size;
                 size_t end = min((chunk_idx + 1) * chunk_size, total_nodes);
 
+                memory_tracker.begin_phase("chunk " + to_string(chunk_idx));
                 process_chunk(graph, start, end, results[0]);
+                memory_tracker.end_phase();
                 
                 MemoryTracker::print_memory_stats("After chunk " + to_string(chunk_idx));
             }
+            memory_tracker.add_footprint("results", MemoryTracker::footprint(results));
+            memory_tracker.print_report();
 
             return results;
         } catch (const exception& e) {
@@ -103,9 +246,11 @@ private:
 
     void apply_memory_efficient_attention(Ciphertext& cipher) {
         try {
+            // Encode at the ciphertext's level: the NTT and the plaintext
+            // only cover the primes the aggregate still has
             Plaintext attention_weight;
             vector<double> weight(poly_modulus_degree / 2, 0.5);
-            encoder->encode(weight, scale, attention_weight);
+            encoder->encode(weight, cipher.parms_id(), scale, attention_weight);
             evaluator->multiply_plain_inplace(cipher, attention_weight);
         } catch (const exception& e) {
             cerr << "Error in apply_memory_efficient_attention: " << e.what() << endl;
@@ -151,6 +296,13 @@ public:
             CKKSEncoder encoder(*context);
 
             vector<EncryptedGraphNode> graph = create_sample_graph(encoder, encryptor, 500); // Reduced graph size
+            size_t graph_bytes = 0;
+            for (const auto& node : graph) {
+                graph_bytes += MemoryTracker::footprint(node.features);
+            }
+            cout << "Graph ciphertexts: " << graph_bytes / (1024 * 1024) << " MB, keys: "
+                 << (MemoryTracker::footprint(public_key) + MemoryTracker::footprint(secret_key)) / 1024
+                 << " KB" << endl;
 
             ChunkedGraphProcessor processor(context, chunk_size, poly_modulus_degree, scale);
             processor.set_encryptor(make_shared<Encryptor>(*context, public_key));
@@ -8,16 +8,651 @@
 #include <queue>
 #include <unordered_map>
 #include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <numeric>
+#include <stdexcept>
+#include <cmath>
+#include <array>
+#include <random>
+#include <functional>
 #include "seal/seal.h"
 
 using namespace std;
 using namespace seal;
 
+// Stored form of an encrypted embedding. Fresh symmetric encryptions are
+// serialized seeded (c1 is re-expanded from a PRNG seed on load, halving the
+// payload), the bytes are zstd-compressed, and only the RNS limbs of the
+// ciphertext's own level are written, so storing below the top level drops
+// the unused primes.
+struct CompressedCiphertext {
+    vector<seal_byte> bytes;
+
+    // Accepts a Ciphertext or the Serializable<Ciphertext> of encrypt_symmetric
+    template<typename T>
+    static CompressedCiphertext from(const T& ciphertext) {
+        CompressedCiphertext stored;
+        stored.bytes.resize(static_cast<size_t>(ciphertext.save_size(compr_mode_type::zstd)));
+        auto written = ciphertext.save(stored.bytes.data(), stored.bytes.size(), compr_mode_type::zstd);
+        stored.bytes.resize(static_cast<size_t>(written));
+        stored.bytes.shrink_to_fit();
+        return stored;
+    }
+
+    void load(const SEALContext& context, Ciphertext& destination) const {
+        destination.load(context, bytes.data(), bytes.size());
+    }
+
+    size_t size() const { return bytes.size(); }
+};
+
+// Read-only, memory-mapped store of serialized ciphertexts. The file holds a
+// data column of concatenated ciphertext bytes followed by an index sorted by
+// (node id, chunk). Opening maps the file and reads only the header, so
+// startup does not depend on the graph size; lookups binary-search the mapped
+// index and deserialize straight out of the mapping, and the page cache
+// decides what stays resident.
+class MappedCiphertextStore {
+private:
+    struct Header {
+        char magic[8];
+        uint64_t entry_count;
+        uint64_t index_offset;
+    };
+
+public:
+    struct IndexEntry {
+        int64_t node_id;
+        uint64_t chunk;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    // Streams ciphertexts to disk; finish() sorts and appends the index
+    class Writer {
+    public:
+        explicit Writer(const string& path) : out(path, ios::binary | ios::trunc), offset(sizeof(Header)) {
+            if (!out) {
+                throw runtime_error("Cannot create ciphertext store: " + path);
+            }
+            Header header{};
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        }
+
+        void append(int64_t node_id, uint64_t chunk, const vector<seal_byte>& bytes) {
+            append(node_id, chunk, bytes.data(), bytes.size());
+        }
+
+        void append(int64_t node_id, uint64_t chunk, const seal_byte* bytes, size_t size) {
+            out.write(reinterpret_cast<const char*>(bytes), size);
+            entries.push_back({node_id, chunk, offset, size});
+            offset += size;
+        }
+
+        void finish() {
+            sort(entries.begin(), entries.end(), [](const IndexEntry& a, const IndexEntry& b) {
+                return a.node_id != b.node_id ? a.node_id < b.node_id : a.chunk < b.chunk;
+            });
+            // Keep the index 8-byte aligned so it can be read in place
+            static const char zeros[8] = {};
+            uint64_t padding = (8 - offset % 8) % 8;
+            out.write(zeros, padding);
+
+            Header header{{'C', 'T', 'S', 'T', 'O', 'R', 'E', '1'}, entries.size(), offset + padding};
+            out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(IndexEntry));
+            out.seekp(0);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.close();
+            if (!out) {
+                throw runtime_error("Failed to write ciphertext store");
+            }
+        }
+
+    private:
+        ofstream out;
+        vector<IndexEntry> entries;
+        uint64_t offset;
+    };
+
+    MappedCiphertextStore() = default;
+    MappedCiphertextStore(const MappedCiphertextStore&) = delete;
+    MappedCiphertextStore& operator=(const MappedCiphertextStore&) = delete;
+
+    ~MappedCiphertextStore() {
+        close();
+    }
+
+    void open(const string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw runtime_error("Cannot open ciphertext store: " + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+            ::close(fd);
+            throw runtime_error("Invalid ciphertext store: " + path);
+        }
+        void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            throw runtime_error("Cannot map ciphertext store: " + path);
+        }
+        base = static_cast<const uint8_t*>(mapping);
+        length = static_cast<size_t>(st.st_size);
+
+        // Bounds are checked by subtracting from length, so corrupt counts or
+        // offsets cannot overflow past it; every entry is checked here so that
+        // load() and data() never read outside the mapping
+        Header header;
+        memcpy(&header, base, sizeof(header));
+        bool valid = memcmp(header.magic, "CTSTORE1", sizeof(header.magic)) == 0 &&
+                     header.index_offset <= length &&
+                     header.index_offset % alignof(IndexEntry) == 0 &&
+                     header.entry_count <= (length - header.index_offset) / sizeof(IndexEntry);
+        if (valid) {
+            index = reinterpret_cast<const IndexEntry*>(base + header.index_offset);
+            for (uint64_t i = 0; i < header.entry_count && valid; i++) {
+                valid = index[i].offset <= length && index[i].size <= length - index[i].offset;
+            }
+        }
+        if (!valid) {
+            close();
+            throw runtime_error("Corrupt ciphertext store: " + path);
+        }
+        entries = header.entry_count;
+        // Lookups are random, so read-ahead would only evict useful pages
+        madvise(mapping, length, MADV_RANDOM);
+    }
+
+    void close() {
+        if (base) {
+            munmap(const_cast<uint8_t*>(base), length);
+        }
+        base = nullptr;
+        length = 0;
+        index = nullptr;
+        entries = 0;
+    }
+
+    bool is_open() const { return base != nullptr; }
+    size_t size() const { return entries; }
+    const IndexEntry& entry(size_t i) const { return index[i]; }
+
+    // Index range [first, second) of the chunks stored for node_id
+    pair<size_t, size_t> find(int64_t node_id) const {
+        auto first = lower_bound(index, index + entries, node_id,
+            [](const IndexEntry& e, int64_t id) { return e.node_id < id; });
+        auto last = upper_bound(first, index + entries, node_id,
+            [](int64_t id, const IndexEntry& e) { return id < e.node_id; });
+        return {static_cast<size_t>(first - index), static_cast<size_t>(last - index)};
+    }
+
+    void load(size_t i, const SEALContext& context, Ciphertext& destination) const {
+        const IndexEntry& e = index[i];
+        destination.load(context, data(i), e.size);
+    }
+
+    // Serialized bytes of entry i, valid while the store is open
+    const seal_byte* data(size_t i) const {
+        return reinterpret_cast<const seal_byte*>(base + index[i].offset);
+    }
+
+private:
+    const uint8_t* base = nullptr;
+    size_t length = 0;
+    const IndexEntry* index = nullptr;
+    size_t entries = 0;
+};
+
+// Node database packed for one encrypted matrix-vector product per query.
+// With block = next power of two >= dim, the query is replicated with period
+// block across all slots, and generalized diagonal j of a group of up to
+// slot_count nodes holds E[n][(n + j) mod block] in slot n. Then
+// sum_j diag_j * rot(query, j) leaves every node's score in its own slot:
+// one output ciphertext per slot_count nodes. Baby-step giant-step splits
+// j = g * baby + b. The query is rotated baby - 1 times and those rotations
+// are shared by every group. Diagonals are stored shifted right by g * baby,
+// so each partial sum over b needs one left rotation by g * baby. Each group
+// then adds only giant - 1 rotations. That is about 2 * sqrt(block) key
+// switches per query instead of one per node.
+class PackedScoreMatrix {
+public:
+    // Rows are cosine-normalized, so scores are cosine similarities
+    template<typename Node>
+    void pack(const vector<Node>& nodes, const CKKSEncoder& encoder, parms_id_type parms_id, double scale) {
+        slots = encoder.slot_count();
+        dim = nodes.empty() ? 0 : nodes[0].embedding.size();
+        block = 1;
+        while (block < dim) block <<= 1;
+        baby = 1;
+        while (baby * baby < block) baby <<= 1;
+        giant = block / baby;
+
+        ids.clear();
+        groups.clear();
+        vector<double> inv_norms(nodes.size());
+        for (size_t i = 0; i < nodes.size(); i++) {
+            const auto& embedding = nodes[i].embedding;
+            if (embedding.size() != dim) throw invalid_argument("PackedScoreMatrix: embedding size mismatch");
+            double norm = sqrt(inner_product(embedding.begin(), embedding.end(), embedding.begin(), 0.0));
+            inv_norms[i] = norm > 0 ? 1.0 / norm : 0.0;
+            ids.push_back(nodes[i].id);
+        }
+
+        vector<double> diagonal(slots);
+        for (size_t first = 0; first < nodes.size(); first += slots) {
+            size_t count = min(slots, nodes.size() - first);
+            auto& group = groups.emplace_back(block);
+            for (size_t j = 0; j < block; j++) {
+                size_t shift = (j / baby) * baby;
+                fill(diagonal.begin(), diagonal.end(), 0.0);
+                for (size_t n = 0; n < count; n++) {
+                    size_t d = (n + j) % block;
+                    if (d < dim) {
+                        diagonal[(n + shift) % slots] = nodes[first + n].embedding[d] * inv_norms[first + n];
+                    }
+                }
+                // multiply_plain by a zero plaintext would give a transparent ciphertext
+                group[j].zero = all_of(diagonal.begin(), diagonal.end(), [](double v) { return v == 0.0; });
+                if (!group[j].zero) encoder.encode(diagonal, parms_id, scale, group[j].plain);
+            }
+        }
+    }
+
+    // Appends one node in place. Its row touches one slot of each diagonal
+    // of the last group, so only those entries are encoded (one sparse
+    // plaintext per diagonal) and added into the stored plaintexts. The cost
+    // depends on the dimension, not on the number of packed nodes, and the
+    // rotation steps do not change.
+    template<typename Node>
+    void insert(const Node& node, const SEALContext& context, const CKKSEncoder& encoder,
+                parms_id_type parms_id, double scale) {
+        if (ids.empty()) {
+            pack(vector<Node>(1, node), encoder, parms_id, scale);
+            return;
+        }
+        const auto& embedding = node.embedding;
+        if (embedding.size() != dim) throw invalid_argument("PackedScoreMatrix: embedding size mismatch");
+        double norm = sqrt(inner_product(embedding.begin(), embedding.end(), embedding.begin(), 0.0));
+        double inv_norm = norm > 0 ? 1.0 / norm : 0.0;
+
+        size_t n = ids.size() % slots;
+        if (n == 0) groups.emplace_back(block);
+        auto& group = groups.back();
+        vector<double> sparse(slots, 0.0);
+        Plaintext row;
+        for (size_t j = 0; j < block; j++) {
+            size_t d = (n + j) % block;
+            if (d >= dim || embedding[d] == 0.0) continue;
+            size_t slot = (n + (j / baby) * baby) % slots;
+            sparse[slot] = embedding[d] * inv_norm;
+            if (group[j].zero) {
+                encoder.encode(sparse, parms_id, scale, group[j].plain);
+                group[j].zero = false;
+            } else {
+                encoder.encode(sparse, parms_id, scale, row);
+                add_plain_inplace(group[j].plain, row, context);
+            }
+            sparse[slot] = 0.0;
+        }
+        ids.push_back(node.id);
+    }
+
+    // Galois steps score() rotates by
+    vector<int> rotation_steps() const {
+        vector<int> steps;
+        for (size_t b = 1; b < baby; b++) steps.push_back(static_cast<int>(b));
+        for (size_t g = 1; g < giant; g++) steps.push_back(static_cast<int>(g * baby));
+        return steps;
+    }
+
+    // Client side: normalized query replicated with period block
+    void encode_query(const vector<double>& query, const CKKSEncoder& encoder, parms_id_type parms_id,
+                      double scale, Plaintext& destination) const {
+        if (query.size() > block) throw invalid_argument("PackedScoreMatrix: query is wider than the database");
+        double norm = sqrt(inner_product(query.begin(), query.end(), query.begin(), 0.0));
+        vector<double> replicated(slots, 0.0);
+        for (size_t i = 0; i < slots; i++) {
+            size_t d = i % block;
+            if (d < query.size() && norm > 0) replicated[i] = query[d] / norm;
+        }
+        encoder.encode(replicated, parms_id, scale, destination);
+    }
+
+    // Server side: destination[g] holds the scores of nodes g*slots.. in its
+    // slots. keys_for(step) returns a pointer-like handle to Galois keys
+    // covering step. A group with no nonzero entry is left empty.
+    template<typename KeysFor>
+    void score(const Ciphertext& encrypted_query, const Evaluator& evaluator, KeysFor keys_for,
+               vector<Ciphertext>& destination) const {
+        vector<Ciphertext> baby_rotations(baby);
+        baby_rotations[0] = encrypted_query;
+        for (size_t b = 1; b < baby; b++) {
+            int step = static_cast<int>(b);
+            evaluator.rotate_vector(encrypted_query, step, *keys_for(step), baby_rotations[b]);
+        }
+
+        destination.assign(groups.size(), Ciphertext());
+        Ciphertext inner, term;
+        for (size_t g = 0; g < groups.size(); g++) {
+            Ciphertext& scores = destination[g];
+            for (size_t gi = 0; gi < giant; gi++) {
+                bool has_inner = false;
+                for (size_t b = 0; b < baby; b++) {
+                    const Diagonal& diagonal = groups[g][gi * baby + b];
+                    if (diagonal.zero) continue;
+                    if (!has_inner) {
+                        evaluator.multiply_plain(baby_rotations[b], diagonal.plain, inner);
+                        has_inner = true;
+                    } else {
+                        evaluator.multiply_plain(baby_rotations[b], diagonal.plain, term);
+                        evaluator.add_inplace(inner, term);
+                    }
+                }
+                if (!has_inner) continue;
+                if (gi > 0) {
+                    int step = static_cast<int>(gi * baby);
+                    evaluator.rotate_vector_inplace(inner, step, *keys_for(step));
+                }
+                if (scores.size() == 0) {
+                    scores = move(inner);
+                } else {
+                    evaluator.add_inplace(scores, inner);
+                }
+            }
+            if (scores.size() != 0) evaluator.rescale_to_next_inplace(scores);
+        }
+    }
+
+    size_t node_count() const { return ids.size(); }
+    int node_id(size_t i) const { return ids[i]; }
+
+private:
+    struct Diagonal {
+        Plaintext plain;
+        bool zero = true;
+    };
+
+    // Encoding is linear, so two NTT-form plaintexts at one level add limb
+    // by limb modulo each prime
+    static void add_plain_inplace(Plaintext& destination, const Plaintext& other, const SEALContext& context) {
+        const auto& coeff_modulus = context.get_context_data(destination.parms_id())->parms().coeff_modulus();
+        size_t degree = destination.coeff_count() / coeff_modulus.size();
+        uint64_t* a = destination.data();
+        const uint64_t* b = other.data();
+        for (size_t i = 0; i < coeff_modulus.size(); i++) {
+            uint64_t q = coeff_modulus[i].value();
+            for (size_t c = i * degree; c < (i + 1) * degree; c++) {
+                uint64_t sum = a[c] + b[c];
+                a[c] = sum >= q ? sum - q : sum;
+            }
+        }
+    }
+
+    size_t slots = 0;
+    size_t dim = 0;
+    size_t block = 1;
+    size_t baby = 1;
+    size_t giant = 1;
+    vector<int> ids;
+    vector<vector<Diagonal>> groups;
+};
+
+// Approximate top-k over packed encrypted scores in [-1, 1], decrypting
+// neither the scores nor their order. The comparison x > 0 is the composite
+// sign approximation of Cheon et al. (Asiacrypt 2020), f^df o g^dg, with
+//   g(x) = (4589x - 16577x^3 + 25614x^5 - 12860x^7) / 2^10
+//   f(x) = (35x - 35x^3 + 21x^5 - 5x^7) / 2^4.
+// Each degree-7 stage costs 3 levels. The indicator of score > t is
+// (1 + sign((score - t) / 2)) / 2, and it is within 0.05 of 0 or 1 once
+// |score - t| clears the resolution below:
+//   levels  (dg, df)  resolution      levels  (dg, df)  resolution
+//     6      (0, 2)     0.54            9      (1, 2)     0.122
+//     6      (1, 1)     0.26           12      (2, 2)     0.027
+//     9      (2, 1)     0.058          15      (3, 2)     0.006
+// A tournament or bitonic network needs log2(n) comparisons in sequence,
+// which no SEAL modulus chain holds without bootstrapping. Instead each
+// round evaluates one comparison against a public threshold over every
+// slot. Only the encrypted count of scores above it is decrypted, and the
+// threshold is bisected until about k pass. The key holder sees one count
+// per round and the final indicators, never a score.
+struct TopKOptions {
+    size_t g_stages = 1;
+    size_t f_stages = 2;
+    size_t max_rounds = 16;
+};
+
+class EncryptedTopK {
+public:
+    struct Selection {
+        vector<Ciphertext> indicators; // encrypted 0/1 per slot
+        double threshold = 0.0;
+        size_t rounds = 0;
+    };
+
+    static size_t levels_required(const TopKOptions& options) {
+        return 3 * (options.g_stages + options.f_stages);
+    }
+
+    // Radix-16 rotate-and-sum: four keys instead of log2(slots), at the
+    // price of up to 15 cheap bottom-level rotations per key
+    static vector<int> sum_steps(size_t slots) {
+        vector<int> steps;
+        for (size_t step = 1; step < slots; step *= 16) steps.push_back(static_cast<int>(step));
+        return steps;
+    }
+
+    EncryptedTopK(const SEALContext& context, const CKKSEncoder& encoder, const Evaluator& evaluator,
+                  const RelinKeys& relin_keys, const GaloisKeys& galois_keys, TopKOptions options = TopKOptions())
+        : context(context), encoder(encoder), evaluator(evaluator),
+          relin_keys(relin_keys), galois_keys(galois_keys), options(options) {}
+
+    // Server: destination[g] is about 1 where scores[g] > threshold and 0 below
+    void indicators(const vector<Ciphertext>& scores, double threshold, vector<Ciphertext>& destination) const {
+        destination.assign(scores.size(), Ciphertext());
+        for (size_t g = 0; g < scores.size(); g++) {
+            if (scores[g].size() == 0) throw invalid_argument("EncryptedTopK: empty score ciphertext");
+            if (context.get_context_data(scores[g].parms_id())->chain_index() < levels_required(options)) {
+                throw invalid_argument("EncryptedTopK: scores have too few levels left");
+            }
+            Plaintext plain_threshold;
+            encoder.encode(threshold, scores[g].parms_id(), scores[g].scale(), plain_threshold);
+            Ciphertext x;
+            evaluator.sub_plain(scores[g], plain_threshold, x);
+
+            size_t stages = options.g_stages + options.f_stages;
+            for (size_t stage = 0; stage < stages; stage++) {
+                const auto& c = stage < options.g_stages ? g_coeffs : f_coeffs;
+                // Fold the input halving into the first stage and the
+                // (1 + sign) / 2 mapping into the last
+                double in = stage == 0 ? 0.5 : 1.0;
+                double out = stage + 1 == stages ? 0.5 : 1.0;
+                array<double, 4> odd = {out * c[0] * in, out * c[1] * pow(in, 3),
+                                        out * c[2] * pow(in, 5), out * c[3] * pow(in, 7)};
+                Ciphertext y;
+                odd_polynomial(x, odd, stage + 1 == stages ? 0.5 : 0.0, y);
+                x = move(y);
+            }
+            destination[g] = move(x);
+        }
+    }
+
+    // Server: every slot of destination holds the sum of all indicators
+    void count(const vector<Ciphertext>& indicators, Ciphertext& destination) const {
+        destination = indicators[0];
+        for (size_t g = 1; g < indicators.size(); g++) evaluator.add_inplace(destination, indicators[g]);
+
+        size_t slots = encoder.slot_count();
+        Ciphertext rotated;
+        for (int step : sum_steps(slots)) {
+            size_t radix = min<size_t>(16, slots / step);
+            rotated = destination;
+            Ciphertext partial = destination;
+            for (size_t r = 1; r < radix; r++) {
+                evaluator.rotate_vector_inplace(rotated, step, galois_keys);
+                evaluator.add_inplace(partial, rotated);
+            }
+            destination = move(partial);
+        }
+    }
+
+    // The indicator polynomial in plaintext; padding slots score exactly 0,
+    // so their share of a count is known and subtracted by the client
+    double indicator_of(double score, double threshold) const {
+        double x = (score - threshold) / 2;
+        for (size_t stage = 0; stage < options.g_stages + options.f_stages; stage++) {
+            const auto& c = stage < options.g_stages ? g_coeffs : f_coeffs;
+            x = c[0] * x + c[1] * pow(x, 3) + c[2] * pow(x, 5) + c[3] * pow(x, 7);
+        }
+        return (1.0 + x) / 2;
+    }
+
+    // Client: bisects the threshold on decrypted counts. valid is the number
+    // of real candidates; the remaining slots are packing padding.
+    Selection select(const vector<Ciphertext>& scores, size_t valid, size_t k, Decryptor& decryptor) const {
+        size_t padding = scores.size() * encoder.slot_count() - valid;
+        double lo = -1.0, hi = 1.0;
+        double passed = 0.0;
+        Selection selection;
+        Ciphertext encrypted_count;
+        Plaintext plain_count;
+        vector<double> decoded;
+
+        auto probe = [&](double threshold) {
+            selection.threshold = threshold;
+            selection.rounds++;
+            indicators(scores, threshold, selection.indicators);
+            count(selection.indicators, encrypted_count);
+            decryptor.decrypt(encrypted_count, plain_count);
+            encoder.decode(plain_count, decoded);
+            passed = decoded[0] - padding * indicator_of(0.0, threshold);
+        };
+
+        while (selection.rounds < options.max_rounds) {
+            probe((lo + hi) / 2);
+            if (passed > k + 0.5) {
+                lo = selection.threshold;
+            } else if (passed < k - 0.5) {
+                hi = selection.threshold;
+            } else {
+                return selection;
+            }
+        }
+        // Out of rounds: settle on the last threshold that let at least k through
+        if (passed < k - 0.5) probe(lo);
+        return selection;
+    }
+
+    // Client: the k slots with the largest decrypted indicators
+    vector<size_t> top_slots(const Selection& selection, size_t valid, size_t k, Decryptor& decryptor) const {
+        size_t slots = encoder.slot_count();
+        vector<pair<double, size_t>> marked;
+        Plaintext plain;
+        vector<double> decoded;
+        for (size_t g = 0; g < selection.indicators.size(); g++) {
+            decryptor.decrypt(selection.indicators[g], plain);
+            encoder.decode(plain, decoded);
+            for (size_t n = 0; n < slots && g * slots + n < valid; n++) {
+                marked.emplace_back(decoded[n], g * slots + n);
+            }
+        }
+        k = min(k, marked.size());
+        partial_sort(marked.begin(), marked.begin() + k, marked.end(), greater<pair<double, size_t>>());
+        vector<size_t> result;
+        for (size_t i = 0; i < k; i++) result.push_back(marked[i].second);
+        return result;
+    }
+
+private:
+    static constexpr array<double, 4> g_coeffs = {4589.0 / 1024, -16577.0 / 1024, 25614.0 / 1024, -12860.0 / 1024};
+    static constexpr array<double, 4> f_coeffs = {35.0 / 16, -35.0 / 16, 21.0 / 16, -5.0 / 16};
+
+    double last_prime(parms_id_type parms_id) const {
+        return static_cast<double>(context.get_context_data(parms_id)->parms().coeff_modulus().back().value());
+    }
+
+    Ciphertext times_constant(const Ciphertext& x, double value, double plain_scale) const {
+        Plaintext plain;
+        encoder.encode(value, x.parms_id(), plain_scale, plain);
+        Ciphertext result;
+        evaluator.multiply_plain(x, plain, result);
+        evaluator.rescale_to_next_inplace(result);
+        return result;
+    }
+
+    void multiply_rescale(Ciphertext& a, const Ciphertext& b) const {
+        evaluator.multiply_inplace(a, b);
+        evaluator.relinearize_inplace(a, relin_keys);
+        evaluator.rescale_to_next_inplace(a);
+    }
+
+    // constant + odd[0] x + odd[1] x^3 + odd[2] x^5 + odd[3] x^7 in three
+    // levels. Each coefficient is multiplied into x first, encoded at the
+    // scale that brings its term out at exactly x's scale, so the terms add
+    // without any scale drift and constants never cost a level of their own.
+    void odd_polynomial(const Ciphertext& x, const array<double, 4>& odd, double constant,
+                        Ciphertext& destination) const {
+        auto level1 = context.get_context_data(x.parms_id())->next_context_data();
+        auto level2 = level1->next_context_data();
+        double q1 = last_prime(x.parms_id());
+        double q2 = last_prime(level1->parms_id());
+        double q3 = last_prime(level2->parms_id());
+
+        Ciphertext x2, x4;
+        evaluator.square(x, x2);
+        evaluator.relinearize_inplace(x2, relin_keys);
+        evaluator.rescale_to_next_inplace(x2);
+        evaluator.square(x2, x4);
+        evaluator.relinearize_inplace(x4, relin_keys);
+        evaluator.rescale_to_next_inplace(x4);
+        double s2 = x2.scale(), s4 = x4.scale();
+
+        destination = times_constant(x, odd[3], q1 * q2 * q3 / (s2 * s4));
+        multiply_rescale(destination, x2);
+        multiply_rescale(destination, x4);
+
+        Ciphertext term = times_constant(x, odd[2], q1 * q3 / s4);
+        evaluator.mod_switch_to_inplace(term, x4.parms_id());
+        multiply_rescale(term, x4);
+        evaluator.add_inplace(destination, term);
+
+        term = times_constant(x, odd[1], q1 * q2 / s2);
+        multiply_rescale(term, x2);
+        evaluator.mod_switch_to_inplace(term, destination.parms_id());
+        evaluator.add_inplace(destination, term);
+
+        term = times_constant(x, odd[0], q1);
+        evaluator.mod_switch_to_inplace(term, destination.parms_id());
+        evaluator.add_inplace(destination, term);
+
+        if (constant != 0.0) {
+            Plaintext plain_constant;
+            encoder.encode(constant, destination.parms_id(), destination.scale(), plain_constant);
+            evaluator.add_plain_inplace(destination, plain_constant);
+        }
+    }
+
+    const SEALContext& context;
+    const CKKSEncoder& encoder;
+    const Evaluator& evaluator;
+    const RelinKeys& relin_keys;
+    const GaloisKeys& galois_keys;
+    TopKOptions options;
+};
+
 // Graph Node Structure with CKKS-compatible embeddings
 struct GraphNode {
     int id;
     vector<double> embedding; // Original embedding
-    Ciphertext encrypted_embedding; // CKKS encrypted embedding
+    CompressedCiphertext encrypted_embedding; // Seeded, compressed CKKS embedding
     vector<int> neighbors;
 };
 
@@ -30,43 +665,100 @@ private:
     unique_ptr<Decryptor> decryptor;
     PublicKey public_key;
     SecretKey secret_key;
+    GaloisKeys score_galois_keys;
     RelinKeys relin_keys;
+    size_t comparison_levels;
     size_t poly_modulus_degree;
     double scale;
+    // Level the embeddings and queries are encoded at: the first data level
+    parms_id_type storage_parms_id;
 
     vector<GraphNode> graph;
+    PackedScoreMatrix score_matrix;
+    MappedCiphertextStore store;
     mutex graph_mutex;
-    mutex crypto_mutex;
     atomic<int> progress;
     size_t batch_size;
 
+    // Encrypted embeddings live in the mapped store once persist_embeddings()
+    // or open_embeddings() has run; graph holds the ones encrypted since
+    // (all of them before the first persist). Index i covers the store first.
+    size_t stored_count() const {
+        return store.is_open() ? store.size() : 0;
+    }
+
+    size_t embedding_count() const {
+        return stored_count() + graph.size();
+    }
+
+    int embedding_id(size_t i) const {
+        return i < stored_count() ? static_cast<int>(store.entry(i).node_id) : graph[i - stored_count()].id;
+    }
+
+    size_t embedding_bytes(size_t i) const {
+        return i < stored_count() ? store.entry(i).size : graph[i - stored_count()].encrypted_embedding.size();
+    }
+
+    void load_embedding(size_t i, Ciphertext& destination) const {
+        if (i < stored_count()) {
+            store.load(i, *context, destination);
+        } else {
+            graph[i - stored_count()].encrypted_embedding.load(*context, destination);
+        }
+    }
+
+    // Safe to call from several threads: the encoder and encryptor are shared
+    // read-only and each caller brings its own plaintext
+    void encrypt_embedding(GraphNode& node, Plaintext& plain_embedding) {
+        encoder->encode(node.embedding, storage_parms_id, scale, plain_embedding);
+        node.encrypted_embedding = CompressedCiphertext::from(encryptor->encrypt_symmetric(plain_embedding));
+    }
+
+    // Keys for the score matrix's rotations (and the top-k sums); the steps
+    // depend on the embedding dimension only
+    void create_score_keys() {
+        auto steps = score_matrix.rotation_steps();
+        if (comparison_levels > 0) {
+            for (int step : EncryptedTopK::sum_steps(encoder->slot_count())) {
+                if (find(steps.begin(), steps.end(), step) == steps.end()) steps.push_back(step);
+            }
+        }
+        if (!steps.empty()) {
+            KeyGenerator keygen(*context, secret_key);
+            keygen.create_galois_keys(steps, score_galois_keys);
+        }
+    }
+
     // Thread-safe initialization of graph vectors
     void parallel_initialize_vectors(size_t start, size_t end) {
-        vector<Plaintext> plain_embeddings(end - start);
-        vector<Ciphertext> encrypted_embeddings(end - start);
+        Plaintext plain_embedding;
 
         // Process embeddings in parallel
         for (size_t i = start; i < end; i++) {
-            encoder->encode(graph[i].embedding, scale, plain_embeddings[i - start]);
-            
-            // Cryptographic operations need to be serialized
-            {
-                lock_guard<mutex> lock(crypto_mutex);
-                encryptor->encrypt(plain_embeddings[i - start], encrypted_embeddings[i - start]);
+            // Nodes appended by add_node are already encrypted
+            if (graph[i].encrypted_embedding.bytes.empty()) {
+                encrypt_embedding(graph[i], plain_embedding);
             }
-
-            graph[i].encrypted_embedding = encrypted_embeddings[i - start];
             progress.fetch_add(1, memory_order_relaxed);
         }
     }
 
 public:
-    ParallelGraphRetriever(size_t poly_modulus_degree = 8192, double scale = pow(2.0, 40))
-        : poly_modulus_degree(poly_modulus_degree), scale(scale) {
-        // Initialize SEAL context
+    // One data prime is consumed by the score rescale; comparison_levels
+    // more below it leave room for retrieve_top_k_encrypted (see
+    // EncryptedTopK::levels_required)
+    ParallelGraphRetriever(size_t poly_modulus_degree = 8192, double scale = pow(2.0, 40),
+                           size_t comparison_levels = 0)
+        : comparison_levels(comparison_levels), poly_modulus_degree(poly_modulus_degree), scale(scale) {
+        // Initialize SEAL context: data primes of the scale's size, outer
+        // primes 20 bits wider ({ 60, 40, 60 } for the default scale)
+        int scale_bits = static_cast<int>(round(log2(scale)));
+        vector<int> prime_bits(1, scale_bits + 20);
+        prime_bits.insert(prime_bits.end(), 1 + comparison_levels, scale_bits);
+        prime_bits.push_back(scale_bits + 20);
         EncryptionParameters parms(scheme_type::ckks);
         parms.set_poly_modulus_degree(poly_modulus_degree);
-        parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, { 60, 40, 40, 60 }));
+        parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, prime_bits));
         
         context = make_shared<SEALContext>(parms);
         encoder = make_unique<CKKSEncoder>(*context);
@@ -74,19 +766,67 @@ public:
         KeyGenerator keygen(*context);
         secret_key = keygen.secret_key();
         keygen.create_public_key(public_key);
-        keygen.create_relin_keys(relin_keys);
+        if (comparison_levels > 0) keygen.create_relin_keys(relin_keys);
         
-        encryptor = make_unique<Encryptor>(*context, public_key);
+        encryptor = make_unique<Encryptor>(*context, public_key, secret_key);
         evaluator = make_unique<Evaluator>(*context);
         decryptor = make_unique<Decryptor>(*context, secret_key);
+        storage_parms_id = context->first_parms_id();
 
         batch_size = 100; // Default batch size
     }
 
-    // Load graph with embeddings
-    void load_graph(const vector<GraphNode>& nodes) {
-        graph = nodes;
+    // Load graph with embeddings; pass an rvalue to avoid copying the nodes.
+    // The similarity database is packed once here, before the plaintext
+    // embeddings can be released by persist_embeddings().
+    void load_graph(vector<GraphNode> nodes) {
+        graph = move(nodes);
         progress.store(0, memory_order_relaxed);
+
+        score_matrix.pack(graph, *encoder, storage_parms_id, scale);
+        create_score_keys();
+    }
+
+    // Appends one node without touching the rest of the graph: encrypts
+    // only its embedding and inserts its row into the packed score matrix in
+    // place. After persist_embeddings() the node stays in memory until the
+    // next persist. Not to be called while queries are running.
+    void add_node(GraphNode node) {
+        bool first = score_matrix.node_count() == 0;
+        Plaintext plain_embedding;
+        encrypt_embedding(node, plain_embedding);
+        score_matrix.insert(node, *context, *encoder, storage_parms_id, scale);
+        if (first) create_score_keys();
+
+        lock_guard<mutex> lock(graph_mutex);
+        graph.push_back(move(node));
+    }
+
+    // Write the encrypted embeddings (those already stored plus any added
+    // since) to an on-disk store keyed by node id, release the in-memory
+    // graph and serve later lookups from the mapping. The new store is
+    // written beside the old one, which stays mapped until the rename.
+    void persist_embeddings(const string& path) {
+        string staging = path + ".tmp";
+        MappedCiphertextStore::Writer writer(staging);
+        for (size_t i = 0; i < stored_count(); i++) {
+            writer.append(store.entry(i).node_id, 0, store.data(i), store.entry(i).size);
+        }
+        for (const auto& node : graph) {
+            writer.append(node.id, 0, node.encrypted_embedding.bytes);
+        }
+        writer.finish();
+        store.close();
+        if (rename(staging.c_str(), path.c_str()) != 0) {
+            throw runtime_error("Cannot replace ciphertext store: " + path);
+        }
+        vector<GraphNode>().swap(graph);
+        open_embeddings(path);
+    }
+
+    // Serve lookups from an existing store; opening costs one mmap
+    void open_embeddings(const string& path) {
+        store.open(path);
     }
 
     // Parallel initialization of graph vectors
@@ -118,55 +858,82 @@ public:
         cout << "Initialization completed in " << duration.count() << " ms" << endl;
     }
 
-    // Retrieve similar nodes with proper similarity comparison
-    vector<int> retrieve_similar_nodes(const vector<double>& query_embedding) {
-        // Encrypt the query
+    // Encrypts the query and scores all nodes, slot_count per ciphertext
+    void score_query(const vector<double>& query_embedding, vector<Ciphertext>& encrypted_scores) {
         Plaintext plain_query;
         Ciphertext encrypted_query;
-        {
-            lock_guard<mutex> lock(crypto_mutex);
-            encoder->encode(query_embedding, scale, plain_query);
-            encryptor->encrypt(plain_query, encrypted_query);
-        }
+        score_matrix.encode_query(query_embedding, *encoder, storage_parms_id, scale, plain_query);
+        encryptor->encrypt(plain_query, encrypted_query);
+        score_matrix.score(encrypted_query, *evaluator,
+                           [this](int) { return &score_galois_keys; }, encrypted_scores);
+    }
 
-        // Compute similarities with all nodes
-        vector<pair<double, int>> similarities(graph.size());
-        
-        #pragma omp parallel for
-        for (size_t i = 0; i < graph.size(); i++) {
-            Ciphertext sim;
-            Plaintext plain_sim;
-            vector<double> decoded_sim;
-            
-            {
-                lock_guard<mutex> lock(crypto_mutex);
-                evaluator->multiply(encrypted_query, graph[i].encrypted_embedding, sim);
-                evaluator->relinearize_inplace(sim, relin_keys);
-                evaluator->rescale_to_next_inplace(sim);
-                decryptor->decrypt(sim, plain_sim);
-                encoder->decode(plain_sim, decoded_sim);
+    // Retrieve similar nodes with proper similarity comparison. One
+    // encrypted query x packed database product scores every node; SEAL's
+    // encoder, encryptor, evaluator and decryptor are safe to share between
+    // the threads of batch_retrieve, so no lock is taken.
+    vector<int> retrieve_similar_nodes(const vector<double>& query_embedding) {
+        vector<Ciphertext> encrypted_scores;
+        score_query(query_embedding, encrypted_scores);
+
+        size_t slots = encoder->slot_count();
+        vector<pair<double, int>> similarities;
+        similarities.reserve(score_matrix.node_count());
+        Plaintext plain_scores;
+        vector<double> decoded_scores;
+        for (size_t g = 0; g < encrypted_scores.size(); g++) {
+            size_t first = g * slots;
+            size_t count = min(slots, score_matrix.node_count() - first);
+            if (encrypted_scores[g].size() == 0) {
+                decoded_scores.assign(count, 0.0);
+            } else {
+                decryptor->decrypt(encrypted_scores[g], plain_scores);
+                encoder->decode(plain_scores, decoded_scores);
+            }
+            for (size_t n = 0; n < count; n++) {
+                similarities.emplace_back(decoded_scores[n], score_matrix.node_id(first + n));
             }
-            
-            // Calculate similarity score (cosine similarity approximation)
-            double score = 0.0;
-            for (double val : decoded_sim) score += val * val;
-            similarities[i] = {score, graph[i].id};
         }
 
-        // Sort by similarity (descending order)
-        sort(similarities.begin(), similarities.end(), 
+        // Top 10 most similar nodes, best first
+        size_t k = min(static_cast<size_t>(10), similarities.size());
+        partial_sort(similarities.begin(), similarities.begin() + k, similarities.end(),
             [](const pair<double, int>& a, const pair<double, int>& b) {
                 return a.first > b.first;
             });
 
-        // Return top 10 most similar nodes
         vector<int> results;
-        for (size_t i = 0; i < min(static_cast<size_t>(10), similarities.size()); i++) {
+        for (size_t i = 0; i < k; i++) {
             results.push_back(similarities[i].second);
         }
         return results;
     }
 
+    // Top-k without showing the key holder any score: per bisection round
+    // only one encrypted count is decrypted, then the final indicators.
+    // The retriever needs EncryptedTopK::levels_required(options)
+    // comparison levels.
+    vector<int> retrieve_top_k_encrypted(const vector<double>& query_embedding, size_t k,
+                                         const TopKOptions& options = TopKOptions()) {
+        if (comparison_levels < EncryptedTopK::levels_required(options)) {
+            throw invalid_argument("retrieve_top_k_encrypted: retriever has too few comparison levels");
+        }
+        vector<Ciphertext> encrypted_scores;
+        score_query(query_embedding, encrypted_scores);
+
+        EncryptedTopK selector(*context, *encoder, *evaluator, relin_keys, score_galois_keys, options);
+        size_t valid = score_matrix.node_count();
+        auto selection = selector.select(encrypted_scores, valid, k, *decryptor);
+        cout << "Encrypted top-" << k << ": threshold " << selection.threshold
+             << " after " << selection.rounds << " rounds" << endl;
+
+        vector<int> results;
+        for (size_t slot : selector.top_slots(selection, valid, k, *decryptor)) {
+            results.push_back(score_matrix.node_id(slot));
+        }
+        return results;
+    }
+
     // Optimized batch retrieval
     vector<vector<int>> batch_retrieve(const vector<vector<double>>& queries) {
         vector<vector<int>> results(queries.size());
@@ -192,12 +959,142 @@ public:
         return results;
     }
 
+    // Bytes per stored embedding against a full top-level ciphertext, and load speed
+    void report_storage() {
+        size_t count = embedding_count();
+        if (count == 0) return;
+
+        size_t stored_bytes = 0;
+        for (size_t i = 0; i < count; i++) stored_bytes += embedding_bytes(i);
+        double per_node = static_cast<double>(stored_bytes) / count;
+
+        Ciphertext full;
+        encryptor->encrypt_zero(full);
+        double full_bytes = static_cast<double>(full.save_size(compr_mode_type::none));
+
+        Ciphertext loaded;
+        auto start = chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < count; i++) {
+            load_embedding(i, loaded);
+        }
+        auto end = chrono::high_resolution_clock::now();
+        double ms = chrono::duration<double, milli>(end - start).count();
+
+        cout << "Stored embedding: " << per_node / 1024 << " KiB (full ciphertext "
+             << full_bytes / 1024 << " KiB, " << full_bytes / per_node << "x smaller)" << endl;
+        cout << "Loaded " << count << " embeddings in " << ms << " ms ("
+             << ms * 1000.0 / count << " us each)" << endl;
+    }
+
     // Set batch size for parallel processing
     void set_batch_size(size_t size) {
         batch_size = size;
     }
 };
 
+// Recall and cost of the encrypted top-10 against the exact top-10 for
+// 4k-64k candidates at each comparison depth that fits N = 16384
+void benchmark_encrypted_top_k() {
+    const size_t k = 10;
+    const size_t max_levels = 9;
+    const vector<TopKOptions> configs = {{0, 2}, {1, 1}, {2, 1}, {1, 2}};
+    double scale = pow(2.0, 30);
+
+    vector<int> prime_bits(1, 50);
+    prime_bits.insert(prime_bits.end(), max_levels + 1, 30);
+    prime_bits.push_back(50);
+    EncryptionParameters parms(scheme_type::ckks);
+    parms.set_poly_modulus_degree(16384);
+    parms.set_coeff_modulus(CoeffModulus::Create(16384, prime_bits));
+    SEALContext context(parms);
+
+    KeyGenerator keygen(context);
+    PublicKey public_key;
+    RelinKeys relin_keys;
+    GaloisKeys galois_keys;
+    keygen.create_public_key(public_key);
+    keygen.create_relin_keys(relin_keys);
+    CKKSEncoder encoder(context);
+    keygen.create_galois_keys(EncryptedTopK::sum_steps(encoder.slot_count()), galois_keys);
+    Encryptor encryptor(context, public_key);
+    Evaluator evaluator(context);
+    Decryptor decryptor(context, keygen.secret_key());
+    size_t slots = encoder.slot_count();
+
+    mt19937 gen(11);
+    normal_distribution<double> normal(0.0, 0.3);
+    cout << "\nEncrypted top-" << k << " benchmark (N = 16384)\n";
+    cout << "candidates  levels  (dg,df)  rounds  time_ms  recall" << endl;
+    for (size_t n : {4096, 16384, 65536}) {
+        vector<double> scores(n);
+        for (auto& score : scores) score = max(-1.0, min(1.0, normal(gen)));
+
+        vector<size_t> order(n);
+        for (size_t i = 0; i < n; i++) order[i] = i;
+        partial_sort(order.begin(), order.begin() + k, order.end(),
+                     [&](size_t a, size_t b) { return scores[a] > scores[b]; });
+
+        vector<Ciphertext> encrypted_scores((n + slots - 1) / slots);
+        Plaintext plain;
+        for (size_t g = 0; g < encrypted_scores.size(); g++) {
+            vector<double> chunk(slots, 0.0);
+            copy(scores.begin() + g * slots, scores.begin() + min(n, (g + 1) * slots), chunk.begin());
+            encoder.encode(chunk, scale, plain);
+            encryptor.encrypt(plain, encrypted_scores[g]);
+        }
+
+        for (const auto& options : configs) {
+            EncryptedTopK selector(context, encoder, evaluator, relin_keys, galois_keys, options);
+            auto start = chrono::high_resolution_clock::now();
+            auto selection = selector.select(encrypted_scores, n, k, decryptor);
+            auto top = selector.top_slots(selection, n, k, decryptor);
+            auto end = chrono::high_resolution_clock::now();
+
+            size_t hits = 0;
+            for (size_t slot : top) {
+                if (find(order.begin(), order.begin() + k, slot) != order.begin() + k) hits++;
+            }
+            cout << n << "  " << EncryptedTopK::levels_required(options)
+                 << "  (" << options.g_stages << "," << options.f_stages << ")  " << selection.rounds
+                 << "  " << chrono::duration<double, milli>(end - start).count()
+                 << "  " << static_cast<double>(hits) / k << endl;
+        }
+    }
+}
+
+// Per-insert cost of add_node at growing graph sizes; it should stay flat
+// since an insert encrypts one embedding and touches one group's diagonals
+void benchmark_ingest() {
+    const size_t dim = 64;
+    const size_t inserts = 200;
+    mt19937 gen(5);
+    normal_distribution<double> normal(0.0, 1.0);
+    auto random_node = [&](int id) {
+        GraphNode node;
+        node.id = id;
+        node.embedding.resize(dim);
+        for (auto& value : node.embedding) value = normal(gen);
+        return node;
+    };
+
+    cout << "\nIngest benchmark (dim " << dim << ")\n";
+    cout << "graph_size  us_per_insert  inserts_per_s" << endl;
+    for (size_t n : {1000, 8000, 64000}) {
+        vector<GraphNode> nodes;
+        for (size_t i = 0; i < n; i++) nodes.push_back(random_node(static_cast<int>(i)));
+        ParallelGraphRetriever retriever;
+        retriever.load_graph(move(nodes));
+
+        auto start = chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < inserts; i++) {
+            retriever.add_node(random_node(static_cast<int>(n + i)));
+        }
+        auto end = chrono::high_resolution_clock::now();
+        double us = chrono::duration<double, micro>(end - start).count() / inserts;
+        cout << n << "  " << us << "  " << 1e6 / us << endl;
+    }
+}
+
 // Example usage
 int main() {
     // Example graph creation - simple linear graph with meaningful embeddings
@@ -222,6 +1119,12 @@ int main() {
     ParallelGraphRetriever retriever;
     retriever.load_graph(graph_nodes);
     retriever.initialize_encrypted_embeddings(); // Parallel initialization
+    retriever.report_storage();
+
+    // Move the per-node ciphertexts to disk. Similarity queries are scored
+    // through the packed score matrix and do not read the store.
+    retriever.persist_embeddings("graph_embeddings.ctstore");
+    retriever.report_storage();
 
     // Example query - looking for nodes with middle-range features
     vector<double> query = {0.5, 1.0, 0.5}; // Max sine value at 0.5 position
@@ -258,5 +1161,31 @@ int main() {
     }
     cout << endl;
 
+    // Same query through the encrypted top-k: the key holder sees counts
+    // and the final indicators, never a similarity score
+    TopKOptions top_k_options;
+    ParallelGraphRetriever secure_retriever(16384, pow(2.0, 30), EncryptedTopK::levels_required(top_k_options));
+    secure_retriever.load_graph(graph_nodes);
+    auto secure_results = secure_retriever.retrieve_top_k_encrypted(query, 10, top_k_options);
+    cout << "Encrypted top-k nodes for query {0.5, 1.0, 0.5}: ";
+    for (int node_id : secure_results) {
+        cout << node_id << " ";
+    }
+    cout << endl;
+
+    // Nodes appended after persisting are queryable right away
+    GraphNode fresh;
+    fresh.id = static_cast<int>(graph_size);
+    fresh.embedding = query;
+    retriever.add_node(move(fresh));
+    cout << "After inserting node " << graph_size << ": ";
+    for (int node_id : retriever.retrieve_similar_nodes(query)) {
+        cout << node_id << " ";
+    }
+    cout << endl;
+
+    benchmark_encrypted_top_k();
+    benchmark_ingest();
+
     return 0;
 }
\ No newline at end of file
@@ -30,7 +30,6 @@ public:
         secret_key_ = keygen.secret_key();
         keygen.create_public_key(public_key_);
         keygen.create_relin_keys(relin_keys_);
-        keygen.create_galois_keys(galois_keys_);
         
         // Create evaluator and encoder
         evaluator_ = make_shared<Evaluator>(*context_);
@@ -52,7 +51,6 @@ private:
     SecretKey secret_key_;
     PublicKey public_key_;
     RelinKeys relin_keys_;
-    GaloisKeys galois_keys_;
     shared_ptr<Evaluator> evaluator_;
     shared_ptr<CKKSEncoder> encoder_;
     shared_ptr<Encryptor> encryptor_;
@@ -6,34 +6,152 @@
 #include <chrono>
 #include <numeric>
 #include <random>
+#include <fstream>
+#include <string>
+#include <map>
+#include <algorithm>
 #include <seal/seal.h>
 
 using namespace std;
 using namespace seal;
 
-// Memory tracker for large graph operations
+// Memory instrumentation: SEAL global pool usage, process RSS and peak RSS
+// from /proc/self/status, exact footprints of SEAL objects, and per-phase
+// high-water marks (the kernel's peak RSS counter is reset at each phase start).
 class MemoryTracker {
-private:
-    size_t total_memory = 0;
-    mutex memory_mutex;
-
 public:
-    void add_memory(size_t bytes) {
+    struct Snapshot {
+        size_t seal_pool_bytes = 0;
+        size_t rss_bytes = 0;
+        size_t peak_rss_bytes = 0;
+    };
+
+    struct PhaseRecord {
+        string name;
+        Snapshot start;
+        Snapshot end;
+        bool finished = false; // Set by end_phase
+    };
+
+    static Snapshot snapshot() {
+        Snapshot s;
+        s.seal_pool_bytes = MemoryManager::GetPool().alloc_byte_count();
+        s.rss_bytes = read_status_kb("VmRSS:") * 1024;
+        s.peak_rss_bytes = read_status_kb("VmHWM:") * 1024;
+        return s;
+    }
+
+    // Bytes held by the object's coefficient data (allocated capacity)
+    static size_t footprint(const Ciphertext& ct) {
+        return ct.size_capacity() * ct.poly_modulus_degree() * ct.coeff_modulus_size() * sizeof(uint64_t);
+    }
+
+    static size_t footprint(const Plaintext& pt) {
+        return pt.capacity() * sizeof(uint64_t);
+    }
+
+    static size_t footprint(const PublicKey& key) {
+        return footprint(key.data());
+    }
+
+    static size_t footprint(const SecretKey& key) {
+        return footprint(key.data());
+    }
+
+    static size_t footprint(const KSwitchKeys& keys) {
+        size_t bytes = 0;
+        for (const auto& key_set : keys.data()) {
+            for (const auto& key : key_set) {
+                bytes += footprint(key);
+            }
+        }
+        return bytes;
+    }
+
+    template <class T>
+    static size_t footprint(const vector<T>& objects) {
+        size_t bytes = 0;
+        for (const auto& object : objects) {
+            bytes += footprint(object);
+        }
+        return bytes;
+    }
+
+    void add_footprint(const string& label, size_t bytes) {
         lock_guard<mutex> lock(memory_mutex);
-        total_memory += bytes;
+        footprints[label] += bytes;
     }
 
-    void free_memory(size_t bytes) {
+    void remove_footprint(const string& label, size_t bytes) {
         lock_guard<mutex> lock(memory_mutex);
-        total_memory -= bytes;
+        auto& entry = footprints[label];
+        entry -= min(entry, bytes);
     }
 
-    size_t get_total_memory() const {
-        return total_memory;
+    void begin_phase(const string& name) {
+        reset_peak_rss();
+        lock_guard<mutex> lock(memory_mutex);
+        phases.push_back({name, snapshot(), Snapshot(), false});
     }
 
-    void print_memory_usage() const {
-        cout << "Current memory usage: " << (total_memory / (1024 * 1024)) << " MB" << endl;
+    void end_phase() {
+        lock_guard<mutex> lock(memory_mutex);
+        if (!phases.empty()) {
+            phases.back().end = snapshot();
+            phases.back().finished = true;
+        }
+    }
+
+    void print_report() const {
+        lock_guard<mutex> lock(memory_mutex);
+        auto mb = [](size_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); };
+        Snapshot now = snapshot();
+        cout << "Memory: RSS " << mb(now.rss_bytes) << " MB, SEAL pool "
+             << mb(now.seal_pool_bytes) << " MB" << endl;
+        for (const auto& entry : footprints) {
+            cout << "  " << entry.first << ": " << mb(entry.second) << " MB" << endl;
+        }
+        for (const auto& phase : phases) {
+            if (!phase.finished) continue;
+            // The pool can shrink within a phase, so the change is signed
+            int64_t pool_delta = static_cast<int64_t>(phase.end.seal_pool_bytes)
+                               - static_cast<int64_t>(phase.start.seal_pool_bytes);
+            cout << "  phase " << phase.name << ": peak RSS " << mb(phase.end.peak_rss_bytes)
+                 << " MB, SEAL pool " << showpos << pool_delta / (1024.0 * 1024.0) << noshowpos
+                 << " MB" << endl;
+        }
+    }
+
+    static void print_memory_stats(const string& label = "") {
+        Snapshot s = snapshot();
+        cout << label << " - RSS " << s.rss_bytes / 1024 << " KB, peak "
+             << s.peak_rss_bytes / 1024 << " KB, SEAL pool "
+             << s.seal_pool_bytes / 1024 << " KB" << endl;
+    }
+
+private:
+    mutable mutex memory_mutex;
+    map<string, size_t> footprints;
+    vector<PhaseRecord> phases;
+
+    // Returns 0 where /proc is unavailable
+    static size_t read_status_kb(const string& key) {
+        ifstream status("/proc/self/status");
+        string line;
+        while (getline(status, line)) {
+            if (line.compare(0, key.size(), key) == 0) {
+                return stoul(line.substr(key.size()));
+            }
+        }
+        return 0;
+    }
+
+    // Writing 5 to clear_refs resets VmHWM to the current RSS (Linux >= 4.0)
+    static void reset_peak_rss() {
+        ofstream clear_refs("/proc/self/clear_refs");
+        if (clear_refs) {
+            clear_refs << "5";
+        }
     }
 };
 
@@ -74,7 +192,7 @@ public:
         }
 
         // Track memory
-        memory_tracker.add_memory(size * sizeof(double));
+        memory_tracker.add_footprint("embeddings", vec.capacity() * sizeof(double));
         return vec;
     }
 };
@@ -90,7 +208,6 @@ private:
     PublicKey public_key;
     SecretKey secret_key;
     RelinKeys relin_keys;
-    GaloisKeys galois_keys;
     MemoryTracker& memory_tracker;
 
     // Modulus switching parameters
@@ -121,7 +238,6 @@ public:
         secret_key = keygen.secret_key();
         keygen.create_public_key(public_key);
         keygen.create_relin_keys(relin_keys);
-        keygen.create_galois_keys(galois_keys);
         
         // Initialize crypto components
         encoder = make_unique<CKKSEncoder>(*context);
@@ -130,13 +246,16 @@ public:
         decryptor = make_unique<Decryptor>(*context, secret_key);
         
         // Track memory usage
-        size_t key_memory = poly_modulus_degree * coeff_modulus.size() * sizeof(uint64_t) * 4;
-        memory_tracker.add_memory(key_memory);
+        memory_tracker.add_footprint("keys", key_footprint());
     }
 
     ~CKKSDotProduct() {
-        size_t key_memory = poly_modulus_degree * coeff_modulus.size() * sizeof(uint64_t) * 4;
-        memory_tracker.free_memory(key_memory);
+        memory_tracker.remove_footprint("keys", key_footprint());
+    }
+
+    size_t key_footprint() const {
+        return MemoryTracker::footprint(public_key) + MemoryTracker::footprint(secret_key)
+             + MemoryTracker::footprint(relin_keys);
     }
 
     // Batch encode graph embeddings into polynomials
@@ -150,8 +269,7 @@ public:
         }
         
         // Track memory
-        size_t mem_used = embeddings.size() * poly_modulus_degree * coeff_modulus.size() * sizeof(uint64_t);
-        memory_tracker.add_memory(mem_used);
+        memory_tracker.add_footprint("plaintexts", MemoryTracker::footprint(plaintexts));
         
         return plaintexts;
     }
@@ -165,8 +283,7 @@ public:
         }
         
         // Track memory
-        size_t mem_used = plaintexts.size() * 2 * poly_modulus_degree * coeff_modulus.size() * sizeof(uint64_t);
-        memory_tracker.add_memory(mem_used);
+        memory_tracker.add_footprint("ciphertexts", MemoryTracker::footprint(ciphertexts));
         
         return ciphertexts;
     }
@@ -231,33 +348,41 @@ int main() {
         size_t num_embeddings = 5;   // Fewer embeddings for demo
         
         cout << "Initializing graph embeddings..." << endl;
+        memory_tracker.begin_phase("init");
         vector<vector<double>> embeddings(num_embeddings);
         for (auto& emb : embeddings) {
             emb = vector_initializer.initialize_random_vector(embedding_size, -0.5, 0.5); // Smaller range
         }
-        memory_tracker.print_memory_usage();
+        memory_tracker.end_phase();
+        memory_tracker.print_report();
         
         // Set up CKKS environment
         cout << "Setting up CKKS environment..." << endl;
+        memory_tracker.begin_phase("keygen");
         CKKSDotProduct ckks_processor(memory_tracker, 8192, 30); // Explicit parameters
-        memory_tracker.print_memory_usage();
+        memory_tracker.end_phase();
+        memory_tracker.print_report();
         
         // Batch encode and encrypt embeddings
         cout << "Encoding and encrypting embeddings..." << endl;
+        memory_tracker.begin_phase("encode+encrypt");
         auto plaintexts = ckks_processor.batch_encode_embeddings(embeddings);
         auto ciphertexts = ckks_processor.batch_encrypt(plaintexts);
-        memory_tracker.print_memory_usage();
+        memory_tracker.end_phase();
+        memory_tracker.print_report();
         
         // Perform secure dot product between first two embeddings
         cout << "Computing secure dot product..." << endl;
+        memory_tracker.begin_phase("dot product");
         auto start_time = chrono::high_resolution_clock::now();
         
         Ciphertext dot_product = ckks_processor.secure_dot_product(ciphertexts[0], ciphertexts[1]);
         
         auto end_time = chrono::high_resolution_clock::now();
         auto duration = chrono::duration_cast<chrono::milliseconds>(end_time - start_time);
+        memory_tracker.end_phase();
         cout << "Dot product computation took " << duration.count() << " ms" << endl;
-        memory_tracker.print_memory_usage();
+        memory_tracker.print_report();
         
         // Extract and verify the result
         cout << "Extracting results..." << endl;
@@ -4,7 +4,27 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <mutex>
+#include <thread>
+#include <atomic>
+#include <exception>
 #include <memory>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sstream>
+#include <list>
+#include <map>
+#include <random>
+#include <cmath>
+#include <cstdlib>
 #include <seal/seal.h>
 
 using namespace std;
@@ -37,11 +57,277 @@ public:
     }
 };
 
+// Best g-score, parent and queued f-score per node of one search, sharded by
+// node id so that workers relaxing different nodes rarely contend
+class ConcurrentSearchState {
+private:
+    struct Entry {
+        double g;
+        double f;
+        int parent;
+    };
+    struct Shard {
+        mutex mtx;
+        unordered_map<int, Entry> entries;
+    };
+    vector<Shard> shards;
+
+    Shard& shard_of(int node) {
+        return shards[static_cast<size_t>(node) % shards.size()];
+    }
+
+public:
+    explicit ConcurrentSearchState(size_t shard_count = 64) : shards(shard_count) {}
+
+    // Records (g, f, parent) if g improves on the node's best score so far
+    bool relax(int node, double g, double f, int parent) {
+        Shard& shard = shard_of(node);
+        lock_guard<mutex> lock(shard.mtx);
+        auto it = shard.entries.find(node);
+        if (it != shard.entries.end() && it->second.g <= g) return false;
+        shard.entries[node] = {g, f, parent};
+        return true;
+    }
+
+    bool lookup(int node, double& g, double& f, int& parent) {
+        Shard& shard = shard_of(node);
+        lock_guard<mutex> lock(shard.mtx);
+        auto it = shard.entries.find(node);
+        if (it == shard.entries.end()) return false;
+        g = it->second.g;
+        f = it->second.f;
+        parent = it->second.parent;
+        return true;
+    }
+};
+
+// Runs body(i) for every i in [0, count) on up to `threads` threads, the
+// caller being one of them, and rethrows the first exception raised
+template<typename Body>
+void parallel_for(size_t count, size_t threads, Body body) {
+    threads = min(threads, count);
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; i++) body(i);
+        return;
+    }
+
+    atomic<size_t> next{0};
+    exception_ptr error;
+    mutex error_mtx;
+    auto work = [&]() {
+        for (size_t i; (i = next++) < count;) {
+            try {
+                body(i);
+            } catch (...) {
+                lock_guard<mutex> lock(error_mtx);
+                if (!error) error = current_exception();
+                next = count;
+            }
+        }
+    };
+
+    vector<thread> workers;
+    for (size_t t = 1; t < threads; t++) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    if (error) rethrow_exception(error);
+}
+
+// Stored form of an encrypted embedding. Fresh symmetric encryptions are
+// serialized seeded (c1 is re-expanded from a PRNG seed on load, halving the
+// payload), the bytes are zstd-compressed, and only the RNS limbs of the
+// ciphertext's own level are written, so storing below the top level drops
+// the unused primes.
+struct CompressedCiphertext {
+    vector<seal_byte> bytes;
+
+    // Accepts a Ciphertext or the Serializable<Ciphertext> of encrypt_symmetric
+    template<typename T>
+    static CompressedCiphertext from(const T& ciphertext) {
+        CompressedCiphertext stored;
+        stored.bytes.resize(static_cast<size_t>(ciphertext.save_size(compr_mode_type::zstd)));
+        auto written = ciphertext.save(stored.bytes.data(), stored.bytes.size(), compr_mode_type::zstd);
+        stored.bytes.resize(static_cast<size_t>(written));
+        stored.bytes.shrink_to_fit();
+        return stored;
+    }
+
+    void load(const SEALContext& context, Ciphertext& destination) const {
+        destination.load(context, bytes.data(), bytes.size());
+    }
+
+    size_t size() const { return bytes.size(); }
+};
+
+// Read-only, memory-mapped store of serialized ciphertexts. The file holds a
+// data column of concatenated ciphertext bytes followed by an index sorted by
+// (node id, chunk). Opening maps the file and reads only the header, so
+// startup does not depend on the graph size; lookups binary-search the mapped
+// index and deserialize straight out of the mapping, and the page cache
+// decides what stays resident.
+class MappedCiphertextStore {
+private:
+    struct Header {
+        char magic[8];
+        uint64_t entry_count;
+        uint64_t index_offset;
+    };
+
+public:
+    struct IndexEntry {
+        int64_t node_id;
+        uint64_t chunk;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    // Streams ciphertexts to disk; finish() sorts and appends the index
+    class Writer {
+    public:
+        explicit Writer(const string& path) : out(path, ios::binary | ios::trunc), offset(sizeof(Header)) {
+            if (!out) {
+                throw runtime_error("Cannot create ciphertext store: " + path);
+            }
+            Header header{};
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        }
+
+        void append(int64_t node_id, uint64_t chunk, const vector<seal_byte>& bytes) {
+            append(node_id, chunk, bytes.data(), bytes.size());
+        }
+
+        void append(int64_t node_id, uint64_t chunk, const seal_byte* bytes, size_t size) {
+            out.write(reinterpret_cast<const char*>(bytes), size);
+            entries.push_back({node_id, chunk, offset, size});
+            offset += size;
+        }
+
+        void finish() {
+            sort(entries.begin(), entries.end(), [](const IndexEntry& a, const IndexEntry& b) {
+                return a.node_id != b.node_id ? a.node_id < b.node_id : a.chunk < b.chunk;
+            });
+            // Keep the index 8-byte aligned so it can be read in place
+            static const char zeros[8] = {};
+            uint64_t padding = (8 - offset % 8) % 8;
+            out.write(zeros, padding);
+
+            Header header{{'C', 'T', 'S', 'T', 'O', 'R', 'E', '1'}, entries.size(), offset + padding};
+            out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(IndexEntry));
+            out.seekp(0);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.close();
+            if (!out) {
+                throw runtime_error("Failed to write ciphertext store");
+            }
+        }
+
+    private:
+        ofstream out;
+        vector<IndexEntry> entries;
+        uint64_t offset;
+    };
+
+    MappedCiphertextStore() = default;
+    MappedCiphertextStore(const MappedCiphertextStore&) = delete;
+    MappedCiphertextStore& operator=(const MappedCiphertextStore&) = delete;
+
+    ~MappedCiphertextStore() {
+        close();
+    }
+
+    void open(const string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw runtime_error("Cannot open ciphertext store: " + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+            ::close(fd);
+            throw runtime_error("Invalid ciphertext store: " + path);
+        }
+        void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            throw runtime_error("Cannot map ciphertext store: " + path);
+        }
+        base = static_cast<const uint8_t*>(mapping);
+        length = static_cast<size_t>(st.st_size);
+
+        // Bounds are checked by subtracting from length, so corrupt counts or
+        // offsets cannot overflow past it; every entry is checked here so that
+        // load() and data() never read outside the mapping
+        Header header;
+        memcpy(&header, base, sizeof(header));
+        bool valid = memcmp(header.magic, "CTSTORE1", sizeof(header.magic)) == 0 &&
+                     header.index_offset <= length &&
+                     header.index_offset % alignof(IndexEntry) == 0 &&
+                     header.entry_count <= (length - header.index_offset) / sizeof(IndexEntry);
+        if (valid) {
+            index = reinterpret_cast<const IndexEntry*>(base + header.index_offset);
+            for (uint64_t i = 0; i < header.entry_count && valid; i++) {
+                valid = index[i].offset <= length && index[i].size <= length - index[i].offset;
+            }
+        }
+        if (!valid) {
+            close();
+            throw runtime_error("Corrupt ciphertext store: " + path);
+        }
+        entries = header.entry_count;
+        // Lookups are random, so read-ahead would only evict useful pages
+        madvise(mapping, length, MADV_RANDOM);
+    }
+
+    void close() {
+        if (base) {
+            munmap(const_cast<uint8_t*>(base), length);
+        }
+        base = nullptr;
+        length = 0;
+        index = nullptr;
+        entries = 0;
+    }
+
+    bool is_open() const { return base != nullptr; }
+    size_t size() const { return entries; }
+    const IndexEntry& entry(size_t i) const { return index[i]; }
+
+    // Index range [first, second) of the chunks stored for node_id
+    pair<size_t, size_t> find(int64_t node_id) const {
+        auto first = lower_bound(index, index + entries, node_id,
+            [](const IndexEntry& e, int64_t id) { return e.node_id < id; });
+        auto last = upper_bound(first, index + entries, node_id,
+            [](int64_t id, const IndexEntry& e) { return id < e.node_id; });
+        return {static_cast<size_t>(first - index), static_cast<size_t>(last - index)};
+    }
+
+    void load(size_t i, const SEALContext& context, Ciphertext& destination) const {
+        const IndexEntry& e = index[i];
+        destination.load(context, data(i), e.size);
+    }
+
+    // Serialized bytes of entry i, valid while the store is open
+    const seal_byte* data(size_t i) const {
+        return reinterpret_cast<const seal_byte*>(base + index[i].offset);
+    }
+
+private:
+    const uint8_t* base = nullptr;
+    size_t length = 0;
+    const IndexEntry* index = nullptr;
+    size_t entries = 0;
+};
+
 // Hierarchical graph node with encrypted embeddings
 struct EncryptedNode {
     int id;
     int level; // Hierarchy level
-    vector<Ciphertext> encrypted_embedding;
+    vector<CompressedCiphertext> encrypted_embedding; // Empty when served from the store
+    size_t switched_levels = 0; // Levels modulus_switch_path drops when chunks are loaded
     vector<pair<int, double>> neighbors; // (neighbor_id, edge_weight)
 };
 
@@ -50,6 +336,139 @@ struct GraphPartition {
     int partition_id;
     unordered_set<int> node_ids;
     vector<Ciphertext> centroid;
+    vector<Ciphertext> member_sum; // Encrypted sum of the members' chunks
+    double centroid_norm = 0.0;    // |centroid|^2, as decrypted by the key holder
+};
+
+// Galois keys paged per rotation step. A step's key is generated the first
+// time a rotation needs it (when the secret key is available), appended to a
+// keyed file (a private temp file unless a path is given), and held in a
+// bounded LRU; evicted steps are reloaded from the file. Nothing is
+// generated for rotations that never happen, and resident key memory is
+// proportional to the steps actually in use.
+class GaloisKeyPager {
+public:
+    // Key owner: keys go to a private file from mkstemp, removed on destruction
+    GaloisKeyPager(const SEALContext& context, const SecretKey& secret_key, size_t capacity = 4)
+        : GaloisKeyPager(context, secret_key, create_temp_file(), capacity) {
+        owns_file = true;
+    }
+
+    // Key owner: starts a fresh key file at a caller-chosen path, which is
+    // kept so evaluator-side pagers can serve it
+    GaloisKeyPager(const SEALContext& context, const SecretKey& secret_key,
+                   const string& path, size_t capacity = 4)
+        : context(context), keygen(make_unique<KeyGenerator>(context, secret_key)),
+          path(path), capacity(capacity) {
+        ofstream out(path, ios::binary | ios::trunc);
+        if (!out) {
+            throw runtime_error("Cannot create Galois key file: " + path);
+        }
+    }
+
+    ~GaloisKeyPager() {
+        if (owns_file) remove(path.c_str());
+    }
+
+    GaloisKeyPager(const GaloisKeyPager&) = delete;
+    GaloisKeyPager& operator=(const GaloisKeyPager&) = delete;
+
+    // Evaluator side: serves a key file written by a key owner, read-only
+    GaloisKeyPager(const SEALContext& context, const string& path, size_t capacity = 4)
+        : context(context), path(path), capacity(capacity) {
+        ifstream in(path, ios::binary);
+        if (!in) {
+            throw runtime_error("Cannot open Galois key file: " + path);
+        }
+        int32_t step;
+        uint64_t size;
+        while (in.read(reinterpret_cast<char*>(&step), sizeof(step)) &&
+               in.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+            offsets[step] = {static_cast<streamoff>(in.tellg()), size};
+            in.seekg(static_cast<streamoff>(size), ios::cur);
+        }
+    }
+
+    // Keys for one rotation step; the pointer stays valid after eviction
+    shared_ptr<const GaloisKeys> get(int step) {
+        lock_guard<mutex> lock(pager_mutex);
+        auto cached = cache.find(step);
+        if (cached != cache.end()) {
+            lru.splice(lru.begin(), lru, cached->second.second);
+            return cached->second.first;
+        }
+
+        if (!offsets.count(step)) {
+            if (!keygen) {
+                throw invalid_argument("No Galois key stored for step " + to_string(step));
+            }
+            append(step);
+        }
+
+        auto keys = make_shared<GaloisKeys>();
+        ifstream in(path, ios::binary);
+        in.seekg(offsets[step].first);
+        keys->load(context, in);
+        disk_loads++;
+
+        lru.push_front(step);
+        cache[step] = {keys, lru.begin()};
+        if (cache.size() > capacity) {
+            cache.erase(lru.back());
+            lru.pop_back();
+        }
+        return keys;
+    }
+
+    size_t resident_steps() const { return cache.size(); }
+    size_t stored_steps() const { return offsets.size(); }
+    size_t loads() const { return disk_loads; }
+
+private:
+    // Unique file under $TMPDIR (or /tmp), so concurrent pagers never share one
+    static string create_temp_file() {
+        const char* dir = getenv("TMPDIR");
+        string pattern = string(dir && *dir ? dir : "/tmp") + "/galois_keys.XXXXXX";
+        vector<char> name(pattern.begin(), pattern.end());
+        name.push_back('\0');
+        int fd = mkstemp(name.data());
+        if (fd < 0) {
+            throw runtime_error("Cannot create Galois key file: " + pattern);
+        }
+        ::close(fd);
+        return name.data();
+    }
+
+    // Record layout: int32 step, uint64 byte count, seeded GaloisKeys bytes
+    void append(int step) {
+        stringstream buffer;
+        keygen->create_galois_keys(vector<int>{step}).save(buffer);
+        string bytes = buffer.str();
+
+        ofstream out(path, ios::binary | ios::app);
+        out.seekp(0, ios::end);
+        int32_t key = step;
+        uint64_t size = bytes.size();
+        out.write(reinterpret_cast<const char*>(&key), sizeof(key));
+        out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        streamoff offset = out.tellp();
+        out.write(bytes.data(), bytes.size());
+        if (!out) {
+            throw runtime_error("Failed to write Galois key file: " + path);
+        }
+        offsets[step] = {offset, size};
+    }
+
+    const SEALContext& context;
+    unique_ptr<KeyGenerator> keygen;
+    string path;
+    bool owns_file = false;
+    size_t capacity;
+    map<int, pair<streamoff, uint64_t>> offsets;
+    list<int> lru;
+    unordered_map<int, pair<shared_ptr<const GaloisKeys>, list<int>::iterator>> cache;
+    size_t disk_loads = 0;
+    mutex pager_mutex;
 };
 
 class EncryptedGraphTraversal {
@@ -59,7 +478,7 @@ private:
     PublicKey public_key;
     SecretKey secret_key;
     RelinKeys relin_keys;
-    GaloisKeys galois_keys;
+    unique_ptr<GaloisKeyPager> galois_keys;
     unique_ptr<Encryptor> encryptor;
     unique_ptr<Evaluator> evaluator;
     unique_ptr<Decryptor> decryptor;
@@ -67,6 +486,7 @@ private:
 
     // Graph data
     unordered_map<int, EncryptedNode> nodes;
+    MappedCiphertextStore store;
     vector<GraphPartition> partitions;
     size_t chunk_size;
     double scale;
@@ -75,13 +495,87 @@ private:
     mutex progress_mtx;
     unordered_map<int, double> traversal_progress;
 
+    // Heuristics memoized per target: target id -> (node id -> h). A modulus
+    // switch leaves the encrypted values unchanged, so entries survive it;
+    // they are dropped when either node's embedding is replaced.
+    // Searches score neighbors on several threads, so the cache is guarded.
+    unordered_map<int, unordered_map<int, double>> heuristic_cache;
+    mutable mutex heuristic_mtx;
+    size_t embedding_span = 0; // Longest chunk written by add_node
+    atomic<size_t> heuristic_lookups{0};
+    atomic<size_t> heuristic_computed{0};
+    atomic<size_t> packed_products{0};
+    atomic<size_t> packed_decryptions{0};
+
+    // A node's chunks come from its in-memory copy when it has one (added
+    // since the last persist) and from the mapped store otherwise
+    size_t chunk_count(const EncryptedNode& node) const {
+        if (!node.encrypted_embedding.empty() || !store.is_open()) {
+            return node.encrypted_embedding.size();
+        }
+        auto range = store.find(node.id);
+        return range.second - range.first;
+    }
+
+    void load_chunk(const EncryptedNode& node, size_t chunk, Ciphertext& destination) const {
+        if (!node.encrypted_embedding.empty()) {
+            node.encrypted_embedding[chunk].load(*context, destination);
+        } else {
+            store.load(store.find(node.id).first + chunk, *context, destination);
+        }
+        for (size_t i = 0; i < node.switched_levels; i++) {
+            evaluator->mod_switch_to_next_inplace(destination);
+        }
+    }
+
+    void load_chunks(const EncryptedNode& node, vector<Ciphertext>& destination) const {
+        destination.resize(chunk_count(node));
+        for (size_t i = 0; i < destination.size(); i++) {
+            load_chunk(node, i, destination[i]);
+        }
+    }
+
+    vector<pair<double, int>> rank_candidates(const vector<Ciphertext>& query,
+                                              const vector<int>& candidates, size_t k) {
+        vector<double> scores = packed_dot_products(candidates.size(), [&](size_t j, vector<Ciphertext>& chunks) {
+            load_chunks(nodes.at(candidates[j]), chunks);
+        }, query);
+        vector<pair<double, int>> ranked;
+        for (size_t j = 0; j < candidates.size(); j++) {
+            ranked.emplace_back(scores[j], candidates[j]);
+        }
+        k = min(k, ranked.size());
+        partial_sort(ranked.begin(), ranked.begin() + k, ranked.end(), greater<pair<double, int>>());
+        ranked.resize(k);
+        return ranked;
+    }
+
+    size_t chunk_bytes(const EncryptedNode& node, size_t chunk) const {
+        if (!node.encrypted_embedding.empty()) {
+            return node.encrypted_embedding[chunk].size();
+        }
+        return store.entry(store.find(node.id).first + chunk).size;
+    }
+
+    void forget_heuristics(int id) {
+        lock_guard<mutex> lock(heuristic_mtx);
+        heuristic_cache.erase(id);
+        for (auto& entry : heuristic_cache) {
+            entry.second.erase(id);
+        }
+    }
+
 public:
     EncryptedGraphTraversal(size_t poly_modulus_degree, size_t chunk_size = 4096)
         : chunk_size(chunk_size), scale(pow(2.0, 40)) {
         // Initialize SEAL context with CKKS
         EncryptionParameters params(scheme_type::ckks);
         params.set_poly_modulus_degree(poly_modulus_degree);
-        params.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, {60, 40, 40, 60}));
+        // Three data primes: a chunk switched once by modulus_switch_path still
+        // has the two levels a partition mean and its dot products consume.
+        // The special prime is the largest, as key switching needs, and the
+        // chain uses the full 218-bit budget of N = 8192.
+        params.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, {48, 40, 40, 40, 50}));
         
         context = make_shared<SEALContext>(params);
         
@@ -90,10 +584,10 @@ public:
         secret_key = keygen.secret_key();
         keygen.create_public_key(public_key);
         keygen.create_relin_keys(relin_keys);
-        keygen.create_galois_keys(galois_keys);
+        galois_keys = make_unique<GaloisKeyPager>(*context, secret_key, 16);
         
         // Initialize crypto components using unique_ptr
-        encryptor = make_unique<Encryptor>(*context, public_key);
+        encryptor = make_unique<Encryptor>(*context, public_key, secret_key);
         evaluator = make_unique<Evaluator>(*context);
         decryptor = make_unique<Decryptor>(*context, secret_key);
         encoder = make_unique<CKKSEncoder>(*context);
@@ -101,6 +595,9 @@ public:
 
     // Add node to graph with encrypted embedding
     void add_node(int id, int level, const vector<double>& embedding) {
+        if (embedding.empty()) {
+            throw invalid_argument("Node embedding must not be empty");
+        }
         EncryptedNode node;
         node.id = id;
         node.level = level;
@@ -114,12 +611,68 @@ public:
             Plaintext plain_chunk;
             encoder->encode(chunk, scale, plain_chunk);
             
-            Ciphertext encrypted_chunk;
-            encryptor->encrypt(plain_chunk, encrypted_chunk);
-            node.encrypted_embedding.push_back(encrypted_chunk);
+            node.encrypted_embedding.push_back(
+                CompressedCiphertext::from(encryptor->encrypt_symmetric(plain_chunk)));
         }
+        embedding_span = max(embedding_span, min(chunk_size, embedding.size()));
         
+        forget_heuristics(id);
+        unindex_node(id);
         nodes[id] = node;
+        index_node(id);
+    }
+
+    // Register a node whose chunks are already in the store opened by open_embeddings()
+    void add_stored_node(int id, int level) {
+        if (!store.is_open()) {
+            throw logic_error("open_embeddings must run before add_stored_node");
+        }
+        auto range = store.find(id);
+        if (range.first == range.second) {
+            throw invalid_argument("Node " + to_string(id) + " has no chunks in the store");
+        }
+        EncryptedNode node;
+        node.id = id;
+        node.level = level;
+        forget_heuristics(id);
+        unindex_node(id);
+        nodes[id] = node;
+        index_node(id);
+    }
+
+    // Write every node's chunks to an on-disk store keyed by (node id, chunk),
+    // drop the in-memory ciphertexts and serve later lookups from the mapping.
+    // Nodes still served by the current store are carried over; the new
+    // store is written beside it and renamed into place.
+    void persist_embeddings(const string& path) {
+        string staging = path + ".tmp";
+        MappedCiphertextStore::Writer writer(staging);
+        for (const auto& entry : nodes) {
+            const auto& chunks = entry.second.encrypted_embedding;
+            if (chunks.empty() && store.is_open()) {
+                auto range = store.find(entry.first);
+                for (size_t i = range.first; i < range.second; i++) {
+                    writer.append(entry.first, i - range.first, store.data(i), store.entry(i).size);
+                }
+            }
+            for (size_t i = 0; i < chunks.size(); i++) {
+                writer.append(entry.first, i, chunks[i].bytes);
+            }
+        }
+        writer.finish();
+        store.close();
+        if (rename(staging.c_str(), path.c_str()) != 0) {
+            throw runtime_error("Cannot replace ciphertext store: " + path);
+        }
+        for (auto& entry : nodes) {
+            vector<CompressedCiphertext>().swap(entry.second.encrypted_embedding);
+        }
+        open_embeddings(path);
+    }
+
+    // Serve node chunks from an existing store; opening costs one mmap
+    void open_embeddings(const string& path) {
+        store.open(path);
     }
 
     // Add edge between nodes
@@ -127,49 +680,202 @@ public:
         nodes[from].neighbors.emplace_back(to, weight);
     }
 
-    // Create hierarchical partitions
-    void create_partitions(int num_partitions) {
-        // Simplified partitioning - in practice would use a clustering algorithm
-        partitions.resize(num_partitions);
-        int nodes_per_partition = nodes.size() / num_partitions + 1;
-        int current_partition = 0;
-        int count = 0;
-        
-        for (const auto& pair : nodes) {
-            partitions[current_partition].node_ids.insert(pair.first);
-            count++;
-            if (count >= nodes_per_partition && current_partition < num_partitions - 1) {
-                current_partition++;
-                count = 0;
+    // k-means partitions over the encrypted embeddings (Forgy seeding).
+    // Centroids never leave the ciphertext domain: each partition keeps the
+    // encrypted sum of its members, and the centroid is that sum times a
+    // plaintext 1/|P| encoded at the scale of the prime the rescale drops, so
+    // the mean keeps the working scale and costs one level. The assignment
+    // argmin cannot be evaluated under CKKS, so the key holder decrypts the
+    // packed scores |c|^2 - 2 x.c (|x|^2 does not change the argmin). An
+    // iteration costs nodes x partitions dot products; a partition left empty
+    // keeps its centroid. Embeddings must be at least two levels above the
+    // last prime, which modulus_switch_path preserves. Later add_node calls
+    // maintain the partitions incrementally.
+    void create_partitions(int num_partitions, int iterations = 10, unsigned seed = 42) {
+        if (nodes.empty() || num_partitions <= 0) {
+            throw invalid_argument("Partitioning needs nodes and a positive partition count");
+        }
+        vector<int> ids;
+        for (const auto& entry : nodes) {
+            ids.push_back(entry.first);
+        }
+        sort(ids.begin(), ids.end());
+        size_t k = min(static_cast<size_t>(num_partitions), ids.size());
+
+        vector<int> seeds = ids;
+        shuffle(seeds.begin(), seeds.end(), mt19937(seed));
+        partitions.assign(k, GraphPartition{});
+        for (size_t p = 0; p < k; p++) {
+            partitions[p].partition_id = static_cast<int>(p);
+            load_chunks(nodes.at(seeds[p]), partitions[p].centroid);
+            update_centroid_norm(partitions[p]);
+        }
+
+        auto load_node = [&](size_t j, vector<Ciphertext>& chunks) {
+            load_chunks(nodes.at(ids[j]), chunks);
+        };
+
+        vector<size_t> assignment(ids.size(), k);
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            vector<double> best(ids.size(), numeric_limits<double>::max());
+            vector<size_t> choice(ids.size(), 0);
+            for (size_t p = 0; p < k; p++) {
+                vector<double> dots = packed_dot_products(ids.size(), load_node, partitions[p].centroid);
+                for (size_t j = 0; j < ids.size(); j++) {
+                    double distance = partitions[p].centroid_norm - 2.0 * dots[j];
+                    if (distance < best[j]) {
+                        best[j] = distance;
+                        choice[j] = p;
+                    }
+                }
+            }
+            if (choice == assignment) break;
+            assignment = move(choice);
+
+            for (auto& partition : partitions) {
+                partition.node_ids.clear();
+                partition.member_sum.clear();
+            }
+            vector<Ciphertext> chunks;
+            for (size_t j = 0; j < ids.size(); j++) {
+                GraphPartition& partition = partitions[assignment[j]];
+                load_chunks(nodes.at(ids[j]), chunks);
+                accumulate_chunks(partition.member_sum, chunks, false);
+                partition.node_ids.insert(ids[j]);
+            }
+            for (auto& partition : partitions) {
+                update_centroid(partition);
             }
         }
-        
-        // Compute centroids (simplified - would use actual encrypted computation)
+    }
+
+    // Folds a node into its nearest partition: one packed score against the
+    // centroids, one addition into the member sum and one centroid update.
+    // The cost depends on the partition count, not on the graph size.
+    void index_node(int id) {
+        if (partitions.empty()) return;
+        vector<Ciphertext> chunks;
+        load_chunks(nodes.at(id), chunks);
+        vector<double> dots = packed_dot_products(partitions.size(), [&](size_t p, vector<Ciphertext>& centroid) {
+            centroid = partitions[p].centroid;
+        }, chunks);
+
+        size_t nearest = 0;
+        for (size_t p = 1; p < partitions.size(); p++) {
+            if (partitions[p].centroid_norm - 2.0 * dots[p] <
+                partitions[nearest].centroid_norm - 2.0 * dots[nearest]) {
+                nearest = p;
+            }
+        }
+        GraphPartition& partition = partitions[nearest];
+        accumulate_chunks(partition.member_sum, chunks, false);
+        partition.node_ids.insert(id);
+        update_centroid(partition);
+    }
+
+    // Takes a node that is about to be replaced out of its partition
+    void unindex_node(int id) {
+        auto node = nodes.find(id);
+        if (node == nodes.end()) return;
         for (auto& partition : partitions) {
-            // In practice, would compute encrypted centroid using homomorphic operations
-            // Here we just initialize with zeros
-            partition.centroid.resize(nodes.begin()->second.encrypted_embedding.size());
-            for (auto& ct : partition.centroid) {
-                vector<double> zeros(chunk_size, 0.0);
-                Plaintext plain_zeros;
-                encoder->encode(zeros, scale, plain_zeros);
-                encryptor->encrypt(plain_zeros, ct);
+            if (!partition.node_ids.erase(id)) continue;
+            if (partition.node_ids.empty()) {
+                partition.member_sum.clear();
+            } else {
+                vector<Ciphertext> chunks;
+                load_chunks(node->second, chunks);
+                accumulate_chunks(partition.member_sum, chunks, true);
+                update_centroid(partition);
             }
+            return;
         }
     }
 
+    // sum += chunks (or -=), bringing both to the lower of their levels.
+    // Chunks are checked before anything is added, so a rejected node leaves
+    // the partition sum untouched.
+    void accumulate_chunks(vector<Ciphertext>& sum, vector<Ciphertext>& chunks, bool subtract) {
+        for (const auto& ct : chunks) {
+            if (context->get_context_data(ct.parms_id())->chain_index() < 2) {
+                throw invalid_argument("Partition members need two levels for the centroid mean");
+            }
+        }
+        if (sum.empty()) {
+            if (subtract) throw logic_error("Cannot subtract from an empty partition sum");
+            sum = chunks;
+            return;
+        }
+        if (chunks.size() != sum.size()) {
+            throw invalid_argument("Node embeddings must have the same number of chunks");
+        }
+        for (size_t i = 0; i < sum.size(); i++) {
+            // Nodes on a switched path load with fewer limbs
+            size_t level_sum = context->get_context_data(sum[i].parms_id())->chain_index();
+            size_t level_chunk = context->get_context_data(chunks[i].parms_id())->chain_index();
+            if (level_sum > level_chunk) {
+                evaluator->mod_switch_to_inplace(sum[i], chunks[i].parms_id());
+            } else if (level_chunk > level_sum) {
+                evaluator->mod_switch_to_inplace(chunks[i], sum[i].parms_id());
+            }
+            if (subtract) {
+                evaluator->sub_inplace(sum[i], chunks[i]);
+            } else {
+                evaluator->add_inplace(sum[i], chunks[i]);
+            }
+        }
+    }
+
+    // Centroid = member_sum / |P|, homomorphically; empty partitions keep theirs
+    void update_centroid(GraphPartition& partition) {
+        if (partition.node_ids.empty()) return;
+        vector<Ciphertext> mean = partition.member_sum;
+        Plaintext inverse_count;
+        for (auto& ct : mean) {
+            auto data = context->get_context_data(ct.parms_id());
+            if (data->chain_index() < 2) {
+                throw runtime_error("Partition before modulus switching: centroids need two levels");
+            }
+            double prime = static_cast<double>(data->parms().coeff_modulus().back().value());
+            encoder->encode(1.0 / partition.node_ids.size(), ct.parms_id(), prime, inverse_count);
+            evaluator->multiply_plain_inplace(ct, inverse_count);
+            evaluator->rescale_to_next_inplace(ct);
+        }
+        partition.centroid = move(mean);
+        update_centroid_norm(partition);
+    }
+
+    void update_centroid_norm(GraphPartition& partition) {
+        partition.centroid_norm = packed_dot_products(1, [&](size_t, vector<Ciphertext>& chunks) {
+            chunks = partition.centroid;
+        }, partition.centroid)[0];
+    }
+
     // Encrypted dot product between two nodes
     Ciphertext encrypted_dot_product(const EncryptedNode& a, const EncryptedNode& b) {
-        if (a.encrypted_embedding.size() != b.encrypted_embedding.size()) {
+        size_t chunks = chunk_count(a);
+        if (chunks != chunk_count(b)) {
             throw invalid_argument("Node embeddings must have the same number of chunks");
         }
         
         Ciphertext result;
         bool first = true;
         
-        for (size_t i = 0; i < a.encrypted_embedding.size(); i++) {
+        Ciphertext chunk_a;
+        Ciphertext chunk_b;
+        for (size_t i = 0; i < chunks; i++) {
+            load_chunk(a, i, chunk_a);
+            load_chunk(b, i, chunk_b);
+            // Nodes on a switched path load with fewer limbs
+            size_t level_a = context->get_context_data(chunk_a.parms_id())->chain_index();
+            size_t level_b = context->get_context_data(chunk_b.parms_id())->chain_index();
+            if (level_a > level_b) {
+                evaluator->mod_switch_to_inplace(chunk_a, chunk_b.parms_id());
+            } else if (level_b > level_a) {
+                evaluator->mod_switch_to_inplace(chunk_b, chunk_a.parms_id());
+            }
+            
             Ciphertext temp;
-            evaluator->multiply(a.encrypted_embedding[i], b.encrypted_embedding[i], temp);
+            evaluator->multiply(chunk_a, chunk_b, temp);
             evaluator->relinearize_inplace(temp, relin_keys);
             evaluator->rescale_to_next_inplace(temp);
             
@@ -184,87 +890,303 @@ public:
         return result;
     }
 
+    // Dot products of `reference` with `count` chunked operands, where
+    // load(j, chunks) fills the chunks of operand j. Each operand's product
+    // with the reference is rotated into its own slot block and added into a
+    // shared ciphertext (one rotation per operand, log2(pack) distinct
+    // steps), so a pack of operands costs a single decryption; the client
+    // then sums each block. Safe to call from several threads.
+    template<typename Load>
+    vector<double> packed_dot_products(size_t count, Load load, vector<Ciphertext> reference) {
+        vector<double> dots(count);
+        size_t chunks = reference.size();
+        if (chunks == 0) return dots;
+
+        // Products only occupy the first embedding_span slots of a chunk
+        size_t slots = encoder->slot_count();
+        size_t span = embedding_span ? embedding_span : chunk_size;
+        size_t block = 1;
+        while (block < min(span, slots)) {
+            block <<= 1;
+        }
+        size_t per_pack = slots / block;
+
+        vector<double> decoded;
+        for (size_t first = 0; first < count; first += per_pack) {
+            size_t pack = min(per_pack, count - first);
+
+            // Bring every operand of the pack to the lowest level among them
+            // so all products rescale by the same prime and can be added
+            vector<vector<Ciphertext>> operands(pack);
+            parms_id_type lowest = reference[0].parms_id();
+            auto note_level = [&](const Ciphertext& ct) {
+                if (context->get_context_data(ct.parms_id())->chain_index() <
+                    context->get_context_data(lowest)->chain_index()) {
+                    lowest = ct.parms_id();
+                }
+            };
+            for (const auto& ct : reference) {
+                note_level(ct);
+            }
+            for (size_t j = 0; j < pack; j++) {
+                load(first + j, operands[j]);
+                if (operands[j].size() != chunks) {
+                    throw invalid_argument("Node embeddings must have the same number of chunks");
+                }
+                for (const auto& ct : operands[j]) {
+                    note_level(ct);
+                }
+            }
+            for (auto& ct : reference) {
+                if (ct.parms_id() != lowest) evaluator->mod_switch_to_inplace(ct, lowest);
+            }
+
+            vector<Ciphertext> products(pack);
+            Ciphertext temp;
+            for (size_t j = 0; j < pack; j++) {
+                for (size_t i = 0; i < chunks; i++) {
+                    Ciphertext& chunk = operands[j][i];
+                    if (chunk.parms_id() != lowest) evaluator->mod_switch_to_inplace(chunk, lowest);
+                    evaluator->multiply(chunk, reference[i], temp);
+                    evaluator->relinearize_inplace(temp, relin_keys);
+                    evaluator->rescale_to_next_inplace(temp);
+                    if (i == 0) {
+                        products[j] = temp;
+                    } else {
+                        evaluator->add_inplace(products[j], temp);
+                    }
+                }
+            }
+            vector<vector<Ciphertext>>().swap(operands);
+
+            // Pairwise tree: after the pass with stride s, products[j] holds
+            // operands j..j+2s-1 in consecutive blocks
+            for (size_t stride = 1; stride < pack; stride <<= 1) {
+                int step = -static_cast<int>(stride * block);
+                auto keys = galois_keys->get(step);
+                for (size_t j = 0; j + stride < pack; j += 2 * stride) {
+                    evaluator->rotate_vector_inplace(products[j + stride], step, *keys);
+                    evaluator->add_inplace(products[j], products[j + stride]);
+                }
+            }
+
+            Plaintext plain_result;
+            decryptor->decrypt(products[0], plain_result);
+            encoder->decode(plain_result, decoded);
+            packed_products += pack;
+            packed_decryptions++;
+
+            for (size_t j = 0; j < pack; j++) {
+                double sum = 0.0;
+                for (size_t k = j * block; k < (j + 1) * block; k++) {
+                    sum += decoded[k];
+                }
+                dots[first + j] = sum;
+            }
+        }
+        return dots;
+    }
+
+    // Score every node in node_ids that has no cached heuristic for
+    // target_id, packed as in packed_dot_products. Safe to call from several
+    // threads.
+    void score_heuristics(const vector<int>& node_ids, int target_id) {
+        vector<int> pending = uncached_heuristics(node_ids, target_id);
+        if (pending.empty()) return;
+
+        vector<Ciphertext> target_chunks;
+        load_chunks(nodes.at(target_id), target_chunks);
+        vector<double> dots = packed_dot_products(pending.size(), [&](size_t j, vector<Ciphertext>& chunks) {
+            load_chunks(nodes.at(pending[j]), chunks);
+        }, move(target_chunks));
+
+        // Similarity to heuristic value (higher similarity = lower heuristic)
+        lock_guard<mutex> lock(heuristic_mtx);
+        auto& cached = heuristic_cache[target_id];
+        for (size_t j = 0; j < pending.size(); j++) {
+            cached[pending[j]] = 1.0 / (1.0 + dots[j]);
+        }
+        heuristic_computed += pending.size();
+    }
+
+    // IVF search: scores the query node against the partition centroids and
+    // then only against the nodes of the nprobe best partitions. Returns up
+    // to k (similarity, node id) pairs, best first.
+    vector<pair<double, int>> ivf_search(int query_id, size_t k, size_t nprobe) {
+        if (partitions.empty()) {
+            throw logic_error("create_partitions must run before ivf_search");
+        }
+        vector<Ciphertext> query;
+        load_chunks(nodes.at(query_id), query);
+
+        vector<double> centroid_scores = packed_dot_products(partitions.size(),
+            [&](size_t p, vector<Ciphertext>& chunks) { chunks = partitions[p].centroid; }, query);
+        vector<size_t> order(partitions.size());
+        for (size_t p = 0; p < order.size(); p++) order[p] = p;
+        nprobe = min(nprobe, order.size());
+        partial_sort(order.begin(), order.begin() + nprobe, order.end(),
+                     [&](size_t a, size_t b) { return centroid_scores[a] > centroid_scores[b]; });
+
+        vector<int> candidates;
+        for (size_t i = 0; i < nprobe; i++) {
+            const auto& members = partitions[order[i]].node_ids;
+            candidates.insert(candidates.end(), members.begin(), members.end());
+        }
+        return rank_candidates(query, candidates, k);
+    }
+
+    // Exhaustive counterpart of ivf_search, one dot product per node
+    vector<pair<double, int>> exact_search(int query_id, size_t k) {
+        vector<Ciphertext> query;
+        load_chunks(nodes.at(query_id), query);
+        vector<int> candidates;
+        for (const auto& entry : nodes) {
+            candidates.push_back(entry.first);
+        }
+        return rank_candidates(query, candidates, k);
+    }
+
+    size_t dot_products_computed() const { return packed_products; }
+
+    // Distinct ids of node_ids without a cached heuristic for target_id
+    vector<int> uncached_heuristics(const vector<int>& node_ids, int target_id) const {
+        lock_guard<mutex> lock(heuristic_mtx);
+        auto cached = heuristic_cache.find(target_id);
+        vector<int> pending;
+        for (int id : node_ids) {
+            if ((cached == heuristic_cache.end() || !cached->second.count(id)) &&
+                find(pending.begin(), pending.end(), id) == pending.end()) {
+                pending.push_back(id);
+            }
+        }
+        return pending;
+    }
+
+    // Splits the uncached nodes into one slice per thread and scores the
+    // slices concurrently; each slice still packs its nodes together
+    void score_heuristics_parallel(const vector<int>& node_ids, int target_id, size_t threads) {
+        vector<int> pending = uncached_heuristics(node_ids, target_id);
+        size_t slices = min(max<size_t>(threads, 1), pending.size());
+        parallel_for(slices, threads, [&](size_t t) {
+            vector<int> slice(pending.begin() + pending.size() * t / slices,
+                              pending.begin() + pending.size() * (t + 1) / slices);
+            score_heuristics(slice, target_id);
+        });
+    }
+
     // Heuristic function for A* using encrypted dot product similarity
-    double heuristic(const EncryptedNode& current, const EncryptedNode& target) {
-        Ciphertext dot = encrypted_dot_product(current, target);
-        
-        // Decrypt and decode the result (in practice would do more sophisticated processing)
-        Plaintext plain_result;
-        decryptor->decrypt(dot, plain_result);
-        
-        vector<double> result;
-        encoder->decode(plain_result, result);
-        
-        // Sum all values in the result vector
-        double sum = 0.0;
-        for (double val : result) {
-            sum += val;
+    double heuristic(int node_id, int target_id) {
+        heuristic_lookups++;
+        {
+            lock_guard<mutex> lock(heuristic_mtx);
+            auto cached = heuristic_cache.find(target_id);
+            if (cached != heuristic_cache.end()) {
+                auto hit = cached->second.find(node_id);
+                if (hit != cached->second.end()) return hit->second;
+            }
         }
-        
-        // Convert similarity to heuristic value (higher similarity = lower heuristic)
-        return 1.0 / (1.0 + sum);
+        score_heuristics({node_id}, target_id);
+        lock_guard<mutex> lock(heuristic_mtx);
+        return heuristic_cache.at(target_id).at(node_id);
+    }
+
+    void clear_heuristics() {
+        lock_guard<mutex> lock(heuristic_mtx);
+        heuristic_cache.clear();
+        heuristic_lookups = 0;
+        heuristic_computed = 0;
+        packed_products = 0;
+        packed_decryptions = 0;
     }
 
-    // A* search with encrypted operations
-    vector<int> a_star_search(int start_id, int target_id, bool track_progress = false) {
+    // A* search with encrypted operations. Each round pops up to `threads`
+    // best frontier nodes (k-best batch expansion), scores all their neighbors
+    // concurrently and relaxes the nodes in parallel into sharded g-score and
+    // parent maps. With one thread this is plain A*; with more, nodes a serial
+    // search would expand later may be expanded early, so the path returned
+    // is not necessarily the one a serial search finds.
+    vector<int> a_star_search(int start_id, int target_id, bool track_progress = false,
+                              size_t threads = 1) {
         if (nodes.find(start_id) == nodes.end() || nodes.find(target_id) == nodes.end()) {
             throw invalid_argument("Start or target node not found");
         }
-        
-        const EncryptedNode& target = nodes[target_id];
+        threads = max<size_t>(threads, 1);
         
         ThreadSafePriorityQueue<int, double> open_set;
-        unordered_map<int, double> g_score;
-        unordered_map<int, int> came_from;
+        ConcurrentSearchState state;
         
         open_set.push(0.0, start_id);
-        g_score[start_id] = 0.0;
+        state.relax(start_id, 0.0, 0.0, start_id);
         
-        while (!open_set.empty()) {
+        vector<int> batch;
+        vector<int> neighbor_ids;
+        while (true) {
+            batch.clear();
             pair<double, int> current_pair;
-            if (!open_set.try_pop(current_pair)) continue;
-            
-            int current_id = current_pair.second;
-            if (current_id == target_id) {
-                // Reconstruct path
-                vector<int> path;
-                while (came_from.find(current_id) != came_from.end()) {
-                    path.push_back(current_id);
-                    current_id = came_from[current_id];
+            while (batch.size() < threads && open_set.try_pop(current_pair)) {
+                int current_id = current_pair.second;
+                if (current_id == target_id) {
+                    // Reconstruct path
+                    vector<int> path;
+                    double g, f;
+                    int parent;
+                    while (state.lookup(current_id, g, f, parent) && parent != current_id) {
+                        path.push_back(current_id);
+                        current_id = parent;
+                    }
+                    path.push_back(start_id);
+                    reverse(path.begin(), path.end());
+                    return path;
                 }
-                path.push_back(start_id);
-                reverse(path.begin(), path.end());
-                return path;
+                
+                // Entries superseded by a later improvement are skipped
+                double g, f;
+                int parent;
+                state.lookup(current_id, g, f, parent);
+                if (current_pair.first > f) continue;
+                batch.push_back(current_id);
             }
+            if (batch.empty()) break;
             
-            const EncryptedNode& current_node = nodes[current_id];
+            // Score the unseen neighbors of the whole batch; relaxation only reads the cache
+            neighbor_ids.clear();
+            for (int current_id : batch) {
+                for (const auto& neighbor : nodes.at(current_id).neighbors) {
+                    neighbor_ids.push_back(neighbor.first);
+                }
+            }
+            score_heuristics_parallel(neighbor_ids, target_id, threads);
             
-            for (const auto& neighbor : current_node.neighbors) {
-                int neighbor_id = neighbor.first;
-                double edge_weight = neighbor.second;
-                
-                double tentative_g_score = g_score[current_id] + edge_weight;
+            parallel_for(batch.size(), threads, [&](size_t i) {
+                int current_id = batch[i];
+                double current_g, current_f;
+                int parent;
+                state.lookup(current_id, current_g, current_f, parent);
                 
-                if (g_score.find(neighbor_id) == g_score.end() || tentative_g_score < g_score[neighbor_id]) {
-                    came_from[neighbor_id] = current_id;
-                    g_score[neighbor_id] = tentative_g_score;
+                for (const auto& neighbor : nodes.at(current_id).neighbors) {
+                    int neighbor_id = neighbor.first;
+                    double edge_weight = neighbor.second;
                     
-                    double f_score = tentative_g_score + heuristic(nodes[neighbor_id], target);
-                    open_set.push(f_score, neighbor_id);
+                    double tentative_g_score = current_g + edge_weight;
+                    double f_score = tentative_g_score + heuristic(neighbor_id, target_id);
                     
-                    if (track_progress) {
-                        lock_guard<mutex> lock(progress_mtx);
-                        traversal_progress[neighbor_id] = f_score;
+                    if (state.relax(neighbor_id, tentative_g_score, f_score, current_id)) {
+                        open_set.push(f_score, neighbor_id);
+                        
+                        if (track_progress) {
+                            lock_guard<mutex> lock(progress_mtx);
+                            traversal_progress[neighbor_id] = f_score;
+                        }
                     }
                 }
-            }
+            });
         }
         
         return {}; // No path found
     }
 
     // Hierarchical traversal with modulus switching
-    vector<int> hierarchical_traversal(int start_id, int target_id) {
+    vector<int> hierarchical_traversal(int start_id, int target_id, size_t threads = 1) {
         // Start at highest level
         int max_level = 0;
         for (const auto& pair : nodes) {
@@ -285,18 +1207,12 @@ public:
                 }
             }
             
-            // Create a subgraph at this level
-            unordered_map<int, EncryptedNode> subgraph;
-            for (int node_id : level_nodes) {
-                subgraph[node_id] = nodes[node_id];
-            }
-            
             // Find closest node to target at this level
-            int closest_node = find_closest_node(subgraph, current_node, target_id);
+            int closest_node = find_closest_node(level_nodes, current_node, target_id, threads);
             
             // If we found a path at this level, follow it
             if (closest_node != -1) {
-                vector<int> sub_path = a_star_search(current_node, closest_node);
+                vector<int> sub_path = a_star_search(current_node, closest_node, false, threads);
                 path.insert(path.end(), sub_path.begin(), sub_path.end());
                 current_node = closest_node;
             }
@@ -308,39 +1224,122 @@ public:
         }
         
         // Final path to target at level 0
-        vector<int> final_path = a_star_search(current_node, target_id);
+        vector<int> final_path = a_star_search(current_node, target_id, false, threads);
         path.insert(path.end(), final_path.begin(), final_path.end());
         
         return path;
     }
 
-    // Find closest node to target in a subgraph
-    int find_closest_node(const unordered_map<int, EncryptedNode>& subgraph, int start_id, int target_id) {
+    // Find closest node to target among the subgraph's nodes
+    int find_closest_node(const vector<int>& subgraph, int start_id, int target_id, size_t threads = 1) {
+        vector<int> candidates;
+        for (int node_id : subgraph) {
+            if (node_id != start_id) candidates.push_back(node_id);
+        }
+        score_heuristics_parallel(candidates, target_id, threads);
+        
         double min_distance = numeric_limits<double>::max();
         int closest_node = -1;
         
-        for (const auto& pair : subgraph) {
-            if (pair.first == start_id) continue;
-            
-            double dist = heuristic(pair.second, nodes[target_id]);
+        for (int node_id : candidates) {
+            double dist = heuristic(node_id, target_id);
             if (dist < min_distance) {
                 min_distance = dist;
-                closest_node = pair.first;
+                closest_node = node_id;
             }
         }
         
         return closest_node;
     }
 
-    // Modulus switching for path nodes to reduce noise
+    // Modulus switching for path nodes to reduce noise. The switch is
+    // recorded on the node and applied as its chunks are loaded; the stored
+    // bytes are left alone, since a re-stored switched chunk loses its seeded
+    // c1 and is larger than the original despite the dropped limb. Chunks
+    // stay at least two levels above the last prime so a partition they join
+    // can still take its mean and score it.
     void modulus_switch_path(const vector<int>& path) {
+        Ciphertext ct;
         for (int node_id : path) {
-            for (auto& ct : nodes[node_id].encrypted_embedding) {
-                evaluator->mod_switch_to_next_inplace(ct);
+            EncryptedNode& node = nodes[node_id];
+            size_t chunks = chunk_count(node);
+            bool switchable = chunks > 0;
+            for (size_t i = 0; i < chunks && switchable; i++) {
+                load_chunk(node, i, ct);
+                switchable = context->get_context_data(ct.parms_id())->chain_index() >= 3;
+            }
+            if (switchable) {
+                node.switched_levels++;
             }
         }
     }
 
+    // Average stored bytes per node against full top-level ciphertexts, and load speed
+    void report_storage() {
+        if (nodes.empty()) return;
+
+        size_t stored_bytes = 0;
+        size_t chunks = 0;
+        for (const auto& entry : nodes) {
+            for (size_t i = 0; i < chunk_count(entry.second); i++) {
+                stored_bytes += chunk_bytes(entry.second, i);
+                chunks++;
+            }
+        }
+
+        Ciphertext full;
+        encryptor->encrypt_zero(full);
+        double full_bytes = static_cast<double>(full.save_size(compr_mode_type::none)) * chunks;
+
+        Ciphertext loaded;
+        auto start = chrono::high_resolution_clock::now();
+        for (const auto& entry : nodes) {
+            for (size_t i = 0; i < chunk_count(entry.second); i++) {
+                load_chunk(entry.second, i, loaded);
+            }
+        }
+        auto end = chrono::high_resolution_clock::now();
+        double ms = chrono::duration<double, milli>(end - start).count();
+
+        cout << "Stored bytes per node: " << stored_bytes / nodes.size() << " (full ciphertexts "
+             << static_cast<size_t>(full_bytes) / nodes.size() << ", "
+             << full_bytes / stored_bytes << "x smaller)" << endl;
+        cout << "Loaded " << chunks << " chunks in " << ms << " ms" << endl;
+    }
+
+    // Heuristic work so far: encrypted evaluations are bounded by the distinct
+    // (node, target) pairs touched, whatever the number of relaxations
+    void report_heuristics() const {
+        lock_guard<mutex> lock(heuristic_mtx);
+        size_t cached = 0;
+        for (const auto& entry : heuristic_cache) {
+            cached += entry.second.size();
+        }
+        cout << "Heuristics: " << heuristic_lookups << " lookups, " << heuristic_computed
+             << " computed (" << cached << " cached), " << packed_products
+             << " dot products, " << packed_decryptions << " decryptions" << endl;
+    }
+
+    // Key-holder view of the partition holding node_id: its members and the
+    // decrypted centroid, embedding_span slots per chunk
+    pair<vector<int>, vector<double>> inspect_partition(int node_id) const {
+        for (const auto& partition : partitions) {
+            if (!partition.node_ids.count(node_id)) continue;
+            vector<int> members(partition.node_ids.begin(), partition.node_ids.end());
+            sort(members.begin(), members.end());
+            vector<double> centroid;
+            Plaintext plain;
+            vector<double> decoded;
+            for (const auto& ct : partition.centroid) {
+                decryptor->decrypt(ct, plain);
+                encoder->decode(plain, decoded);
+                centroid.insert(centroid.end(), decoded.begin(), decoded.begin() + embedding_span);
+            }
+            return {members, centroid};
+        }
+        throw invalid_argument("Node " + to_string(node_id) + " is not in a partition");
+    }
+
     // Get traversal progress
     unordered_map<int, double> get_traversal_progress() {
         lock_guard<mutex> lock(progress_mtx);
@@ -348,6 +1347,166 @@ public:
     }
 };
 
+// Serial against batched parallel A* on a side x side grid whose embeddings
+// vary smoothly with position, so the heuristic points towards the target.
+// The heuristic cache is cleared before each run so every run pays for its
+// own encrypted scoring.
+void benchmark_parallel_search(size_t side, const vector<size_t>& thread_counts) {
+    EncryptedGraphTraversal traversal(8192);
+    const size_t dim = 16;
+    mt19937 rng(7);
+    uniform_real_distribution<double> coord(0.0, static_cast<double>(side));
+    vector<pair<double, double>> anchors(dim);
+    for (auto& anchor : anchors) {
+        anchor = {coord(rng), coord(rng)};
+    }
+    double width = side / 4.0;
+
+    vector<double> embedding(dim);
+    for (size_t y = 0; y < side; y++) {
+        for (size_t x = 0; x < side; x++) {
+            for (size_t k = 0; k < dim; k++) {
+                double dx = x - anchors[k].first;
+                double dy = y - anchors[k].second;
+                embedding[k] = exp(-(dx * dx + dy * dy) / (width * width));
+            }
+            traversal.add_node(static_cast<int>(y * side + x), 0, embedding);
+        }
+    }
+    for (size_t y = 0; y < side; y++) {
+        for (size_t x = 0; x < side; x++) {
+            int id = static_cast<int>(y * side + x);
+            if (x + 1 < side) {
+                traversal.add_edge(id, id + 1, 1.0);
+                traversal.add_edge(id + 1, id, 1.0);
+            }
+            if (y + 1 < side) {
+                traversal.add_edge(id, id + static_cast<int>(side), 1.0);
+                traversal.add_edge(id + static_cast<int>(side), id, 1.0);
+            }
+        }
+    }
+
+    int target = static_cast<int>(side * side - 1);
+    double baseline_ms = 0.0;
+    for (size_t threads : thread_counts) {
+        traversal.clear_heuristics();
+        auto start = chrono::high_resolution_clock::now();
+        vector<int> path = traversal.a_star_search(0, target, false, threads);
+        auto end = chrono::high_resolution_clock::now();
+        double ms = chrono::duration<double, milli>(end - start).count();
+        if (baseline_ms == 0.0) baseline_ms = ms;
+
+        cout << side * side << " nodes, " << threads << " threads: " << ms << " ms, path length "
+             << path.size() << ", speedup " << baseline_ms / ms << "x" << endl;
+        traversal.report_heuristics();
+    }
+}
+
+// IVF against exhaustive encrypted search on clustered embeddings: encrypted
+// dot products per query and recall of the IVF top-k
+void benchmark_ivf(size_t node_count, int num_partitions, size_t nprobe, size_t queries) {
+    EncryptedGraphTraversal traversal(8192);
+    const size_t dim = 16;
+    const size_t k = 10;
+    mt19937 rng(11);
+    normal_distribution<double> noise(0.0, 0.1);
+    vector<vector<double>> centers(num_partitions, vector<double>(dim));
+    for (auto& center : centers) {
+        for (double& value : center) value = noise(rng) * 10.0;
+    }
+    vector<double> embedding(dim);
+    for (size_t i = 0; i < node_count; i++) {
+        const auto& center = centers[i % centers.size()];
+        for (size_t d = 0; d < dim; d++) {
+            embedding[d] = center[d] + noise(rng);
+        }
+        traversal.add_node(static_cast<int>(i), 0, embedding);
+    }
+
+    auto start = chrono::high_resolution_clock::now();
+    traversal.create_partitions(num_partitions, 4);
+    auto end = chrono::high_resolution_clock::now();
+    cout << "k-means over " << node_count << " encrypted embeddings: "
+         << chrono::duration<double>(end - start).count() << " s" << endl;
+
+    // Inserts after partitioning update one partition each, whatever the graph size
+    const size_t inserts = 32;
+    start = chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < inserts; i++) {
+        const auto& center = centers[i % centers.size()];
+        for (size_t d = 0; d < dim; d++) {
+            embedding[d] = center[d] + noise(rng);
+        }
+        traversal.add_node(static_cast<int>(node_count + i), 0, embedding);
+    }
+    end = chrono::high_resolution_clock::now();
+    cout << "Incremental insert: " << chrono::duration<double, milli>(end - start).count() / inserts
+         << " ms per node (encryption, partition assignment and centroid update)" << endl;
+
+    size_t ivf_products = 0;
+    size_t exact_products = 0;
+    size_t hits = 0;
+    for (size_t q = 0; q < queries; q++) {
+        int query = static_cast<int>(q * node_count / queries);
+        size_t before = traversal.dot_products_computed();
+        auto approximate = traversal.ivf_search(query, k, nprobe);
+        size_t middle = traversal.dot_products_computed();
+        auto exact = traversal.exact_search(query, k);
+        ivf_products += middle - before;
+        exact_products += traversal.dot_products_computed() - middle;
+
+        for (const auto& result : approximate) {
+            for (const auto& truth : exact) {
+                if (truth.second == result.second) {
+                    hits++;
+                    break;
+                }
+            }
+        }
+    }
+    cout << "IVF (" << num_partitions << " partitions, nprobe " << nprobe << "): "
+         << static_cast<double>(ivf_products) / queries << " dot products per query vs "
+         << static_cast<double>(exact_products) / queries << " exhaustive ("
+         << static_cast<double>(exact_products) / ivf_products << "x fewer), recall@" << k
+         << " " << static_cast<double>(hits) / (queries * k) << endl;
+}
+
+// Re-inserts a modulus-switched node into an existing partition, then adds a
+// fresh node to the now lower partition sum, and compares the centroid with
+// the plaintext mean of the members
+bool check_switched_insert() {
+    EncryptedGraphTraversal traversal(8192);
+    map<int, vector<double>> embeddings = {
+        {1, {1.0, 0.1, 0.0, 0.0}}, {2, {0.9, 0.0, 0.1, 0.0}},
+        {3, {0.0, 1.0, 0.0, 0.1}}, {4, {0.1, 0.9, 0.0, 0.0}},
+        {5, {1.0, 0.0, 0.1, 0.1}}, {6, {0.95, 0.05, 0.0, 0.0}}};
+    for (int id = 1; id <= 4; id++) {
+        traversal.add_node(id, 0, embeddings[id]);
+    }
+    traversal.create_partitions(2);
+    traversal.add_node(5, 0, embeddings[5]);
+
+    traversal.modulus_switch_path({5});
+    traversal.unindex_node(5);
+    traversal.index_node(5);
+    traversal.add_node(6, 0, embeddings[6]);
+
+    auto partition = traversal.inspect_partition(5);
+    double error = 0.0;
+    for (size_t d = 0; d < embeddings[5].size(); d++) {
+        double mean = 0.0;
+        for (int id : partition.first) {
+            mean += embeddings[id][d] / partition.first.size();
+        }
+        error = max(error, fabs(partition.second[d] - mean));
+    }
+    bool passed = error < 1e-3;
+    cout << "Switched-node insert: " << partition.first.size() << " members, centroid error "
+         << error << (passed ? " (PASS)" : " (FAIL)") << endl;
+    return passed;
+}
+
 int main() {
     // Example usage
     EncryptedGraphTraversal traversal(8192);
@@ -370,6 +1529,11 @@ int main() {
     
     // Create partitions
     traversal.create_partitions(2);
+    traversal.report_storage();
+    
+    // Move the ciphertexts to disk; traversal reads them through the mapping
+    traversal.persist_embeddings("graph_nodes.ctstore");
+    traversal.report_storage();
     
     // Perform A* search
     vector<int> path = traversal.a_star_search(1, 4, true);
@@ -388,6 +1552,17 @@ int main() {
         cout << node << " ";
     }
     cout << endl;
+    traversal.report_heuristics();
+    
+    vector<size_t> thread_counts;
+    for (size_t threads = 1; threads <= max(1u, thread::hardware_concurrency()); threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    if (!check_switched_insert()) {
+        return 1;
+    }
+    benchmark_parallel_search(32, thread_counts);
+    benchmark_ivf(1024, 32, 2, 8);
     
     return 0;
 }
\ No newline at end of file
@@ -4,7 +4,20 @@
 #include <memory>
 #include <unordered_map>
 #include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <queue>
+#include <functional>
+#include <chrono>
+#include <thread>
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
 #include "seal/seal.h"
+#include "seal/util/ntt.h"
+#include "seal/util/uintcore.h"
 
 using namespace std;
 using namespace seal;
@@ -50,85 +63,305 @@ private:
     unordered_map<string, vector<pair<string, float>>> edges_;
 };
 
-// Graph Embedding Generator
+// float32 inner product; AVX2/FMA when the build enables it
+inline float dot_product(const float* a, const float* b, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    }
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum4 = _mm_hadd_ps(sum4, sum4);
+    sum4 = _mm_hadd_ps(sum4, sum4);
+    float sum = _mm_cvtss_f32(sum4);
+#else
+    // Independent accumulators let the compiler vectorize the loop
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    float sum = (s0 + s1) + (s2 + s3);
+#endif
+    for (; i < n; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+// y += a * x; AVX2/FMA when the build enables it
+inline void axpy(float a, const float* x, float* y, size_t n) {
+    size_t i = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 va = _mm256_set1_ps(a);
+    for (; i + 16 <= n; i += 16) {
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+        _mm256_storeu_ps(y + i + 8, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(y + i + 8)));
+    }
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+    }
+#endif
+    for (; i < n; ++i) y[i] += a * x[i];
+}
+
+inline void normalize(float* v, size_t n) {
+    float norm = sqrt(dot_product(v, v, n));
+    if (norm > 0) {
+        for (size_t i = 0; i < n; ++i) v[i] /= norm;
+    }
+}
+
+// Compressed sparse row snapshot of a KnowledgeGraph. Nodes get integer
+// ids in sorted string-id order; the out-edges of node i are entries
+// [row_offsets[i], row_offsets[i + 1]) of columns and weights, and the
+// embeddings form one row-major node_count x dim matrix.
+struct CSRGraph {
+    vector<string> ids;
+    vector<size_t> row_offsets{0};
+    vector<uint32_t> columns;
+    vector<float> weights;
+    vector<float> embeddings;
+    size_t dim = 0;
+
+    size_t node_count() const { return ids.size(); }
+    size_t edge_count() const { return columns.size(); }
+    float* row(size_t i) { return embeddings.data() + i * dim; }
+    const float* row(size_t i) const { return embeddings.data() + i * dim; }
+
+    static CSRGraph from(const KnowledgeGraph& graph) {
+        CSRGraph csr;
+        for (const auto& [id, node] : graph.get_nodes()) csr.ids.push_back(id);
+        sort(csr.ids.begin(), csr.ids.end());
+        unordered_map<string, uint32_t> index;
+        index.reserve(csr.ids.size());
+        for (size_t i = 0; i < csr.ids.size(); ++i) index[csr.ids[i]] = static_cast<uint32_t>(i);
+
+        csr.dim = csr.ids.empty() ? 0 : graph.get_nodes().at(csr.ids[0]).embedding.size();
+        csr.embeddings.reserve(csr.ids.size() * csr.dim);
+        for (const auto& id : csr.ids) {
+            const auto& embedding = graph.get_nodes().at(id).embedding;
+            if (embedding.size() != csr.dim) throw invalid_argument("CSRGraph: embedding size mismatch");
+            csr.embeddings.insert(csr.embeddings.end(), embedding.begin(), embedding.end());
+            for (const auto& [neighbor, weight] : graph.get_edges(id)) {
+                auto it = index.find(neighbor);
+                if (it == index.end()) throw invalid_argument("CSRGraph: edge to unknown node " + neighbor);
+                csr.columns.push_back(it->second);
+                csr.weights.push_back(weight);
+            }
+            csr.row_offsets.push_back(csr.columns.size());
+        }
+        return csr;
+    }
+
+    void write_back(KnowledgeGraph& graph) const {
+        for (size_t i = 0; i < ids.size(); ++i) {
+            graph.get_node_mutable(ids[i]).embedding.assign(row(i), row(i) + dim);
+        }
+    }
+};
+
+// Graph Embedding Generator. Each epoch moves every node with out-edges to
+// 0.8 x its embedding + 0.2 x the weighted mean of its neighbours' embeddings
+// from the previous epoch. An epoch is one SpMM over the CSR graph into a
+// second buffer, with rows split across threads by edge count; the buffers
+// swap between epochs instead of copying the graph.
 class GraphEmbedder {
 public:
+    explicit GraphEmbedder(size_t threads = thread::hardware_concurrency())
+        : threads_(max<size_t>(threads, 1)) {}
+
     void generate_embeddings(KnowledgeGraph& graph, int epochs = 5) {
+        CSRGraph csr = CSRGraph::from(graph);
+        generate_embeddings(csr, epochs);
+        csr.write_back(graph);
+    }
+
+    void generate_embeddings(CSRGraph& graph, int epochs = 5) {
+        vector<float> next(graph.embeddings.size());
+        vector<size_t> bounds = split_rows(graph);
+        vector<thread> workers;
         for (int epoch = 0; epoch < epochs; ++epoch) {
-            auto nodes_copy = graph.get_nodes();
-            for (const auto& [id, _] : nodes_copy) {
-                auto& node = graph.get_node_mutable(id);
-                vector<float> agg(node.embedding.size(), 0.0f);
-                int neighbor_count = 0;
-                
-                for (const auto& [neighbor, weight] : graph.get_edges(id)) {
-                    const auto& neighbor_emb = nodes_copy.at(neighbor).embedding;
-                    for (size_t i = 0; i < node.embedding.size(); ++i) {
-                        agg[i] += neighbor_emb[i] * weight;
-                    }
-                    neighbor_count++;
-                }
+            const float* current = graph.embeddings.data();
+            for (size_t t = 1; t + 1 < bounds.size(); ++t) {
+                workers.emplace_back(propagate_rows, cref(graph), current, next.data(), bounds[t], bounds[t + 1]);
+            }
+            propagate_rows(graph, current, next.data(), bounds[0], bounds[1]);
+            for (auto& worker : workers) worker.join();
+            workers.clear();
+            graph.embeddings.swap(next);
+        }
+    }
 
-                if (neighbor_count > 0) {
-                    for (size_t i = 0; i < node.embedding.size(); ++i) {
-                        node.embedding[i] = 0.8f * node.embedding[i] + 0.2f * (agg[i] / neighbor_count);
-                    }
-                }
+private:
+    // Row boundaries giving each thread about the same rows + edges
+    vector<size_t> split_rows(const CSRGraph& graph) const {
+        size_t n = graph.node_count();
+        size_t total = n + graph.edge_count();
+        vector<size_t> bounds{0};
+        size_t row = 0;
+        for (size_t t = 1; t < threads_; ++t) {
+            size_t target = total * t / threads_;
+            while (row < n && row + graph.row_offsets[row] < target) ++row;
+            bounds.push_back(row);
+        }
+        bounds.push_back(n);
+        return bounds;
+    }
+
+    static void propagate_rows(const CSRGraph& graph, const float* current, float* next,
+                               size_t first, size_t last) {
+        size_t dim = graph.dim;
+        for (size_t i = first; i < last; ++i) {
+            const float* self = current + i * dim;
+            float* out = next + i * dim;
+            size_t begin = graph.row_offsets[i], end = graph.row_offsets[i + 1];
+            if (begin == end) {
+                copy(self, self + dim, out);
+                continue;
+            }
+            for (size_t d = 0; d < dim; ++d) out[d] = 0.8f * self[d];
+            float share = 0.2f / static_cast<float>(end - begin);
+            for (size_t e = begin; e < end; ++e) {
+                axpy(share * graph.weights[e], current + static_cast<size_t>(graph.columns[e]) * dim, out, dim);
             }
         }
     }
+
+    size_t threads_;
 };
 
-// HNSW Index with Encrypted Search
-class HNSWIndex {
+// CKKS encode/decode against caller-owned buffers. Staging buffers are sized
+// once per codec, so the hot path allocates nothing beyond SEAL's pooled
+// scratch memory. decode_slots evaluates only the requested slots straight
+// from the plaintext coefficients instead of running the full inverse FFT:
+// slot i is the message polynomial at the root zeta^(3^i mod 2N). Not
+// thread-safe; use one codec per thread.
+class SlotCodec {
 public:
-    void build(const KnowledgeGraph& graph) {
-        for (const auto& [id, node] : graph.get_nodes()) {
-            embeddings_[id] = node.embedding;
-        }
-    }
+    SlotCodec(const SEALContext& context, const CKKSEncoder& encoder)
+        : context_(context), encoder_(encoder) {
+        auto first_data = context_.first_context_data();
+        size_t n = first_data->parms().poly_modulus_degree();
+        size_t m = 2 * n;
+        size_t slots = encoder_.slot_count();
 
-    vector<string> knn_search(const vector<float>& query, size_t k) {
-        vector<pair<float, string>> scores;
-        for (const auto& [id, emb] : embeddings_) {
-            float score = cosine_similarity(query, emb);
-            scores.emplace_back(score, id);
+        staging_.reserve(slots);
+        decoded_.reserve(slots);
+        coeff_words_.resize(n * first_data->parms().coeff_modulus().size());
+        coeffs_.resize(n);
+
+        cos_table_.resize(m);
+        for (size_t t = 0; t < m; ++t) {
+            cos_table_[t] = cos(2.0 * M_PI * static_cast<double>(t) / static_cast<double>(m));
         }
-        
-        sort(scores.rbegin(), scores.rend());
-        vector<string> result;
-        for (size_t i = 0; i < min(k, scores.size()); ++i) {
-            result.push_back(scores[i].second);
+        slot_roots_.resize(slots);
+        uint64_t root = 1;
+        for (size_t i = 0; i < slots; ++i) {
+            slot_roots_[i] = root;
+            root = (root * 3) & (m - 1);
         }
-        return result;
     }
 
-    vector<Ciphertext> encrypt_query(
-        const vector<float>& query,
-        const CKKSEncoder& encoder,
-        const Encryptor& encryptor,
-        double scale) const {
-        
-        vector<Ciphertext> encrypted;
-        Plaintext plain;
-        vector<double> query_d(query.begin(), query.end());
-        encoder.encode(query_d, scale, plain);
-        encryptor.encrypt(plain, encrypted.emplace_back());
-        return encrypted;
+    size_t slot_count() const { return slot_roots_.size(); }
+
+    // Encodes count values, zero-padding the remaining slots
+    template<typename T>
+    void encode(const T* values, size_t count, parms_id_type parms_id, double scale, Plaintext& destination) {
+        if (count > slot_count()) throw invalid_argument("SlotCodec: too many values");
+        staging_.assign(values, values + count);
+        encoder_.encode(staging_, parms_id, scale, destination);
+    }
+
+    template<typename T>
+    void encode(const T* values, size_t count, double scale, Plaintext& destination) {
+        encode(values, count, context_.first_parms_id(), scale, destination);
+    }
+
+    // Writes slots [first, first + count) of plain to out
+    template<typename T>
+    void decode_slots(const Plaintext& plain, size_t first, size_t count, T* out) {
+        if (first + count > slot_count()) throw invalid_argument("SlotCodec: slot range out of bounds");
+        size_t n = coeffs_.size();
+        size_t log_n = 0;
+        while ((size_t(1) << log_n) < n) ++log_n;
+
+        // Direct evaluation costs O(N) per slot against O(N log N) for the FFT
+        if (count > log_n) {
+            encoder_.decode(plain, decoded_);
+            for (size_t i = 0; i < count; ++i) out[i] = static_cast<T>(decoded_[first + i]);
+            return;
+        }
+
+        load_coefficients(plain);
+        size_t mask = cos_table_.size() - 1;
+        for (size_t i = 0; i < count; ++i) {
+            uint64_t root = slot_roots_[first + i];
+            uint64_t exponent = 0;
+            double sum = 0.0;
+            for (size_t k = 0; k < n; ++k) {
+                sum += coeffs_[k] * cos_table_[exponent];
+                exponent = (exponent + root) & mask;
+            }
+            out[i] = static_cast<T>(sum);
+        }
     }
 
 private:
-    float cosine_similarity(const vector<float>& a, const vector<float>& b) {
-        float dot = 0, norm_a = 0, norm_b = 0;
-        for (size_t i = 0; i < a.size(); ++i) {
-            dot += a[i] * b[i];
-            norm_a += a[i] * a[i];
-            norm_b += b[i] * b[i];
+    // Inverse NTT, CRT composition and centered lift of plain into coeffs_,
+    // divided by the plaintext scale (as CKKSEncoder::decode does)
+    void load_coefficients(const Plaintext& plain) {
+        auto context_data = context_.get_context_data(plain.parms_id());
+        if (!context_data || !plain.is_ntt_form()) {
+            throw invalid_argument("SlotCodec: plaintext is not valid for this context");
+        }
+        size_t n = coeffs_.size();
+        size_t modulus_count = context_data->parms().coeff_modulus().size();
+        const uint64_t* modulus = context_data->total_coeff_modulus();
+        const uint64_t* threshold = context_data->upper_half_threshold();
+        const util::NTTTables* ntt_tables = context_data->small_ntt_tables();
+
+        uint64_t* words = coeff_words_.data();
+        copy(plain.data(), plain.data() + n * modulus_count, words);
+        for (size_t j = 0; j < modulus_count; ++j) {
+            util::inverse_ntt_negacyclic_harvey(words + j * n, ntt_tables[j]);
+        }
+        context_data->rns_tool()->base_q()->compose_array(words, n, MemoryManager::GetPool());
+
+        const double two_pow_64 = pow(2.0, 64);
+        const double inv_scale = 1.0 / plain.scale();
+        for (size_t k = 0; k < n; ++k) {
+            const uint64_t* value = words + k * modulus_count;
+            bool negative = util::is_greater_than_or_equal_uint(value, threshold, modulus_count);
+            double coeff = 0.0;
+            double word_scale = inv_scale;
+            for (size_t j = 0; j < modulus_count; ++j, word_scale *= two_pow_64) {
+                if (negative) {
+                    coeff += value[j] > modulus[j] ? static_cast<double>(value[j] - modulus[j]) * word_scale
+                                                   : -static_cast<double>(modulus[j] - value[j]) * word_scale;
+                } else {
+                    coeff += static_cast<double>(value[j]) * word_scale;
+                }
+            }
+            coeffs_[k] = coeff;
         }
-        return dot / (sqrt(norm_a) * sqrt(norm_b));
     }
 
-    unordered_map<string, vector<float>> embeddings_;
+    const SEALContext& context_;
+    const CKKSEncoder& encoder_;
+    vector<double> staging_;
+    vector<double> decoded_;
+    vector<uint64_t> coeff_words_;
+    vector<double> coeffs_;
+    vector<double> cos_table_;
+    vector<uint64_t> slot_roots_;
 };
 
 // CKKS Encryption Helper
@@ -146,47 +379,365 @@ public:
         keygen.create_relin_keys(relin_keys_);
         
         encoder_ = make_unique<CKKSEncoder>(*context_);
+        codec_ = make_unique<SlotCodec>(*context_, *encoder_);
         encryptor_ = make_unique<Encryptor>(*context_, public_key_);
         evaluator_ = make_unique<Evaluator>(*context_);
         decryptor_ = make_unique<Decryptor>(*context_, secret_key_);
     }
 
-    vector<Ciphertext> encrypt(const vector<float>& values, double scale) {
-        vector<Ciphertext> encrypted;
-        Plaintext plain;
-        vector<double> values_d(values.begin(), values.end());
-        encoder_->encode(values_d, scale, plain);
-        encryptor_->encrypt(plain, encrypted.emplace_back());
-        return encrypted;
+    void encrypt(const float* values, size_t count, double scale, Ciphertext& destination) {
+        codec_->encode(values, count, scale, plain_);
+        encryptor_->encrypt(plain_, destination);
     }
 
-    vector<float> decrypt(const vector<Ciphertext>& encrypted) {
-        vector<float> result;
-        Plaintext plain;
-        decryptor_->decrypt(encrypted[0], plain);
-        
-        vector<double> decoded;
-        encoder_->decode(plain, decoded);
-        result.assign(decoded.begin(), decoded.end());
-        return result;
+    // Decrypts slots [first, first + count) of encrypted into out
+    void decrypt(const Ciphertext& encrypted, float* out, size_t count, size_t first = 0) {
+        decryptor_->decrypt(encrypted, plain_);
+        codec_->decode_slots(plain_, first, count, out);
+    }
+
+    size_t slot_count() const { return codec_->slot_count(); }
+
+    // Slot b * block of destination receives the inner product of block b of
+    // encrypted with block b of values; block must be a power of two
+    void block_inner_products(const Ciphertext& encrypted, const float* values, size_t count,
+                              size_t block, double scale, Ciphertext& destination) {
+        codec_->encode(values, count, encrypted.parms_id(), scale, plain_);
+        evaluator_->multiply_plain(encrypted, plain_, destination);
+        evaluator_->rescale_to_next_inplace(destination);
+        const GaloisKeys& keys = block_sum_keys(block);
+        for (size_t step = 1; step < block; step <<= 1) {
+            evaluator_->rotate_vector(destination, static_cast<int>(step), keys, rotated_);
+            evaluator_->add_inplace(destination, rotated_);
+        }
     }
 
     auto get_encoder() const { return encoder_.get(); }
+    auto get_codec() const { return codec_.get(); }
     auto get_encryptor() const { return encryptor_.get(); }
     auto get_evaluator() const { return evaluator_.get(); }
     auto get_decryptor() const { return decryptor_.get(); }
 
 private:
+    // Power-of-two rotation keys up to block / 2, generated on first use
+    const GaloisKeys& block_sum_keys(size_t block) {
+        if (block > galois_block_) {
+            vector<int> steps;
+            for (size_t step = 1; step < block; step <<= 1) steps.push_back(static_cast<int>(step));
+            KeyGenerator keygen(*context_, secret_key_);
+            keygen.create_galois_keys(steps, galois_keys_);
+            galois_block_ = block;
+        }
+        return galois_keys_;
+    }
+
     shared_ptr<SEALContext> context_;
     SecretKey secret_key_;
     PublicKey public_key_;
     RelinKeys relin_keys_;
+    GaloisKeys galois_keys_;
+    size_t galois_block_ = 1;
     unique_ptr<CKKSEncoder> encoder_;
+    unique_ptr<SlotCodec> codec_;
+    Plaintext plain_;
+    Ciphertext rotated_;
     unique_ptr<Encryptor> encryptor_;
     unique_ptr<Evaluator> evaluator_;
     unique_ptr<Decryptor> decryptor_;
 };
 
+// Hierarchical navigable small-world index (Malkov & Yashunin) over
+// unit-normalized embeddings, so cosine similarity is an inner product and
+// distance is 1 - dot. Vectors sit in one contiguous buffer and layer-0 links
+// in another with a fixed stride of 2*M + 1 (count, then ids); the sparse
+// upper layers keep a small per-node block. Queries are not thread-safe:
+// they share the visited-tag buffer.
+struct HNSWParams {
+    size_t M = 16;                 // links per node on upper layers, 2*M on layer 0
+    size_t ef_construction = 200;  // candidate list size while inserting
+    size_t ef_search = 64;         // default candidate list size for queries
+    uint32_t seed = 42;
+};
+
+class HNSWIndex {
+public:
+    explicit HNSWIndex(HNSWParams params = HNSWParams())
+        : params_(params),
+          max_links0_(2 * params.M),
+          level_mult_(1.0 / log(static_cast<double>(max<size_t>(params.M, 2)))),
+          rng_(params.seed) {}
+
+    void build(const KnowledgeGraph& graph) {
+        for (const auto& [id, node] : graph.get_nodes()) {
+            add(id, node.embedding.data(), node.embedding.size());
+        }
+    }
+
+    void add(const string& id, const float* embedding, size_t dim) {
+        if (dim_ == 0) dim_ = dim;
+        if (dim != dim_) throw invalid_argument("HNSWIndex: dimension mismatch for " + id);
+        if (id_to_node_.count(id)) throw invalid_argument("HNSWIndex: duplicate id " + id);
+
+        uint32_t node = static_cast<uint32_t>(ids_.size());
+        ids_.push_back(id);
+        id_to_node_[id] = node;
+        vectors_.insert(vectors_.end(), embedding, embedding + dim);
+        normalize(vectors_.data() + size_t(node) * dim_, dim_);
+
+        int level = random_level();
+        links0_.resize(links0_.size() + max_links0_ + 1, 0);
+        upper_links_.emplace_back(size_t(level) * (params_.M + 1), 0);
+        visited_.push_back(0);
+
+        if (node == 0) {
+            entry_point_ = 0;
+            max_level_ = level;
+            return;
+        }
+
+        const float* point = vector_at(node);
+        uint32_t entry = greedy_descend(point, entry_point_, max_level_, level);
+        for (int l = min(level, max_level_); l >= 0; --l) {
+            auto candidates = search_layer(point, entry, params_.ef_construction, l);
+            auto neighbors = select_neighbors(candidates, params_.M);
+            set_links(node, l, neighbors);
+            for (uint32_t neighbor : neighbors) connect(neighbor, node, l);
+            entry = candidates.front().second;
+        }
+        if (level > max_level_) {
+            max_level_ = level;
+            entry_point_ = node;
+        }
+    }
+
+    // Approximate top-k as (cosine similarity, id), best first. ef = 0 uses
+    // the index's ef_search; larger values trade speed for recall.
+    vector<pair<float, string>> knn_search(const float* query, size_t k, size_t ef = 0) const {
+        vector<pair<float, string>> result;
+        if (ids_.empty()) return result;
+
+        vector<float> q(query, query + dim_);
+        normalize(q.data(), dim_);
+        uint32_t entry = greedy_descend(q.data(), entry_point_, max_level_, 0);
+        auto candidates = search_layer(q.data(), entry, max({ef ? ef : params_.ef_search, k, size_t(1)}), 0);
+        for (size_t i = 0; i < min(k, candidates.size()); ++i) {
+            result.emplace_back(1.0f - candidates[i].first, ids_[candidates[i].second]);
+        }
+        return result;
+    }
+
+    vector<string> knn_search(const vector<float>& query, size_t k) const {
+        vector<string> result;
+        for (const auto& [score, id] : knn_search(query.data(), k)) result.push_back(id);
+        return result;
+    }
+
+    // Brute-force scan, as ground truth for recall measurements
+    vector<pair<float, string>> exact_search(const float* query, size_t k) const {
+        vector<float> q(query, query + dim_);
+        normalize(q.data(), dim_);
+        vector<pair<float, uint32_t>> scores(ids_.size());
+        for (uint32_t n = 0; n < ids_.size(); ++n) {
+            scores[n] = {dot_product(q.data(), vector_at(n), dim_), n};
+        }
+        k = min(k, scores.size());
+        partial_sort(scores.begin(), scores.begin() + k, scores.end(), greater<pair<float, uint32_t>>());
+        vector<pair<float, string>> result;
+        for (size_t i = 0; i < k; ++i) result.emplace_back(scores[i].first, ids_[scores[i].second]);
+        return result;
+    }
+
+    // Second stage: re-scores candidates with encrypted inner products. The
+    // normalized query is encrypted once, replicated into every block of
+    // the next power of two >= dim, so each ciphertext product scores
+    // slot_count / block candidates at once.
+    void rerank_encrypted(const float* query, vector<pair<float, string>>& candidates,
+                          CKKSHelper& ckks, double scale) const {
+        size_t block = 1;
+        while (block < dim_) block <<= 1;
+        size_t per_cipher = ckks.slot_count() / block;
+        if (per_cipher == 0) throw invalid_argument("HNSWIndex: embedding does not fit in one ciphertext");
+
+        vector<float> packed(per_cipher * block, 0.0f);
+        for (size_t b = 0; b < per_cipher; ++b) {
+            copy(query, query + dim_, packed.begin() + b * block);
+            normalize(packed.data() + b * block, dim_);
+        }
+        Ciphertext encrypted_query;
+        ckks.encrypt(packed.data(), packed.size(), scale, encrypted_query);
+
+        Ciphertext products;
+        vector<float> scores(ckks.slot_count());
+        for (size_t start = 0; start < candidates.size(); start += per_cipher) {
+            size_t count = min(per_cipher, candidates.size() - start);
+            fill(packed.begin(), packed.end(), 0.0f);
+            for (size_t b = 0; b < count; ++b) {
+                const float* v = vector_at(id_to_node_.at(candidates[start + b].second));
+                copy(v, v + dim_, packed.begin() + b * block);
+            }
+            ckks.block_inner_products(encrypted_query, packed.data(), count * block, block, scale, products);
+            ckks.decrypt(products, scores.data(), scores.size());
+            for (size_t b = 0; b < count; ++b) candidates[start + b].first = scores[b * block];
+        }
+        sort(candidates.begin(), candidates.end(), greater<pair<float, string>>());
+    }
+
+    void encrypt_query(
+        const float* query,
+        size_t dim,
+        SlotCodec& codec,
+        const Encryptor& encryptor,
+        double scale,
+        Ciphertext& destination) const {
+
+        codec.encode(query, dim, scale, query_plain_);
+        encryptor.encrypt(query_plain_, destination);
+    }
+
+    size_t size() const { return ids_.size(); }
+    size_t dim() const { return dim_; }
+
+private:
+    using Candidate = pair<float, uint32_t>; // (distance, node)
+
+    const float* vector_at(uint32_t node) const { return vectors_.data() + size_t(node) * dim_; }
+
+    float distance(const float* query, uint32_t node) const {
+        return 1.0f - dot_product(query, vector_at(node), dim_);
+    }
+
+    // Count followed by neighbor ids
+    uint32_t* links(uint32_t node, int level) {
+        if (level == 0) return links0_.data() + size_t(node) * (max_links0_ + 1);
+        return upper_links_[node].data() + size_t(level - 1) * (params_.M + 1);
+    }
+
+    const uint32_t* links(uint32_t node, int level) const {
+        return const_cast<HNSWIndex*>(this)->links(node, level);
+    }
+
+    int random_level() {
+        uniform_real_distribution<double> uniform(0.0, 1.0);
+        return static_cast<int>(-log(max(uniform(rng_), 1e-12)) * level_mult_);
+    }
+
+    uint32_t greedy_descend(const float* query, uint32_t entry, int from_level, int to_level) const {
+        float best = distance(query, entry);
+        for (int level = from_level; level > to_level; --level) {
+            bool improved = true;
+            while (improved) {
+                improved = false;
+                const uint32_t* list = links(entry, level);
+                for (uint32_t i = 1; i <= list[0]; ++i) {
+                    float d = distance(query, list[i]);
+                    if (d < best) {
+                        best = d;
+                        entry = list[i];
+                        improved = true;
+                    }
+                }
+            }
+        }
+        return entry;
+    }
+
+    // Best-first search of one layer; returns up to ef nodes, nearest first
+    vector<Candidate> search_layer(const float* query, uint32_t entry, size_t ef, int level) const {
+        if (++visit_epoch_ == 0) {
+            fill(visited_.begin(), visited_.end(), 0);
+            visit_epoch_ = 1;
+        }
+        priority_queue<Candidate, vector<Candidate>, greater<Candidate>> frontier;
+        priority_queue<Candidate> nearest;
+
+        float d = distance(query, entry);
+        frontier.emplace(d, entry);
+        nearest.emplace(d, entry);
+        visited_[entry] = visit_epoch_;
+
+        while (!frontier.empty()) {
+            auto [dist, node] = frontier.top();
+            if (nearest.size() >= ef && dist > nearest.top().first) break;
+            frontier.pop();
+
+            const uint32_t* list = links(node, level);
+            for (uint32_t i = 1; i <= list[0]; ++i) {
+                uint32_t next = list[i];
+                if (visited_[next] == visit_epoch_) continue;
+                visited_[next] = visit_epoch_;
+                float next_dist = distance(query, next);
+                if (nearest.size() < ef || next_dist < nearest.top().first) {
+                    frontier.emplace(next_dist, next);
+                    nearest.emplace(next_dist, next);
+                    if (nearest.size() > ef) nearest.pop();
+                }
+            }
+        }
+
+        vector<Candidate> result(nearest.size());
+        for (size_t i = result.size(); i-- > 0; nearest.pop()) result[i] = nearest.top();
+        return result;
+    }
+
+    // Neighbor heuristic: keep a candidate only if it is closer to the base
+    // than to every neighbor already kept, which preserves long links
+    vector<uint32_t> select_neighbors(const vector<Candidate>& candidates, size_t m) const {
+        vector<uint32_t> selected;
+        for (const auto& [dist, node] : candidates) {
+            if (selected.size() >= m) break;
+            bool diverse = true;
+            for (uint32_t kept : selected) {
+                if (1.0f - dot_product(vector_at(node), vector_at(kept), dim_) < dist) {
+                    diverse = false;
+                    break;
+                }
+            }
+            if (diverse) selected.push_back(node);
+        }
+        return selected;
+    }
+
+    void set_links(uint32_t node, int level, const vector<uint32_t>& neighbors) {
+        uint32_t* list = links(node, level);
+        list[0] = static_cast<uint32_t>(neighbors.size());
+        copy(neighbors.begin(), neighbors.end(), list + 1);
+    }
+
+    // Adds the back link node -> added, re-selecting when the list is full
+    void connect(uint32_t node, uint32_t added, int level) {
+        uint32_t* list = links(node, level);
+        size_t capacity = level == 0 ? max_links0_ : params_.M;
+        if (list[0] < capacity) {
+            list[++list[0]] = added;
+            return;
+        }
+        const float* base = vector_at(node);
+        vector<Candidate> candidates;
+        candidates.emplace_back(distance(base, added), added);
+        for (uint32_t i = 1; i <= list[0]; ++i) candidates.emplace_back(distance(base, list[i]), list[i]);
+        sort(candidates.begin(), candidates.end());
+        set_links(node, level, select_neighbors(candidates, capacity));
+    }
+
+    HNSWParams params_;
+    size_t max_links0_;
+    double level_mult_;
+    mt19937 rng_;
+    size_t dim_ = 0;
+
+    vector<string> ids_;
+    unordered_map<string, uint32_t> id_to_node_;
+    vector<float> vectors_;
+    vector<uint32_t> links0_;
+    vector<vector<uint32_t>> upper_links_;
+    uint32_t entry_point_ = 0;
+    int max_level_ = 0;
+
+    mutable Plaintext query_plain_;
+    mutable vector<uint32_t> visited_;
+    mutable uint32_t visit_epoch_ = 0;
+};
+
 int main() {
     // 1. Create a simple graph
     KnowledgeGraph graph;
@@ -218,14 +769,119 @@ int main() {
 
     // 6. Encrypted search
     double scale = pow(2.0, 40);
-    auto encrypted_query = index.encrypt_query(
-        query, 
-        *ckks.get_encoder(), 
-        *ckks.get_encryptor(), 
-        scale
+    Ciphertext encrypted_query;
+    index.encrypt_query(
+        query.data(),
+        query.size(),
+        *ckks.get_codec(),
+        *ckks.get_encryptor(),
+        scale,
+        encrypted_query
     );
-    
+
+    // Only the leading slots are read back
+    float head[5];
+    ckks.decrypt(encrypted_query, head, 5);
+    cout << "Decrypted query head: ";
+    for (float v : head) cout << v << " ";
+    cout << endl;
+
     cout << "Encrypted search completed" << endl;
 
+    // 7. Recall and throughput against exact search on a larger synthetic set.
+    // Points are random 16-dimensional latents projected to embedding_dim,
+    // since learned embeddings have a low intrinsic dimension.
+    const size_t bench_size = 20000, bench_queries = 200, k = 10, latent_dim = 16;
+    mt19937 gen(7);
+    normal_distribution<float> normal(0.0f, 1.0f);
+    vector<float> projection(latent_dim * embedding_dim);
+    for (auto& v : projection) v = normal(gen);
+    auto synthetic_embedding = [&](float* out) {
+        float latent[latent_dim];
+        for (auto& z : latent) z = normal(gen);
+        for (size_t d = 0; d < embedding_dim; ++d) {
+            out[d] = 0.0f;
+            for (size_t j = 0; j < latent_dim; ++j) out[d] += latent[j] * projection[j * embedding_dim + d];
+        }
+    };
+    vector<float> bench_data(bench_size * embedding_dim);
+    for (size_t n = 0; n < bench_size; ++n) synthetic_embedding(bench_data.data() + n * embedding_dim);
+    vector<float> bench_queries_data(bench_queries * embedding_dim);
+    for (size_t q = 0; q < bench_queries; ++q) synthetic_embedding(bench_queries_data.data() + q * embedding_dim);
+
+    HNSWIndex bench_index;
+    auto build_start = chrono::high_resolution_clock::now();
+    for (size_t n = 0; n < bench_size; ++n) {
+        bench_index.add("n" + to_string(n), bench_data.data() + n * embedding_dim, embedding_dim);
+    }
+    auto build_end = chrono::high_resolution_clock::now();
+    cout << "Built HNSW over " << bench_size << " vectors in "
+         << chrono::duration<double>(build_end - build_start).count() << " s" << endl;
+
+    auto time_queries = [&](auto&& search) {
+        auto start = chrono::high_resolution_clock::now();
+        for (size_t q = 0; q < bench_queries; ++q) search(q);
+        return bench_queries / chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+    };
+
+    vector<vector<pair<float, string>>> truth(bench_queries);
+    double exact_qps = time_queries([&](size_t q) {
+        truth[q] = bench_index.exact_search(bench_queries_data.data() + q * embedding_dim, k);
+    });
+    cout << "Exact scan: " << exact_qps << " QPS" << endl;
+
+    for (size_t ef : {16, 32, 64, 128, 256}) {
+        vector<vector<pair<float, string>>> found(bench_queries);
+        double qps = time_queries([&](size_t q) {
+            found[q] = bench_index.knn_search(bench_queries_data.data() + q * embedding_dim, k, ef);
+        });
+        size_t hits = 0;
+        for (size_t q = 0; q < bench_queries; ++q) {
+            for (const auto& [score, id] : found[q]) {
+                for (const auto& [true_score, true_id] : truth[q]) {
+                    if (id == true_id) {
+                        hits++;
+                        break;
+                    }
+                }
+            }
+        }
+        cout << "ef=" << ef << ": recall@" << k << " " << double(hits) / (bench_queries * k)
+             << ", " << qps << " QPS" << endl;
+    }
+
+    // 8. Re-rank the approximate candidates with encrypted inner products
+    const float* first_query = bench_queries_data.data();
+    auto candidates = bench_index.knn_search(first_query, 4 * k);
+    bench_index.rerank_encrypted(first_query, candidates, ckks, scale);
+    cout << "Encrypted re-rank top " << k << ": ";
+    for (size_t i = 0; i < k; ++i) cout << candidates[i].second << "(" << candidates[i].first << ") ";
+    cout << endl;
+
+    // 9. Message passing on a million-edge graph, built straight into CSR
+    const size_t graph_nodes = 100000, out_degree = 10, graph_dim = 64, epochs = 5;
+    CSRGraph csr;
+    csr.dim = graph_dim;
+    csr.embeddings.resize(graph_nodes * graph_dim);
+    for (auto& v : csr.embeddings) v = normal(gen);
+    uniform_int_distribution<uint32_t> pick(0, graph_nodes - 1);
+    for (size_t i = 0; i < graph_nodes; ++i) {
+        csr.ids.push_back("n" + to_string(i));
+        for (size_t e = 0; e < out_degree; ++e) {
+            csr.columns.push_back(pick(gen));
+            csr.weights.push_back(1.0f);
+        }
+        csr.row_offsets.push_back(csr.columns.size());
+    }
+    for (size_t threads : {size_t(1), size_t(max(1u, thread::hardware_concurrency()))}) {
+        CSRGraph run = csr;
+        GraphEmbedder graph_embedder(threads);
+        auto start = chrono::high_resolution_clock::now();
+        graph_embedder.generate_embeddings(run, epochs);
+        double ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count() / epochs;
+        cout << "Message passing, " << run.edge_count() << " edges, " << threads << " threads: "
+             << ms << " ms/epoch (" << run.edge_count() / ms / 1000.0 << " M edges/s)" << endl;
+    }
+
     return 0;
 }
\ No newline at end of file
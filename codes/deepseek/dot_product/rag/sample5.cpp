@@ -5,34 +5,155 @@
 #include <mutex>
 #include <atomic>
 #include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <map>
 #include <seal/seal.h>
 
 using namespace std;
 using namespace seal;
 
+// Memory instrumentation: SEAL global pool usage, process RSS and peak RSS
+// from /proc/self/status, exact footprints of SEAL objects, and per-phase
+// high-water marks (the kernel's peak RSS counter is reset at each phase start).
 class MemoryTracker {
-private:
-    static atomic<size_t> total_memory;
-    static mutex memory_mutex;
-    
 public:
-    static void add_memory(size_t bytes) {
+    struct Snapshot {
+        size_t seal_pool_bytes = 0;
+        size_t rss_bytes = 0;
+        size_t peak_rss_bytes = 0;
+    };
+
+    struct PhaseRecord {
+        string name;
+        Snapshot start;
+        Snapshot end;
+        bool finished = false; // Set by end_phase
+    };
+
+    static Snapshot snapshot() {
+        Snapshot s;
+        s.seal_pool_bytes = MemoryManager::GetPool().alloc_byte_count();
+        s.rss_bytes = read_status_kb("VmRSS:") * 1024;
+        s.peak_rss_bytes = read_status_kb("VmHWM:") * 1024;
+        return s;
+    }
+
+    // Bytes held by the object's coefficient data (allocated capacity)
+    static size_t footprint(const Ciphertext& ct) {
+        return ct.size_capacity() * ct.poly_modulus_degree() * ct.coeff_modulus_size() * sizeof(uint64_t);
+    }
+
+    static size_t footprint(const Plaintext& pt) {
+        return pt.capacity() * sizeof(uint64_t);
+    }
+
+    static size_t footprint(const PublicKey& key) {
+        return footprint(key.data());
+    }
+
+    static size_t footprint(const SecretKey& key) {
+        return footprint(key.data());
+    }
+
+    static size_t footprint(const KSwitchKeys& keys) {
+        size_t bytes = 0;
+        for (const auto& key_set : keys.data()) {
+            for (const auto& key : key_set) {
+                bytes += footprint(key);
+            }
+        }
+        return bytes;
+    }
+
+    template <class T>
+    static size_t footprint(const vector<T>& objects) {
+        size_t bytes = 0;
+        for (const auto& object : objects) {
+            bytes += footprint(object);
+        }
+        return bytes;
+    }
+
+    void add_footprint(const string& label, size_t bytes) {
         lock_guard<mutex> lock(memory_mutex);
-        total_memory += bytes;
+        footprints[label] += bytes;
     }
-    
-    static void remove_memory(size_t bytes) {
+
+    void remove_footprint(const string& label, size_t bytes) {
         lock_guard<mutex> lock(memory_mutex);
-        total_memory -= bytes;
+        auto& entry = footprints[label];
+        entry -= min(entry, bytes);
     }
-    
-    static size_t get_total_memory() {
-        return total_memory;
+
+    void begin_phase(const string& name) {
+        reset_peak_rss();
+        lock_guard<mutex> lock(memory_mutex);
+        phases.push_back({name, snapshot(), Snapshot(), false});
+    }
+
+    void end_phase() {
+        lock_guard<mutex> lock(memory_mutex);
+        if (!phases.empty()) {
+            phases.back().end = snapshot();
+            phases.back().finished = true;
+        }
+    }
+
+    void print_report() const {
+        lock_guard<mutex> lock(memory_mutex);
+        auto mb = [](size_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); };
+        Snapshot now = snapshot();
+        cout << "Memory: RSS " << mb(now.rss_bytes) << " MB, SEAL pool "
+             << mb(now.seal_pool_bytes) << " MB" << endl;
+        for (const auto& entry : footprints) {
+            cout << "  " << entry.first << ": " << mb(entry.second) << " MB" << endl;
+        }
+        for (const auto& phase : phases) {
+            if (!phase.finished) continue;
+            // The pool can shrink within a phase, so the change is signed
+            int64_t pool_delta = static_cast<int64_t>(phase.end.seal_pool_bytes)
+                               - static_cast<int64_t>(phase.start.seal_pool_bytes);
+            cout << "  phase " << phase.name << ": peak RSS " << mb(phase.end.peak_rss_bytes)
+                 << " MB, SEAL pool " << showpos << pool_delta / (1024.0 * 1024.0) << noshowpos
+                 << " MB" << endl;
+        }
     }
-};
 
-atomic<size_t> MemoryTracker::total_memory{0};
-mutex MemoryTracker::memory_mutex;
+    static void print_memory_stats(const string& label = "") {
+        Snapshot s = snapshot();
+        cout << label << " - RSS " << s.rss_bytes / 1024 << " KB, peak "
+             << s.peak_rss_bytes / 1024 << " KB, SEAL pool "
+             << s.seal_pool_bytes / 1024 << " KB" << endl;
+    }
+
+private:
+    mutable mutex memory_mutex;
+    map<string, size_t> footprints;
+    vector<PhaseRecord> phases;
+
+    // Returns 0 where /proc is unavailable
+    static size_t read_status_kb(const string& key) {
+        ifstream status("/proc/self/status");
+        string line;
+        while (getline(status, line)) {
+            if (line.compare(0, key.size(), key) == 0) {
+                return stoul(line.substr(key.size()));
+            }
+        }
+        return 0;
+    }
+
+    // Writing 5 to clear_refs resets VmHWM to the current RSS (Linux >= 4.0)
+    static void reset_peak_rss() {
+        ofstream clear_refs("/proc/self/clear_refs");
+        if (clear_refs) {
+            clear_refs << "5";
+        }
+    }
+};
 
 class GraphEmbeddingGenerator {
 private:
@@ -45,17 +166,28 @@ private:
     SecretKey secret_key;
     RelinKeys relin_keys;
     mutex encoder_mutex;
+    MemoryTracker memory_tracker;
     
     size_t poly_modulus_degree;
     double scale;
     size_t chunk_size;
     
-    atomic<int> current_noise_budget;
+    // Analytic error bound of a fresh encryption, in slot units
+    double fresh_error_bound;
+    bool debug_mode;
     
 public:
+    // CKKS has no invariant noise budget; track scale, level and error instead
+    struct CiphertextMetadata {
+        double scale;
+        size_t level;
+        double error_bound;
+    };
+
     GraphEmbeddingGenerator(size_t poly_modulus_degree = 8192, double scale = pow(2.0, 40), 
-                          size_t chunk_size = 1024)
-        : poly_modulus_degree(poly_modulus_degree), scale(scale), chunk_size(chunk_size) {
+                          size_t chunk_size = 1024, bool debug_mode = false)
+        : poly_modulus_degree(poly_modulus_degree), scale(scale), chunk_size(chunk_size),
+          debug_mode(debug_mode) {
         
         EncryptionParameters params(scheme_type::ckks);
         params.set_poly_modulus_degree(poly_modulus_degree);
@@ -81,15 +213,22 @@ public:
         decryptor = make_unique<Decryptor>(*context, secret_key);
         evaluator = make_unique<Evaluator>(*context);
         
-        current_noise_budget = 50; // Initial estimate
+        // Fresh public-key encryption plus encoding rounding (sigma = 3.2,
+        // ternary secret with about 2N/3 non-zero coefficients)
+        double n = static_cast<double>(poly_modulus_degree);
+        double sigma = 3.2;
+        double h = 2.0 * n / 3.0;
+        double fresh_coeff = 8.0 * sqrt(2.0) * sigma * n + 6.0 * sigma * sqrt(n)
+                           + 16.0 * sigma * sqrt(h * n) + 3.0 * sqrt(n / 3.0);
+        fresh_error_bound = fresh_coeff / scale;
         
-        size_t mem_usage = poly_modulus_degree * sizeof(double) * 2;
-        MemoryTracker::add_memory(mem_usage);
+        memory_tracker.add_footprint("keys", MemoryTracker::footprint(public_key)
+                                     + MemoryTracker::footprint(secret_key)
+                                     + MemoryTracker::footprint(relin_keys));
     }
     
-    ~GraphEmbeddingGenerator() {
-        size_t mem_usage = poly_modulus_degree * sizeof(double) * 2;
-        MemoryTracker::remove_memory(mem_usage);
+    void print_memory_report() const {
+        memory_tracker.print_report();
     }
     
     vector<Ciphertext> generate_embeddings(const vector<vector<double>>& graph, 
@@ -99,6 +238,7 @@ public:
         
         if (graph.empty()) return results;
         
+        memory_tracker.begin_phase("generate_embeddings");
         size_t slot_count = encoder->slot_count();
         if (graph[0].size() > slot_count) {
             throw invalid_argument("Graph embedding dimension too large for CKKS parameters");
@@ -132,23 +272,55 @@ public:
             }
         }
         
+        memory_tracker.end_phase();
+        memory_tracker.add_footprint("embeddings", MemoryTracker::footprint(results));
+        
         return results;
     }
     
-    int get_noise_budget(const Ciphertext& ciphertext) {
-        try {
-            return decryptor->invariant_noise_budget(ciphertext);
-        } catch (const exception& e) {
-            cerr << "Error getting noise budget: " << e.what() << endl;
-            return -1;
+    CiphertextMetadata get_metadata(const Ciphertext& ciphertext) const {
+        auto context_data = context->get_context_data(ciphertext.parms_id());
+        if (!context_data) {
+            throw invalid_argument("Ciphertext is not valid for this context");
+        }
+        return {ciphertext.scale(), context_data->chain_index(), fresh_error_bound};
+    }
+    
+    // Bits of precision for values up to max_abs_value in magnitude
+    double get_precision_bits(const Ciphertext& ciphertext, double max_abs_value = 1.0) const {
+        return log2(max(max_abs_value, 1.0) / get_metadata(ciphertext).error_bound);
+    }
+    
+    // Debug mode: decrypt and check the analytic bound against the real error
+    bool verify_error_bound(const Ciphertext& ciphertext, const vector<double>& expected) {
+        if (!debug_mode) {
+            return true;
+        }
+        Plaintext pt;
+        vector<double> decoded;
+        decryptor->decrypt(ciphertext, pt);
+        {
+            lock_guard<mutex> lock(encoder_mutex);
+            encoder->decode(pt, decoded);
+        }
+        
+        double observed = 0.0;
+        for (size_t i = 0; i < expected.size(); i++) {
+            observed = max(observed, fabs(decoded[i] - expected[i]));
+        }
+        double bound = get_metadata(ciphertext).error_bound;
+        if (observed > bound) {
+            cerr << "Observed error " << observed << " exceeds bound " << bound << endl;
+            return false;
         }
+        return true;
     }
 };
 
 int main() {
     try {
         cout << "Initializing GraphEmbeddingGenerator..." << endl;
-        GraphEmbeddingGenerator generator(8192, pow(2.0, 40), 512);
+        GraphEmbeddingGenerator generator(8192, pow(2.0, 40), 512, true);
         
         vector<vector<double>> graph_data(100, vector<double>(128, 0.5)); // Reduced size for testing
         vector<size_t> selected_nodes = {10, 20, 30, 40, 50};
@@ -159,11 +331,18 @@ int main() {
         cout << "Generated " << encrypted_embeddings.size() << " encrypted embeddings" << endl;
         
         if (!encrypted_embeddings.empty()) {
-            int budget = generator.get_noise_budget(encrypted_embeddings[0]);
-            cout << "Noise budget for first ciphertext: " << budget << " bits" << endl;
+            auto meta = generator.get_metadata(encrypted_embeddings[0]);
+            cout << "First ciphertext: level " << meta.level
+                 << ", scale 2^" << log2(meta.scale)
+                 << ", error bound " << meta.error_bound << endl;
+            cout << "Precision: " << generator.get_precision_bits(encrypted_embeddings[0])
+                 << " bits" << endl;
+            bool ok = generator.verify_error_bound(encrypted_embeddings[0],
+                                                   graph_data[selected_nodes[0]]);
+            cout << "Error bound check: " << (ok ? "passed" : "FAILED") << endl;
         }
         
-        cout << "Memory usage: " << MemoryTracker::get_total_memory() / (1024 * 1024) << " MB" << endl;
+        generator.print_memory_report();
         
     } catch (const exception& e) {
         cerr << "Error: " << e.what() << endl;
@@ -3,7 +3,15 @@
 #include <complex>
 #include <chrono>
 #include <fstream>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <deque>
+#include <map>
+#include <tuple>
+#include <algorithm>
 #include "seal/seal.h"
+#include "seal/util/uintarithsmallmod.h"
 
 using namespace std;
 using namespace seal;
@@ -40,88 +48,396 @@ vector<vector<double>> plain_matrix_mult(const vector<vector<double>> &A, const
     return result;
 }
 
-// Encode matrix (row-wise)
-vector<Plaintext> encode_matrix(const vector<vector<double>> &matrix, CKKSEncoder &encoder, double scale) {
-    size_t rows = matrix.size(), cols = matrix[0].size();
-    vector<Plaintext> encoded(rows);
-    for (size_t i = 0; i < rows; i++) {
-        vector<double> row_data(cols);
-        for (size_t j = 0; j < cols; j++) row_data[j] = matrix[i][j];
-        encoder.encode(row_data, scale, encoded[i]);
+// Fused multiply-accumulate: accumulator += encrypted * plain, computed in the
+// NTT domain in one pass over the RNS limbs. An empty accumulator is
+// initialized with the product, so the inner loops of the kernels never create
+// a temporary ciphertext; a non-empty one must already be at the level of
+// encrypted. Callers rescale once at the end.
+void multiply_plain_accumulate(const SEALContext &context, const Ciphertext &encrypted,
+                               const Plaintext &plain, Ciphertext &accumulator) {
+    if (!encrypted.is_ntt_form() || !plain.is_ntt_form()) {
+        throw invalid_argument("multiply_plain_accumulate requires NTT-form operands");
+    }
+    if (encrypted.parms_id() != plain.parms_id()) {
+        throw invalid_argument("multiply_plain_accumulate: plaintext is at a different level");
+    }
+
+    auto context_data = context.get_context_data(encrypted.parms_id());
+    const auto &coeff_modulus = context_data->parms().coeff_modulus();
+    const size_t coeff_count = encrypted.poly_modulus_degree();
+    const double product_scale = encrypted.scale() * plain.scale();
+
+    bool overwrite = accumulator.size() == 0;
+    if (!overwrite && accumulator.parms_id() != encrypted.parms_id()) {
+        throw invalid_argument("multiply_plain_accumulate: accumulator is at a different level");
+    }
+    if (overwrite) {
+        accumulator.resize(context, encrypted.parms_id(), encrypted.size());
+        accumulator.is_ntt_form() = true;
+        accumulator.scale() = product_scale;
+    } else if (accumulator.size() != encrypted.size() || fabs(accumulator.scale() / product_scale - 1.0) > 1e-9) {
+        throw invalid_argument("multiply_plain_accumulate: accumulator size or scale mismatch");
     }
-    return encoded;
-}
 
-// Encrypt encoded matrix
-vector<Ciphertext> encrypt_matrix(const vector<Plaintext> &encoded, Encryptor &encryptor) {
-    vector<Ciphertext> encrypted(encoded.size());
-    for (size_t i = 0; i < encoded.size(); i++)
-        encryptor.encrypt(encoded[i], encrypted[i]);
-    return encrypted;
+    const uint64_t *pt = plain.data();
+    for (size_t j = 0; j < encrypted.size(); j++) {
+        const uint64_t *src = encrypted.data(j);
+        uint64_t *dst = accumulator.data(j);
+        for (size_t i = 0; i < coeff_modulus.size(); i++) {
+            const Modulus &q = coeff_modulus[i];
+            const size_t offset = i * coeff_count;
+            if (overwrite) {
+                for (size_t k = offset; k < offset + coeff_count; k++) {
+                    dst[k] = util::multiply_uint_mod(src[k], pt[k], q);
+                }
+            } else {
+                for (size_t k = offset; k < offset + coeff_count; k++) {
+                    dst[k] = util::add_uint_mod(dst[k], util::multiply_uint_mod(src[k], pt[k], q), q);
+                }
+            }
+        }
+    }
 }
 
-// Homomorphic matrix multiplication: Encrypted A × Plain B
-vector<Ciphertext> encrypted_matrix_mult(
-    const vector<Ciphertext> &encrypted_A,
+// Per-thread arena for kernel temporaries: a private SEAL memory pool plus a
+// set of reusable ciphertext/plaintext buffers allocated from it. Pools are
+// passed explicitly to every SEAL call rather than through MMProfGuard, since
+// memory manager profiles are process-wide and would serialize threads.
+// reset() at the end of a kernel hands the buffers back for the next call
+// without freeing them, so steady-state kernels neither contend on the global
+// pool nor fault in fresh pages.
+class KernelArena {
+public:
+    KernelArena() : pool_(MemoryPoolHandle::New()) {}
+
+    static KernelArena& for_this_thread() {
+        thread_local KernelArena arena;
+        return arena;
+    }
+
+    MemoryPoolHandle pool() const { return pool_; }
+
+    Ciphertext& ciphertext() {
+        if (next_ciphertext_ == ciphertexts_.size()) {
+            ciphertexts_.emplace_back(pool_);
+        }
+        return ciphertexts_[next_ciphertext_++];
+    }
+
+    Plaintext& plaintext() {
+        if (next_plaintext_ == plaintexts_.size()) {
+            plaintexts_.emplace_back(pool_);
+        }
+        return plaintexts_[next_plaintext_++];
+    }
+
+    void reset() {
+        next_ciphertext_ = 0;
+        next_plaintext_ = 0;
+    }
+
+    size_t bytes_reserved() const { return pool_.alloc_byte_count(); }
+
+private:
+    MemoryPoolHandle pool_;
+    deque<Ciphertext> ciphertexts_; // deque keeps handed-out references stable
+    deque<Plaintext> plaintexts_;
+    size_t next_ciphertext_ = 0;
+    size_t next_plaintext_ = 0;
+};
+
+// Resets the arena when a kernel invocation ends
+class ArenaScope {
+public:
+    explicit ArenaScope(KernelArena& arena) : arena_(arena) {}
+    ~ArenaScope() { arena_.reset(); }
+
+private:
+    KernelArena& arena_;
+};
+
+// Slot layouts for EncryptedTensor. For a rows x cols tensor with a
+// power-of-two stride S, element (r, c) lives at global slot
+//   RowMajor            r * S + c                      (S >= cols)
+//   Diagonal            ((c - r) mod cols) * S + r     (S >= rows)
+//   InterleavedChannels c * S + r                      (S >= rows; rows are
+//                       channels, interleaved at every position c)
+// Global slot g is slot g % slot_count of ciphertext g / slot_count. S divides
+// the slot count, so no row, diagonal or position straddles two ciphertexts.
+enum class TensorLayout { RowMajor, Diagonal, InterleavedChannels };
+
+// Price of a layout conversion in the operations kernels budget for
+struct LayoutCost {
+    size_t rotations = 0;        // key switches
+    size_t plain_multiplies = 0; // mask multiplications
+    size_t levels = 0;           // rescales consumed
+
+    bool is_free() const { return rotations == 0 && plain_multiplies == 0 && levels == 0; }
+};
+
+// Shape-aware CKKS tensor: a rows x cols matrix spread over as many
+// ciphertexts as its layout needs, with its stride, padding, level and scale
+// carried alongside. With cyclic padding (row-major only) each row's padding
+// repeats the row periodically, so rotating by d < S - cols reads every row
+// cyclically. Layout changes only happen through convert(), whose price is
+// known up front from conversion_cost().
+class EncryptedTensor {
+public:
+    EncryptedTensor() = default;
+
+    // min_stride lets a kernel keep its output lanes where its input lanes were
+    EncryptedTensor(size_t rows, size_t cols, TensorLayout layout, size_t slot_count,
+                    bool cyclic_padding = false, size_t min_stride = 1)
+        : rows_(rows), cols_(cols), layout_(layout), cyclic_(cyclic_padding), slot_count_(slot_count) {
+        if (rows == 0 || cols == 0) {
+            throw invalid_argument("EncryptedTensor: empty shape");
+        }
+        if (cyclic_padding && layout != TensorLayout::RowMajor) {
+            throw invalid_argument("EncryptedTensor: cyclic padding requires a row-major layout");
+        }
+        size_t needed = layout == TensorLayout::RowMajor ? (cyclic_padding ? 2 * cols : cols) : rows;
+        stride_ = 1;
+        while (stride_ < max(needed, min_stride)) stride_ <<= 1;
+        if (stride_ > slot_count) {
+            throw invalid_argument("EncryptedTensor: a single row does not fit in one ciphertext");
+        }
+        size_t lanes = layout == TensorLayout::RowMajor ? rows : cols;
+        ciphertexts_.resize((lanes * stride_ + slot_count - 1) / slot_count);
+    }
+
+    static EncryptedTensor encrypt(const vector<vector<double>>& values, TensorLayout layout,
+                                   bool cyclic_padding, CKKSEncoder& encoder, Encryptor& encryptor,
+                                   double scale) {
+        EncryptedTensor tensor(values.size(), values.empty() ? 0 : values[0].size(), layout,
+                               encoder.slot_count(), cyclic_padding);
+        vector<vector<double>> slots(tensor.ciphertexts_.size(), vector<double>(tensor.slot_count_, 0.0));
+        for (size_t r = 0; r < tensor.rows_; r++) {
+            for (size_t c = 0; c < tensor.cols_; c++) {
+                for (size_t g : tensor.slots_of(r, c)) {
+                    slots[g / tensor.slot_count_][g % tensor.slot_count_] = values[r][c];
+                }
+            }
+        }
+        Plaintext plain;
+        for (size_t i = 0; i < slots.size(); i++) {
+            encoder.encode(slots[i], scale, plain);
+            encryptor.encrypt(plain, tensor.ciphertexts_[i]);
+        }
+        return tensor;
+    }
+
+    vector<vector<double>> decrypt(CKKSEncoder& encoder, Decryptor& decryptor) const {
+        vector<vector<double>> decoded(ciphertexts_.size());
+        Plaintext plain;
+        for (size_t i = 0; i < ciphertexts_.size(); i++) {
+            decryptor.decrypt(ciphertexts_[i], plain);
+            encoder.decode(plain, decoded[i]);
+        }
+        vector<vector<double>> values(rows_, vector<double>(cols_));
+        for (size_t r = 0; r < rows_; r++) {
+            for (size_t c = 0; c < cols_; c++) {
+                size_t g = primary_slot(r, c);
+                values[r][c] = decoded[g / slot_count_][g % slot_count_];
+            }
+        }
+        return values;
+    }
+
+    size_t primary_slot(size_t r, size_t c) const {
+        switch (layout_) {
+        case TensorLayout::RowMajor:
+            return r * stride_ + c;
+        case TensorLayout::Diagonal:
+            return ((c + cols_ - r % cols_) % cols_) * stride_ + r;
+        default:
+            return c * stride_ + r;
+        }
+    }
+
+    // Every global slot holding (r, c): the primary one plus, with cyclic
+    // padding, its periodic copies in the row padding
+    vector<size_t> slots_of(size_t r, size_t c) const {
+        vector<size_t> slots{primary_slot(r, c)};
+        if (cyclic_) {
+            for (size_t p = c + cols_; p < stride_; p += cols_) {
+                slots.push_back(r * stride_ + p);
+            }
+        }
+        return slots;
+    }
+
+    LayoutCost conversion_cost(TensorLayout target, bool target_cyclic) const {
+        if (target == layout_ && target_cyclic == cyclic_) {
+            return {};
+        }
+        EncryptedTensor shape(rows_, cols_, target, slot_count_, target_cyclic);
+        LayoutCost cost;
+        for (const auto& group : moves_to(shape)) {
+            cost.plain_multiplies++;
+            if (get<2>(group.first) != 0) cost.rotations++;
+        }
+        cost.levels = 1;
+        return cost;
+    }
+
+    // Repack into another layout by masking, rotating and summing: one
+    // mask multiply per (source, destination, shift) group and one rescale.
+    // Masks are encoded at the last prime of the current level, so the
+    // rescale brings the scale back to where it was.
+    EncryptedTensor convert(TensorLayout target, bool target_cyclic, const SEALContext& context,
+                            CKKSEncoder& encoder, Evaluator& evaluator, const GaloisKeys& galois_keys) const {
+        if (target == layout_ && target_cyclic == cyclic_) {
+            return *this;
+        }
+        EncryptedTensor result(rows_, cols_, target, slot_count_, target_cyclic);
+        auto context_data = context.get_context_data(ciphertexts_[0].parms_id());
+        double mask_scale = static_cast<double>(context_data->parms().coeff_modulus().back().value());
+
+        Plaintext mask_plain;
+        Ciphertext moved;
+        vector<bool> started(result.ciphertexts_.size(), false);
+        for (const auto& group : moves_to(result)) {
+            size_t src = get<0>(group.first);
+            size_t dst = get<1>(group.first);
+            int shift = get<2>(group.first);
+
+            vector<double> mask(slot_count_, 0.0);
+            for (size_t slot : group.second) mask[slot] = 1.0;
+            encoder.encode(mask, ciphertexts_[src].parms_id(), mask_scale, mask_plain);
+            evaluator.multiply_plain(ciphertexts_[src], mask_plain, moved);
+            if (shift != 0) {
+                evaluator.rotate_vector_inplace(moved, shift, galois_keys);
+            }
+            if (started[dst]) {
+                evaluator.add_inplace(result.ciphertexts_[dst], moved);
+            } else {
+                result.ciphertexts_[dst] = moved;
+                started[dst] = true;
+            }
+        }
+        // Every destination ciphertext holds at least one lane, so all were written
+        for (auto& ct : result.ciphertexts_) {
+            evaluator.rescale_to_next_inplace(ct);
+        }
+        return result;
+    }
+
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    TensorLayout layout() const { return layout_; }
+    bool cyclic_padding() const { return cyclic_; }
+    size_t stride() const { return stride_; }
+    size_t slot_count() const { return slot_count_; }
+    size_t size() const { return ciphertexts_.size(); }
+    vector<Ciphertext>& ciphertexts() { return ciphertexts_; }
+    const vector<Ciphertext>& ciphertexts() const { return ciphertexts_; }
+    double scale() const { return ciphertexts_[0].scale(); }
+
+    size_t level(const SEALContext& context) const {
+        return context.get_context_data(ciphertexts_[0].parms_id())->chain_index();
+    }
+
+private:
+    // Source slots grouped by (source ciphertext, destination ciphertext,
+    // left-rotation step) for every element copy the target layout needs
+    map<tuple<size_t, size_t, int>, vector<size_t>> moves_to(const EncryptedTensor& target) const {
+        map<tuple<size_t, size_t, int>, vector<size_t>> groups;
+        long long n = static_cast<long long>(slot_count_);
+        for (size_t r = 0; r < rows_; r++) {
+            for (size_t c = 0; c < cols_; c++) {
+                size_t from = primary_slot(r, c);
+                for (size_t to : target.slots_of(r, c)) {
+                    long long step = (static_cast<long long>(from % slot_count_) -
+                                      static_cast<long long>(to % slot_count_) + n) % n;
+                    if (step > n / 2) step -= n;
+                    groups[make_tuple(from / slot_count_, to / slot_count_, static_cast<int>(step))]
+                        .push_back(from % slot_count_);
+                }
+            }
+        }
+        return groups;
+    }
+
+    size_t rows_ = 0;
+    size_t cols_ = 0;
+    TensorLayout layout_ = TensorLayout::RowMajor;
+    bool cyclic_ = false;
+    size_t slot_count_ = 0;
+    size_t stride_ = 1;
+    vector<Ciphertext> ciphertexts_;
+};
+
+// Homomorphic matrix multiplication: Encrypted A × Plain B. The kernel needs A
+// row-major with cyclic padding, so rot(A, d) lines up A[r][(c + d) mod n]
+// with output slot c of every packed row at once:
+//     C = sum_d rot(A, d) * D_d,   D_d[r * S + c] = B[(c + d) mod n][c]
+// That is n - 1 rotations per ciphertext however many rows it packs. An A in
+// another layout is converted first, and the conversion price is reported.
+EncryptedTensor encrypted_matrix_mult(
+    const SEALContext &context,
+    const EncryptedTensor &A,
     const vector<vector<double>> &plain_B,
     CKKSEncoder &encoder,
     Evaluator &evaluator,
-    RelinKeys &relin_keys,
     GaloisKeys &galois_keys,
     double scale) {
 
-    size_t rows_A = encrypted_A.size();
+    size_t inner_dim = A.cols();
     size_t cols_B = plain_B[0].size();
-    size_t inner_dim = plain_B.size();
-
-    // Encode columns of B
-    vector<Plaintext> encoded_B(cols_B);
-    for (size_t j = 0; j < cols_B; j++) {
-        vector<double> col_data(inner_dim);
-        for (size_t k = 0; k < inner_dim; k++) col_data[k] = plain_B[k][j];
-        encoder.encode(col_data, scale, encoded_B[j]);
+    if (plain_B.size() != inner_dim) {
+        throw invalid_argument("encrypted_matrix_mult: inner dimensions differ");
     }
 
-    // Multiply and rotate-sum to compute dot product
-    vector<Ciphertext> result(rows_A);
-    for (size_t i = 0; i < rows_A; i++) {
-        Ciphertext temp;
-        evaluator.multiply_plain(encrypted_A[i], encoded_B[0], temp);
-        evaluator.relinearize_inplace(temp, relin_keys);
-        evaluator.rescale_to_next_inplace(temp);
-
-        for (size_t j = 1; j < cols_B; j++) {
-            Ciphertext temp2;
-            evaluator.multiply_plain(encrypted_A[i], encoded_B[j], temp2);
-            evaluator.relinearize_inplace(temp2, relin_keys);
-            evaluator.rescale_to_next_inplace(temp2);
+    const EncryptedTensor* a = &A;
+    EncryptedTensor converted;
+    if (A.layout() != TensorLayout::RowMajor || !A.cyclic_padding()) {
+        LayoutCost cost = A.conversion_cost(TensorLayout::RowMajor, true);
+        cout << "Repacking A: " << cost.rotations << " rotations, " << cost.plain_multiplies
+             << " mask multiplies, " << cost.levels << " level\n";
+        converted = A.convert(TensorLayout::RowMajor, true, context, encoder, evaluator, galois_keys);
+        a = &converted;
+    }
+    size_t stride = a->stride();
+    if (cols_B + inner_dim - 1 > stride) {
+        throw invalid_argument("encrypted_matrix_mult: B has too many columns for A's padding");
+    }
 
-            evaluator.rotate_vector_inplace(temp2, -static_cast<int>(j), galois_keys);
-            evaluator.add_inplace(temp, temp2);
+    // Diagonals of B, repeated for every row packed into a ciphertext and
+    // encoded at A's level
+    size_t slot_count = a->slot_count();
+    parms_id_type parms_id = a->ciphertexts()[0].parms_id();
+    vector<Plaintext> diagonals(inner_dim);
+    for (size_t d = 0; d < inner_dim; d++) {
+        vector<double> diag_data(slot_count, 0.0);
+        for (size_t row = 0; row < slot_count / stride; row++) {
+            for (size_t c = 0; c < cols_B; c++) {
+                diag_data[row * stride + c] = plain_B[(c + d) % inner_dim][c];
+            }
         }
-
-        result[i] = temp;
+        encoder.encode(diag_data, parms_id, scale, diagonals[d]);
     }
 
-    return result;
-}
+    // Rotate A, then multiply-accumulate into the result. The rotation
+    // buffer and key-switching temporaries come from this thread's arena.
+    KernelArena& arena = KernelArena::for_this_thread();
+    ArenaScope scope(arena);
+    MemoryPoolHandle pool = arena.pool();
+    Ciphertext& rotated = arena.ciphertext();
 
-// Decrypt and decode result
-vector<vector<double>> decrypt_matrix(
-    const vector<Ciphertext> &encrypted_matrix,
-    Decryptor &decryptor,
-    CKKSEncoder &encoder,
-    size_t row_size) {
+    EncryptedTensor result(a->rows(), cols_B, TensorLayout::RowMajor, slot_count, false, stride);
+    for (size_t i = 0; i < a->size(); i++) {
+        const Ciphertext& packed = a->ciphertexts()[i];
+        Ciphertext& out = result.ciphertexts()[i];
+        multiply_plain_accumulate(context, packed, diagonals[0], out);
 
-    vector<vector<double>> result(encrypted_matrix.size(), vector<double>(row_size));
-    for (size_t i = 0; i < encrypted_matrix.size(); i++) {
-        Plaintext plain;
-        decryptor.decrypt(encrypted_matrix[i], plain);
-        vector<double> decoded;
-        encoder.decode(plain, decoded);
-        for (size_t j = 0; j < row_size; j++)
-            result[i][j] = decoded[j];
+        for (size_t d = 1; d < inner_dim; d++) {
+            evaluator.rotate_vector(packed, static_cast<int>(d), galois_keys, rotated, pool);
+            multiply_plain_accumulate(context, rotated, diagonals[d], out);
+        }
+
+        evaluator.rescale_to_next_inplace(out, pool);
     }
+
     return result;
 }
 
@@ -171,20 +487,20 @@ int main() {
 
     // Encrypt A
     auto t_enc_start = chrono::high_resolution_clock::now();
-    auto encoded_A = encode_matrix(A, encoder, scale);
-    auto encrypted_A = encrypt_matrix(encoded_A, encryptor);
+    // Rows of A share ciphertexts; cyclic padding is the layout the kernel wants
+    auto encrypted_A = EncryptedTensor::encrypt(A, TensorLayout::RowMajor, true, encoder, encryptor, scale);
     auto t_enc_end = chrono::high_resolution_clock::now();
     cout << "Encryption time: " << chrono::duration_cast<chrono::microseconds>(t_enc_end - t_enc_start).count() << " us\n";
 
     // Homomorphic matrix multiplication
     auto t_he_start = chrono::high_resolution_clock::now();
-    auto encrypted_result = encrypted_matrix_mult(encrypted_A, B, encoder, evaluator, relin_keys, galois_keys, scale);
+    auto encrypted_result = encrypted_matrix_mult(context, encrypted_A, B, encoder, evaluator, galois_keys, scale);
     auto t_he_end = chrono::high_resolution_clock::now();
     cout << "HE computation time: " << chrono::duration_cast<chrono::microseconds>(t_he_end - t_he_start).count() << " us\n";
 
     // Decrypt result
     auto t_dec_start = chrono::high_resolution_clock::now();
-    auto he_result = decrypt_matrix(encrypted_result, decryptor, encoder, cols_B);
+    auto he_result = encrypted_result.decrypt(encoder, decryptor);
     auto t_dec_end = chrono::high_resolution_clock::now();
     cout << "Decryption time: " << chrono::duration_cast<chrono::microseconds>(t_dec_end - t_dec_start).count() << " us\n\n";
 
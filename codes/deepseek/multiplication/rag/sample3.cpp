@@ -1,14 +1,73 @@
 #include <iostream>
 #include <vector>
 #include <memory>
+#include <functional>
 #include <thread>
-#include <mutex>
+#include <atomic>
 #include <cmath>
+#include <numeric>
+#include <algorithm>
+#include <deque>
 #include <seal/seal.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 using namespace std;
 using namespace seal;
 
+// Per-worker arena for kernel temporaries: a private SEAL memory pool plus a
+// set of reusable ciphertext/plaintext buffers allocated from it. Pools are
+// passed explicitly to every SEAL call rather than through MMProfGuard, since
+// memory manager profiles are process-wide and would serialize threads.
+// reset() at the end of a kernel hands the buffers back for the next call
+// without freeing them, so steady-state kernels neither contend on the global
+// pool nor fault in fresh pages.
+class KernelArena {
+public:
+    KernelArena() : pool_(MemoryPoolHandle::New()) {}
+
+    MemoryPoolHandle pool() const { return pool_; }
+
+    Ciphertext& ciphertext() {
+        if (next_ciphertext_ == ciphertexts_.size()) {
+            ciphertexts_.emplace_back(pool_);
+        }
+        return ciphertexts_[next_ciphertext_++];
+    }
+
+    Plaintext& plaintext() {
+        if (next_plaintext_ == plaintexts_.size()) {
+            plaintexts_.emplace_back(pool_);
+        }
+        return plaintexts_[next_plaintext_++];
+    }
+
+    void reset() {
+        next_ciphertext_ = 0;
+        next_plaintext_ = 0;
+    }
+
+    size_t bytes_reserved() const { return pool_.alloc_byte_count(); }
+
+private:
+    MemoryPoolHandle pool_;
+    deque<Ciphertext> ciphertexts_; // deque keeps handed-out references stable
+    deque<Plaintext> plaintexts_;
+    size_t next_ciphertext_ = 0;
+    size_t next_plaintext_ = 0;
+};
+
+// Resets the arena when a kernel invocation ends
+class ArenaScope {
+public:
+    explicit ArenaScope(KernelArena& arena) : arena_(arena) {}
+    ~ArenaScope() { arena_.reset(); }
+
+private:
+    KernelArena& arena_;
+};
+
 class ParallelCKKSMultiplier {
 public:
     ParallelCKKSMultiplier(size_t poly_modulus_degree = 8192,
@@ -38,6 +97,12 @@ public:
         scale_ = scale;
         slot_count_ = encoder_->slot_count();
         chunk_size_ = min(static_cast<size_t>(1024), slot_count_);
+
+        // One arena per worker slot, owned here so that the pools and buffers
+        // survive the worker threads and are reused by every call
+        for (size_t t = 0; t < num_threads_; ++t) {
+            arenas_.push_back(make_unique<KernelArena>());
+        }
     }
 
     vector<double> parallel_multiply(const vector<double>& vec1, const vector<double>& vec2) {
@@ -45,62 +110,62 @@ public:
             throw invalid_argument("Vectors must be of equal length");
         }
 
-        const size_t total_size = vec1.size();
-        vector<double> result(total_size, 0.0);
-        mutex result_mutex;
+        vector<double> result(vec1.size());
+        parallel_multiply(vec1.data(), vec2.data(), result.data(), vec1.size());
+        return result;
+    }
+
+    // Streaming mode: reads total_size values from in1/in2 and writes the
+    // products to out. Each chunk is decoded straight into its own disjoint
+    // slice of out, so extra memory is one set of scratch buffers per worker.
+    // Workers use the multiplier's arenas, so calls must not overlap.
+    void parallel_multiply(const double* in1, const double* in2, double* out, size_t total_size) {
+        const size_t num_chunks = (total_size + chunk_size_ - 1) / chunk_size_;
+        atomic<size_t> next_chunk{0};
+
+        // SEAL's encoder, encryptor and evaluator are safe to share across
+        // threads; scratch buffers come from the worker slot's own arena
+        auto process_chunks = [&](KernelArena& arena) {
+            ArenaScope scope(arena);
+            MemoryPoolHandle pool = arena.pool();
 
-        // Parallel vector processing
-        auto process_range = [&](size_t start, size_t end) {
-            vector<double> local_result(total_size, 0.0);
             Decryptor thread_decryptor(*context_, secret_key_); // Thread-local decryptor
+            vector<double> staging(slot_count_, 0.0);
+            vector<double> decoded;
+            Plaintext& plain = arena.plaintext();
+            Ciphertext& ct1 = arena.ciphertext();
+            Ciphertext& ct2 = arena.ciphertext();
 
-            for (size_t i = start; i < end; i += chunk_size_) {
-                size_t current_chunk_size = min(chunk_size_, total_size - i);
+            for (size_t c = next_chunk++; c < num_chunks; c = next_chunk++) {
+                size_t start = c * chunk_size_;
+                size_t current_chunk_size = min(chunk_size_, total_size - start);
                 
                 // Process chunks
-                auto ct1 = process_chunk(vec1, i, current_chunk_size);
-                auto ct2 = process_chunk(vec2, i, current_chunk_size);
+                process_chunk(in1 + start, current_chunk_size, staging, plain, ct1, pool);
+                process_chunk(in2 + start, current_chunk_size, staging, plain, ct2, pool);
                 
-                // Multiply (serial within thread)
-                Ciphertext product;
-                {
-                    lock_guard<mutex> lock(eval_mutex_);
-                    evaluator_->multiply(ct1, ct2, product);
-                    evaluator_->relinearize_inplace(product, relin_keys_);
-                    evaluator_->rescale_to_next_inplace(product);
-                }
+                // Multiply in place; no shared evaluator lock is needed
+                evaluator_->multiply_inplace(ct1, ct2, pool);
+                evaluator_->relinearize_inplace(ct1, relin_keys_, pool);
+                evaluator_->rescale_to_next_inplace(ct1, pool);
                 
-                // Decrypt and decode
-                vector<double> chunk_result = decrypt_and_decode(product, thread_decryptor, current_chunk_size);
-                
-                // Store results
-                copy(chunk_result.begin(), chunk_result.end(), local_result.begin() + i);
+                // Decrypt and decode into this chunk's slice of the output
+                decrypt_and_decode(ct1, thread_decryptor, plain, decoded,
+                                   out + start, current_chunk_size, pool);
             }
-            
-            // Aggregate results
-            lock_guard<mutex> lock(result_mutex);
-            transform(result.begin(), result.end(), local_result.begin(), result.begin(), plus<double>());
         };
 
         // Distribute work across threads
         vector<thread> threads;
-        size_t chunk = (total_size + num_threads_ - 1) / num_threads_;
-        chunk = ((chunk + chunk_size_ - 1) / chunk_size_) * chunk_size_; // Align to chunk boundaries
-
-        for (size_t t = 0; t < num_threads_; ++t) {
-            size_t start = t * chunk;
-            size_t end = min(start + chunk, total_size);
-            if (start < total_size) {
-                threads.emplace_back(process_range, start, end);
-            }
+        size_t thread_count = min(num_threads_, num_chunks);
+        for (size_t t = 0; t < thread_count; ++t) {
+            threads.emplace_back(process_chunks, ref(*arenas_[t]));
         }
 
         // Wait for threads to complete
         for (auto& t : threads) {
             t.join();
         }
-
-        return result;
     }
 
 private:
@@ -111,35 +176,29 @@ private:
     shared_ptr<CKKSEncoder> encoder_;
     shared_ptr<Encryptor> encryptor_;
     shared_ptr<Evaluator> evaluator_;
-    mutex eval_mutex_;
     
     double scale_;
     size_t chunk_size_;
     size_t slot_count_;
     size_t num_threads_;
+    vector<unique_ptr<KernelArena>> arenas_;
 
-    Ciphertext process_chunk(const vector<double>& vec, size_t start, size_t length) {
-        vector<double> chunk(slot_count_, 0.0);
-        copy(vec.begin() + start, vec.begin() + start + length, chunk.begin());
-        
-        Plaintext plain;
-        encoder_->encode(chunk, scale_, plain);
-        
-        Ciphertext cipher;
-        encryptor_->encrypt(plain, cipher);
-        
-        return cipher;
+    // Zero-pads the chunk in the caller's staging buffer, then encrypts it
+    void process_chunk(const double* src, size_t length, vector<double>& staging,
+                       Plaintext& plain, Ciphertext& cipher, MemoryPoolHandle pool) {
+        copy(src, src + length, staging.begin());
+        fill(staging.begin() + length, staging.end(), 0.0);
+        
+        encoder_->encode(staging, scale_, plain, pool);
+        encryptor_->encrypt(plain, cipher, pool);
     }
 
-    vector<double> decrypt_and_decode(const Ciphertext& cipher, Decryptor& decryptor, size_t output_length) {
-        Plaintext plain;
+    void decrypt_and_decode(const Ciphertext& cipher, Decryptor& decryptor, Plaintext& plain,
+                            vector<double>& decoded, double* dest, size_t output_length,
+                            MemoryPoolHandle pool) {
         decryptor.decrypt(cipher, plain);
-        
-        vector<double> result;
-        encoder_->decode(plain, result);
-        result.resize(output_length);
-        
-        return result;
+        encoder_->decode(plain, decoded, pool);
+        copy(decoded.begin(), decoded.begin() + output_length, dest);
     }
 };
 
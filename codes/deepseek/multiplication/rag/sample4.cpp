@@ -1,16 +1,34 @@
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
 #include <seal/seal.h>
 
 using namespace std;
 using namespace seal;
 
+// High-precision multiplication with multi-limb fixed point. Every value is
+// quantized to an integer X = round(x * 2^fractional_bits) and split into
+// limb_count signed digits of limb_bits each, one ciphertext per digit. Limb
+// products are small integers, so CKKS computes them with an error far below
+// 0.5; rounding after decryption recovers them exactly and the carries are
+// normalized in 128-bit integer arithmetic. Cross terms use the Karatsuba
+// identity a_i*b_j + a_j*b_i = (a_i + a_j)(b_i + b_j) - a_i*b_i - a_j*b_j, so
+// L limbs cost L(L+1)/2 ciphertext multiplications instead of L^2.
+// Limb sums must stay below q_0 * q_1 / scale^2 before the rescale; the
+// defaults (6 x 8-bit limbs at scale 2^40 with {60, 40, 60}) keep them under
+// 2^18 and give 48-bit fixed point for |x| < 2^11.
 class CKKSKaratsubaMultiplier {
 public:
     CKKSKaratsubaMultiplier(size_t poly_modulus_degree = 8192,
-                          vector<int> bit_sizes = {40, 30, 30, 40},
-                          double scale = pow(2.0, 30)) {
+                          vector<int> bit_sizes = {60, 40, 60},
+                          double scale = pow(2.0, 40),
+                          int limb_bits = 8,
+                          int limb_count = 6,
+                          int fractional_bits = 36)
+        : limb_bits_(limb_bits), limb_count_(limb_count), fractional_bits_(fractional_bits) {
         // 1. Set up encryption parameters
         EncryptionParameters params(scheme_type::ckks);
         params.set_poly_modulus_degree(poly_modulus_degree);
@@ -24,6 +42,9 @@ public:
         if (!context_->parameters_set()) {
             throw runtime_error("Invalid encryption parameters");
         }
+        if (2 * limb_bits_ * limb_count_ > 120) {
+            throw invalid_argument("Limb configuration overflows 128-bit carry normalization");
+        }
         
         // 4. Generate keys
         KeyGenerator keygen(*context_);
@@ -40,61 +61,129 @@ public:
         scale_ = scale;
         slot_count_ = encoder_->slot_count();
         
-        cout << "Initialized CKKS with " << slot_count_ << " slots" << endl;
+        cout << "Initialized CKKS with " << slot_count_ << " slots, "
+             << limb_count_ << " limbs of " << limb_bits_ << " bits" << endl;
     }
 
-    vector<double> multiply(double a, double b) {
-        // 1. Karatsuba decomposition
-        auto [a1, a2] = decompose(a);
-        auto [b1, b2] = decompose(b);
-        
-        // 2. Encode and encrypt components
-        vector<double> a_vec = {a1, a2};
-        vector<double> b_vec = {b1, b2};
-        
-        Plaintext a_plain, b_plain;
-        encoder_->encode(a_vec, scale_, a_plain);
-        encoder_->encode(b_vec, scale_, b_plain);
-        
-        Ciphertext a_ct, b_ct;
-        encryptor_->encrypt(a_plain, a_ct);
-        encryptor_->encrypt(b_plain, b_ct);
-        
-        // 3. Compute intermediate products
-        Ciphertext z0, z1, z2;
-        evaluator_->multiply(a_ct, b_ct, z0);  // a1*b1
-        evaluator_->relinearize_inplace(z0, relin_keys_);
-        evaluator_->rescale_to_next_inplace(z0);
-        
-        evaluator_->multiply(a_ct, b_ct, z1);  // a1*b2 + a2*b1
-        evaluator_->relinearize_inplace(z1, relin_keys_);
-        evaluator_->rescale_to_next_inplace(z1);
-        
-        evaluator_->multiply(a_ct, b_ct, z2);  // a2*b2
-        evaluator_->relinearize_inplace(z2, relin_keys_);
-        evaluator_->rescale_to_next_inplace(z2);
-        
-        // 4. Combine results
-        Ciphertext result;
-        evaluator_->add(z0, z1, result);
-        evaluator_->add_inplace(result, z2);
-        
-        // 5. Decrypt and decode
-        Plaintext result_plain;
-        decryptor_->decrypt(result, result_plain);
-        
-        vector<double> result_vec;
-        encoder_->decode(result_plain, result_vec);
-        
-        return result_vec;
+    double multiply(double a, double b) {
+        return multiply(vector<double>{a}, vector<double>{b})[0];
+    }
+
+    // Slot-wise product of up to slot_count values
+    vector<double> multiply(const vector<double>& a, const vector<double>& b) {
+        if (a.size() != b.size() || a.size() > slot_count_) {
+            throw invalid_argument("Inputs must have equal length of at most slot_count");
+        }
+        auto a_limbs = encrypt_limbs(a);
+        auto b_limbs = encrypt_limbs(b);
+        auto product_limbs = multiply_limbs(a_limbs, b_limbs);
+        return decrypt_product(product_limbs, a.size());
+    }
+
+    vector<Ciphertext> encrypt_limbs(const vector<double>& values) {
+        vector<vector<double>> digits(limb_count_, vector<double>(values.size()));
+        for (size_t s = 0; s < values.size(); s++) {
+            auto limbs = decompose(values[s]);
+            for (int k = 0; k < limb_count_; k++) {
+                digits[k][s] = static_cast<double>(limbs[k]);
+            }
+        }
+
+        vector<Ciphertext> limbs(limb_count_);
+        for (int k = 0; k < limb_count_; k++) {
+            Plaintext plain;
+            encoder_->encode(digits[k], scale_, plain);
+            encryptor_->encrypt(plain, limbs[k]);
+        }
+        return limbs;
+    }
+
+    // Returns 2L-1 product limbs; limb m carries weight 2^(limb_bits * m)
+    vector<Ciphertext> multiply_limbs(const vector<Ciphertext>& a, const vector<Ciphertext>& b) {
+        vector<Ciphertext> diagonal(limb_count_);
+        for (int i = 0; i < limb_count_; i++) {
+            multiply_rescale(a[i], b[i], diagonal[i]);
+        }
+
+        vector<Ciphertext> product(2 * limb_count_ - 1);
+        vector<bool> has_term(product.size(), false);
+        auto accumulate_term = [&](size_t m, const Ciphertext& term) {
+            if (has_term[m]) {
+                evaluator_->add_inplace(product[m], term);
+            } else {
+                product[m] = term;
+                has_term[m] = true;
+            }
+        };
+
+        for (int i = 0; i < limb_count_; i++) {
+            accumulate_term(2 * i, diagonal[i]);
+        }
+        for (int i = 0; i < limb_count_; i++) {
+            for (int j = i + 1; j < limb_count_; j++) {
+                Ciphertext a_sum, b_sum, cross;
+                evaluator_->add(a[i], a[j], a_sum);
+                evaluator_->add(b[i], b[j], b_sum);
+                multiply_rescale(a_sum, b_sum, cross);
+                evaluator_->sub_inplace(cross, diagonal[i]);
+                evaluator_->sub_inplace(cross, diagonal[j]);
+                accumulate_term(i + j, cross);
+            }
+        }
+        return product;
+    }
+
+    vector<double> decrypt_product(const vector<Ciphertext>& product, size_t count) {
+        vector<__int128> accumulated(count, 0);
+        for (size_t m = 0; m < product.size(); m++) {
+            Plaintext plain;
+            decryptor_->decrypt(product[m], plain);
+            vector<double> limb;
+            encoder_->decode(plain, limb);
+
+            // Limb products are exact integers; rounding removes the CKKS error
+            __int128 weight = static_cast<__int128>(1) << (limb_bits_ * m);
+            for (size_t s = 0; s < count; s++) {
+                accumulated[s] += static_cast<__int128>(llround(limb[s])) * weight;
+            }
+        }
+
+        vector<double> result(count);
+        for (size_t s = 0; s < count; s++) {
+            result[s] = static_cast<double>(ldexpl(static_cast<long double>(accumulated[s]),
+                                                   -2 * fractional_bits_));
+        }
+        return result;
     }
 
 private:
-    pair<double, double> decompose(double num) {
-        double base = pow(10.0, floor(log10(abs(num))/2));
-        double high = floor(num / base);
-        double low = num - high * base;
-        return {high, low};
+    // Balanced base-2^limb_bits digits of round(num * 2^fractional_bits)
+    vector<int64_t> decompose(double num) {
+        long double fixed = ldexpl(static_cast<long double>(num), fractional_bits_);
+        long double limit = ldexpl(1.0L, limb_bits_ * limb_count_ - 1);
+        if (fabsl(fixed) >= limit) {
+            throw out_of_range("Value exceeds multi-limb fixed-point range");
+        }
+
+        int64_t x = llroundl(fixed);
+        const int64_t base = int64_t(1) << limb_bits_;
+        vector<int64_t> limbs(limb_count_);
+        for (int k = 0; k < limb_count_; k++) {
+            int64_t digit = x & (base - 1);
+            if (digit >= base / 2) {
+                digit -= base;
+            }
+            limbs[k] = digit;
+            x = (x - digit) / base;
+        }
+        limbs[limb_count_ - 1] += x * base; // Top limb absorbs any remainder
+        return limbs;
+    }
+
+    void multiply_rescale(const Ciphertext& a, const Ciphertext& b, Ciphertext& result) {
+        evaluator_->multiply(a, b, result);
+        evaluator_->relinearize_inplace(result, relin_keys_);
+        evaluator_->rescale_to_next_inplace(result);
     }
 
     shared_ptr<SEALContext> context_;
@@ -107,8 +196,70 @@ private:
     unique_ptr<Evaluator> evaluator_;
     double scale_;
     size_t slot_count_;
+    int limb_bits_;
+    int limb_count_;
+    int fractional_bits_;
+};
+
+// Baseline: one ciphertext per operand with the largest scale that still
+// leaves room for the product's integer bits in a 60-bit first prime. Keys
+// are generated in the constructor so multiply() times only the arithmetic,
+// as CKKSKaratsubaMultiplier::multiply does.
+class WideScaleMultiplier {
+public:
+    WideScaleMultiplier(size_t poly_modulus_degree, vector<int> bit_sizes, double scale)
+        : scale_(scale) {
+        EncryptionParameters params(scheme_type::ckks);
+        params.set_poly_modulus_degree(poly_modulus_degree);
+        params.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, bit_sizes));
+        context_ = make_shared<SEALContext>(params);
+        KeyGenerator keygen(*context_);
+        PublicKey public_key;
+        keygen.create_public_key(public_key);
+        keygen.create_relin_keys(relin_keys_);
+        encoder_ = make_unique<CKKSEncoder>(*context_);
+        encryptor_ = make_unique<Encryptor>(*context_, public_key);
+        evaluator_ = make_unique<Evaluator>(*context_);
+        decryptor_ = make_unique<Decryptor>(*context_, keygen.secret_key());
+    }
+
+    vector<double> multiply(const vector<double>& a, const vector<double>& b) {
+        Plaintext a_plain, b_plain, result_plain;
+        encoder_->encode(a, scale_, a_plain);
+        encoder_->encode(b, scale_, b_plain);
+        Ciphertext a_ct, b_ct;
+        encryptor_->encrypt(a_plain, a_ct);
+        encryptor_->encrypt(b_plain, b_ct);
+        evaluator_->multiply_inplace(a_ct, b_ct);
+        evaluator_->relinearize_inplace(a_ct, relin_keys_);
+        evaluator_->rescale_to_next_inplace(a_ct);
+        decryptor_->decrypt(a_ct, result_plain);
+        vector<double> result;
+        encoder_->decode(result_plain, result);
+        result.resize(a.size());
+        return result;
+    }
+
+private:
+    shared_ptr<SEALContext> context_;
+    RelinKeys relin_keys_;
+    unique_ptr<CKKSEncoder> encoder_;
+    unique_ptr<Encryptor> encryptor_;
+    unique_ptr<Decryptor> decryptor_;
+    unique_ptr<Evaluator> evaluator_;
+    double scale_;
 };
 
+double precision_bits(const vector<double>& a, const vector<double>& b, const vector<double>& result) {
+    double max_rel_error = 0.0;
+    for (size_t i = 0; i < a.size(); i++) {
+        long double expected = static_cast<long double>(a[i]) * b[i];
+        max_rel_error = max(max_rel_error,
+                            static_cast<double>(fabsl((result[i] - expected) / expected)));
+    }
+    return max_rel_error > 0.0 ? -log2(max_rel_error) : 53.0;
+}
+
 int main() {
     try {
         CKKSKaratsubaMultiplier multiplier;
@@ -116,17 +267,40 @@ int main() {
         double a = 123.456;
         double b = 789.012;
         
-        auto result = multiplier.multiply(a, b);
+        double result = multiplier.multiply(a, b);
         
-        cout << "Result components: ";
-        for (auto val : result) {
-            cout << val << " ";
-        }
+        cout.precision(15);
+        cout << "Result: " << result;
         cout << "\nExpected: " << a * b << endl;
+
+        // Benchmark against a single ciphertext with a wider scale and N; both
+        // sides are timed without context and key generation
+        vector<double> va(1024), vb(1024);
+        for (size_t i = 0; i < va.size(); i++) {
+            va[i] = 1000.0 + 0.123456789 * i;
+            vb[i] = 250.0 - 0.0987654321 * i;
+        }
+
+        auto start = chrono::high_resolution_clock::now();
+        auto limb_result = multiplier.multiply(va, vb);
+        double limb_ms = chrono::duration<double, milli>(
+            chrono::high_resolution_clock::now() - start).count();
+
+        WideScaleMultiplier wide_multiplier(16384, {60, 40, 60}, pow(2.0, 40));
+        start = chrono::high_resolution_clock::now();
+        auto wide_result = wide_multiplier.multiply(va, vb);
+        double wide_ms = chrono::duration<double, milli>(
+            chrono::high_resolution_clock::now() - start).count();
+
+        cout.precision(4);
+        cout << "\nMulti-limb (N=8192, 6x8-bit limbs): "
+             << precision_bits(va, vb, limb_result) << " bits, " << limb_ms << " ms" << endl;
+        cout << "Wide scale (N=16384, scale 2^40):  "
+             << precision_bits(va, vb, wide_result) << " bits, " << wide_ms << " ms" << endl;
         
     } catch (const exception& e) {
         cerr << "Error: " << e.what() << endl;
         return 1;
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -7,22 +7,193 @@
 #include <mutex>
 #include <algorithm>
 #include <numeric>
+#include <cmath>
+#include <stdexcept>
 
 using namespace std;
 using namespace seal;
 
 mutex cout_mutex;
 
+// Circuit-aware parameter planner: picks the smallest N and modulus chain that
+// fit the circuit at the requested security level, then confirms the estimate
+// by running a short calibration of the circuit's multiplications and rotations.
+struct CircuitDescription {
+    int multiplicative_depth = 1;
+    int modulus_switches = 0;  // Primes dropped by mod switches, beyond the rescales
+    vector<int> rotation_steps;
+    int precision_bits = 20;   // Required bits after the last operation
+    int integer_bits = 4;      // Bits needed for |value| before the binary point
+    size_t slot_demand = 1;
+};
+
+struct ParameterPlan {
+    size_t poly_modulus_degree = 0;
+    vector<int> moduli_bits;
+    int scale_bits = 0;
+    double measured_precision_bits = 0.0;
+    double calibration_ms = 0.0;
+};
+
+class CKKSParameterPlanner {
+private:
+    sec_level_type security;
+    bool run_calibration;
+
+    // log2 of the rescale rounding error for a ternary secret (HEAAN bound)
+    static double rounding_error_bits(size_t n) {
+        double h = 2.0 * n / 3.0;
+        return log2(sqrt(n / 3.0) * (3.0 + 8.0 * sqrt(h)));
+    }
+
+    double calibrate(const ParameterPlan& plan, const CircuitDescription& circuit,
+                     double& elapsed_ms) const {
+        EncryptionParameters parms(scheme_type::ckks);
+        parms.set_poly_modulus_degree(plan.poly_modulus_degree);
+        parms.set_coeff_modulus(CoeffModulus::Create(plan.poly_modulus_degree, plan.moduli_bits));
+        SEALContext context(parms, true, security);
+        if (!context.parameters_set()) {
+            return 0.0;
+        }
+
+        KeyGenerator keygen(context);
+        PublicKey public_key;
+        keygen.create_public_key(public_key);
+        RelinKeys relin_keys;
+        keygen.create_relin_keys(relin_keys);
+        GaloisKeys gal_keys;
+        if (!circuit.rotation_steps.empty()) {
+            keygen.create_galois_keys(circuit.rotation_steps, gal_keys);
+        }
+        CKKSEncoder encoder(context);
+        Encryptor encryptor(context, public_key);
+        Evaluator evaluator(context);
+        Decryptor decryptor(context, keygen.secret_key());
+
+        size_t slots = encoder.slot_count();
+        vector<double> expected(slots);
+        for (size_t i = 0; i < slots; i++) {
+            expected[i] = sin(0.01 * static_cast<double>(i));
+        }
+        Plaintext plain;
+        encoder.encode(expected, pow(2.0, plan.scale_bits), plain);
+        Ciphertext cipher;
+        encryptor.encrypt(plain, cipher);
+
+        auto start = chrono::high_resolution_clock::now();
+        for (int d = 0; d < circuit.multiplicative_depth; d++) {
+            evaluator.square_inplace(cipher);
+            evaluator.relinearize_inplace(cipher, relin_keys);
+            evaluator.rescale_to_next_inplace(cipher);
+            for (auto& v : expected) v *= v;
+        }
+        for (int s = 0; s < circuit.modulus_switches; s++) {
+            evaluator.mod_switch_to_next_inplace(cipher);
+        }
+        for (int step : circuit.rotation_steps) {
+            evaluator.rotate_vector_inplace(cipher, step, gal_keys);
+            size_t shift = static_cast<size_t>((step % static_cast<int>(slots) + slots) % slots);
+            rotate(expected.begin(), expected.begin() + shift, expected.end());
+        }
+        elapsed_ms = chrono::duration<double, milli>(
+            chrono::high_resolution_clock::now() - start).count();
+
+        decryptor.decrypt(cipher, plain);
+        vector<double> decoded;
+        encoder.decode(plain, decoded);
+        double max_error = 0.0;
+        for (size_t i = 0; i < slots; i++) {
+            max_error = max(max_error, fabs(decoded[i] - expected[i]));
+        }
+        return max_error > 0.0 ? -log2(max_error) : 64.0;
+    }
+
+public:
+    explicit CKKSParameterPlanner(sec_level_type security = sec_level_type::tc128,
+                                  bool run_calibration = true)
+        : security(security), run_calibration(run_calibration) {}
+
+    ParameterPlan plan(const CircuitDescription& circuit) const {
+        int max_step = 0;
+        for (int step : circuit.rotation_steps) {
+            max_step = max(max_step, abs(step));
+        }
+
+        for (size_t n = 2048; n <= 32768; n *= 2) {
+            if (n / 2 < circuit.slot_demand || static_cast<size_t>(max_step) >= n / 2) {
+                continue;
+            }
+            int max_bits = CoeffModulus::MaxBitCount(n, security);
+
+            // Calibration may show the estimate was optimistic; widen the scale
+            for (int extra_bits = 0; extra_bits < 4; extra_bits++) {
+                int scale_bits = circuit.precision_bits
+                               + static_cast<int>(ceil(rounding_error_bits(n)
+                                                       + log2(circuit.multiplicative_depth + 1.0)))
+                               + extra_bits;
+                int first_bits = scale_bits + circuit.integer_bits + 1;
+                if (first_bits > 60) {
+                    break;
+                }
+
+                ParameterPlan candidate;
+                candidate.poly_modulus_degree = n;
+                candidate.scale_bits = scale_bits;
+                candidate.moduli_bits.push_back(first_bits);
+                // A switched-away prime may be dropped where a rescale would
+                // otherwise land, so it is sized like the scale primes
+                for (int d = 0; d < circuit.multiplicative_depth + circuit.modulus_switches; d++) {
+                    candidate.moduli_bits.push_back(scale_bits);
+                }
+                candidate.moduli_bits.push_back(first_bits); // Special prime for key switching
+
+                int total_bits = 0;
+                for (int bits : candidate.moduli_bits) total_bits += bits;
+                if (total_bits > max_bits) {
+                    break;
+                }
+
+                try {
+                    if (!run_calibration) {
+                        candidate.measured_precision_bits = scale_bits - rounding_error_bits(n);
+                        return candidate;
+                    }
+                    candidate.measured_precision_bits = calibrate(candidate, circuit, candidate.calibration_ms);
+                } catch (const exception&) {
+                    break; // Not enough NTT-friendly primes of these sizes for this N
+                }
+                if (candidate.measured_precision_bits >= circuit.precision_bits) {
+                    return candidate;
+                }
+            }
+        }
+        throw invalid_argument("No CKKS parameters satisfy the circuit at this security level");
+    }
+};
+
+// Encryption parameters are filled in by plan_config() from the circuit
 struct SystemConfig {
-    size_t poly_modulus_degree = 8192;  // Reduced from 16384 for better performance
-    vector<int> bit_sizes = {50, 40, 40, 50};  // Adjusted primes
+    CircuitDescription circuit;
+    sec_level_type security = sec_level_type::tc128;
+    size_t poly_modulus_degree = 0;
+    vector<int> bit_sizes;
     size_t batch_size = 4;
     size_t num_modulus_levels = 3;
     size_t num_threads = thread::hardware_concurrency();
     size_t large_data_threshold = 1000000;
-    double scale = pow(2.0, 40);
+    double scale = 0.0;
 };
 
+void plan_config(SystemConfig& config) {
+    ParameterPlan plan = CKKSParameterPlanner(config.security).plan(config.circuit);
+    config.poly_modulus_degree = plan.poly_modulus_degree;
+    config.bit_sizes = plan.moduli_bits;
+    config.num_modulus_levels = plan.moduli_bits.size() - 1;
+    config.scale = pow(2.0, plan.scale_bits);
+    cout << "Planned N = " << plan.poly_modulus_degree << ", scale 2^" << plan.scale_bits
+         << ", calibrated precision " << plan.measured_precision_bits << " bits" << endl;
+}
+
 struct ValidationResult {
     vector<double> plain_result;
     vector<double> decrypted_result;
@@ -51,7 +222,7 @@ unique_ptr<SEALContext> create_context(const SystemConfig& config) {
     parms.set_coeff_modulus(CoeffModulus::Create(
         config.poly_modulus_degree, config.bit_sizes));
     
-    return make_unique<SEALContext>(parms, true, sec_level_type::tc128);
+    return make_unique<SEALContext>(parms, true, config.security);
 }
 
 vector<vector<double>> create_batch_data(size_t total_elements, size_t batch_size) {
@@ -125,7 +296,12 @@ void encrypted_multiply(
 
 int main() {
     try {
+        // One ciphertext multiplication over four slots
         SystemConfig config;
+        config.circuit.multiplicative_depth = 1;
+        config.circuit.precision_bits = 20;
+        config.circuit.slot_demand = config.batch_size;
+        plan_config(config);
         
         // Create context
         auto context = create_context(config);
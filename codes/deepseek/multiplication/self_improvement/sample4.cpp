@@ -6,7 +6,12 @@
 #include <mutex>
 #include <thread>
 #include <random>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
 #include <seal/seal.h>
+#include <seal/util/polyarithsmallmod.h>
+#include <seal/util/uintarithsmallmod.h>
 
 using namespace std;
 using namespace seal;
@@ -73,6 +78,71 @@ auto measure_time(Func&& f, const string& operation_name) {
     return make_pair(result, duration);
 }
 
+// Multiplies every RNS limb of every ciphertext polynomial by an integer
+// constant. Scalar multiplication commutes with the NTT, so this works on NTT
+// form directly: no encoding, no plaintext, no scale change and no level used.
+void multiply_integer_inplace(Ciphertext& encrypted, int64_t factor, const SEALContext& context) {
+    auto context_data = context.get_context_data(encrypted.parms_id());
+    if (!context_data) {
+        throw invalid_argument("Ciphertext is not valid for this context");
+    }
+    const auto& coeff_modulus = context_data->parms().coeff_modulus();
+    const size_t coeff_count = encrypted.poly_modulus_degree();
+    const uint64_t magnitude = factor < 0 ? 0 - static_cast<uint64_t>(factor) : static_cast<uint64_t>(factor);
+
+    // Reduce the factor and precompute its Barrett quotient once per prime;
+    // the per-coefficient products then need no division.
+    vector<util::MultiplyUIntModOperand> scalars(coeff_modulus.size());
+    for (size_t i = 0; i < coeff_modulus.size(); i++) {
+        uint64_t scalar = magnitude % coeff_modulus[i].value();
+        if (factor < 0) {
+            scalar = util::negate_uint_mod(scalar, coeff_modulus[i]);
+        }
+        scalars[i].set(scalar, coeff_modulus[i]);
+    }
+
+    for (size_t j = 0; j < encrypted.size(); j++) {
+        uint64_t* poly = encrypted.data(j);
+        for (size_t i = 0; i < coeff_modulus.size(); i++) {
+            uint64_t* limb = poly + i * coeff_count;
+            util::multiply_poly_scalar_coeffmod(limb, coeff_count, scalars[i], coeff_modulus[i], limb);
+        }
+    }
+}
+
+// Adds a real constant to every slot without encoding. A constant encodes to
+// the constant polynomial round(value * scale), whose NTT is that same value
+// at every point, so it is added to all coefficients of c_0 in NTT form.
+void add_constant_inplace(Ciphertext& encrypted, double value, const SEALContext& context) {
+    auto context_data = context.get_context_data(encrypted.parms_id());
+    if (!context_data) {
+        throw invalid_argument("Ciphertext is not valid for this context");
+    }
+    long double scaled = roundl(static_cast<long double>(value) * encrypted.scale());
+    if (fabsl(scaled) >= ldexpl(1.0L, 63)) {
+        throw invalid_argument("Constant is too large for the ciphertext scale");
+    }
+    const int64_t constant = static_cast<int64_t>(scaled);
+    const uint64_t magnitude = constant < 0 ? 0 - static_cast<uint64_t>(constant) : static_cast<uint64_t>(constant);
+    const auto& coeff_modulus = context_data->parms().coeff_modulus();
+    const size_t coeff_count = encrypted.poly_modulus_degree();
+    const size_t touched = encrypted.is_ntt_form() ? coeff_count : 1;
+
+    uint64_t* c0 = encrypted.data(0);
+    for (size_t i = 0; i < coeff_modulus.size(); i++) {
+        const uint64_t q = coeff_modulus[i].value();
+        uint64_t term = magnitude % q;
+        if (constant < 0 && term != 0) {
+            term = q - term;
+        }
+        uint64_t* limb = c0 + i * coeff_count;
+        for (size_t k = 0; k < touched; k++) {
+            uint64_t sum = limb[k] + term;
+            limb[k] = sum >= q ? sum - q : sum;
+        }
+    }
+}
+
 int main() {
     const size_t num_threads = thread::hardware_concurrency();
     safe_print("System supports up to " + to_string(num_threads) + " concurrent threads");
@@ -124,8 +194,6 @@ int main() {
     auto secret_key = keygen.secret_key();
     PublicKey public_key;
     keygen.create_public_key(public_key);
-    RelinKeys relin_keys;
-    keygen.create_relin_keys(relin_keys);
     
     Encryptor encryptor(context, public_key);
     Evaluator evaluator(context);
@@ -158,16 +226,9 @@ int main() {
     
     measure_time(
         [&]() {
-            Plaintext plain_one;
-            encoder.encode(1.0, scale, plain_one);
-            evaluator.add_plain_inplace(encrypted_vec, plain_one);
-            
-            Plaintext plain_two;
-            encoder.encode(2.0, scale, plain_two);
-            evaluator.multiply_plain_inplace(encrypted_vec, plain_two);
-            
-            evaluator.relinearize_inplace(encrypted_vec, relin_keys);
-            evaluator.rescale_to_next_inplace(encrypted_vec);
+            // (x + 1) * 2 on the RNS limbs: no encodes, no rescale, level kept
+            add_constant_inplace(encrypted_vec, 1.0, context);
+            multiply_integer_inplace(encrypted_vec, 2, context);
             
             encrypted_result = encrypted_vec;
             return 0;
@@ -188,6 +249,9 @@ int main() {
         "Decryption and decoding"
     );
     
+    safe_print("Result level: " + to_string(context.get_context_data(encrypted_result.parms_id())->chain_index())
+               + " (input level " + to_string(context.first_context_data()->chain_index()) + ")");
+    
     safe_print("\nFirst 5 elements of the result:");
     for (size_t i = 0; i < min(static_cast<size_t>(5), result.size()); ++i) {
         safe_print("Element " + to_string(i) + ": " + to_string(result[i]));
@@ -5,6 +5,114 @@
 using namespace std;
 using namespace seal;
 
+// Evaluator wrapper that aligns levels and scales at the point an operation
+// needs it. The higher-level operand is brought down lazily: a rescale is used
+// when it also moves the scale toward the other operand, otherwise primes are
+// simply dropped. Scales that differ only by rounding drift are treated as equal.
+class AligningEvaluator
+{
+public:
+    AligningEvaluator(const SEALContext &context, Evaluator &evaluator, double max_scale_drift = 1e-4)
+        : context_(context), evaluator_(evaluator), max_scale_drift_(max_scale_drift)
+    {
+    }
+
+    size_t level(const Ciphertext &ct) const
+    {
+        return context_.get_context_data(ct.parms_id())->chain_index();
+    }
+
+    // Bring ct down to target_level using the cheapest step for each prime
+    void lower_to(Ciphertext &ct, size_t target_level, double target_scale) const
+    {
+        while (level(ct) > target_level)
+        {
+            auto context_data = context_.get_context_data(ct.parms_id());
+            double last_prime = static_cast<double>(context_data->parms().coeff_modulus().back().value());
+            double keep_gap = fabs(log2(ct.scale() / target_scale));
+            double rescale_gap = fabs(log2(ct.scale() / last_prime / target_scale));
+            if (rescale_gap < keep_gap)
+            {
+                evaluator_.rescale_to_next_inplace(ct);
+            }
+            else
+            {
+                // Dropping primes is free of NTTs in CKKS, so drop all at once
+                auto target = context_data;
+                while (target->chain_index() > target_level)
+                    target = target->next_context_data();
+                evaluator_.mod_switch_to_inplace(ct, target->parms_id());
+            }
+        }
+    }
+
+    void match_scale(Ciphertext &ct, double target_scale) const
+    {
+        if (ct.scale() == target_scale)
+            return;
+        if (fabs(ct.scale() / target_scale - 1.0) > max_scale_drift_)
+            throw invalid_argument("AligningEvaluator: operand scales differ beyond tolerance");
+        ct.scale() = target_scale;
+    }
+
+    // Aligns a in place; b is only copied when it is the one that must move
+    void add_inplace(Ciphertext &a, const Ciphertext &b) const
+    {
+        if (level(a) > level(b))
+            lower_to(a, level(b), b.scale());
+        if (level(b) > level(a))
+        {
+            Ciphertext b_aligned = b;
+            lower_to(b_aligned, level(a), a.scale());
+            match_scale(a, b_aligned.scale());
+            evaluator_.add_inplace(a, b_aligned);
+            return;
+        }
+        match_scale(a, b.scale());
+        evaluator_.add_inplace(a, b);
+    }
+
+    void multiply_inplace(Ciphertext &a, const Ciphertext &b) const
+    {
+        if (level(a) > level(b))
+            lower_to(a, level(b), b.scale());
+        if (level(b) > level(a))
+        {
+            Ciphertext b_aligned = b;
+            lower_to(b_aligned, level(a), a.scale());
+            evaluator_.multiply_inplace(a, b_aligned);
+            return;
+        }
+        evaluator_.multiply_inplace(a, b);
+    }
+
+    // Encode at exactly ct's level: the encoder's NTTs run over ct's primes
+    // only and the plaintext carries no limbs that would be dropped later
+    void encode_at(const CKKSEncoder &encoder, double value, const Ciphertext &ct, double scale,
+                   Plaintext &pt) const
+    {
+        encoder.encode(value, ct.parms_id(), scale, pt);
+    }
+
+    // Plaintexts encoded at a higher level just drop their extra primes
+    void multiply_plain_inplace(Ciphertext &ct, const Plaintext &pt) const
+    {
+        if (pt.parms_id() == ct.parms_id())
+        {
+            evaluator_.multiply_plain_inplace(ct, pt);
+            return;
+        }
+        Plaintext pt_aligned;
+        evaluator_.mod_switch_to(pt, ct.parms_id(), pt_aligned);
+        evaluator_.multiply_plain_inplace(ct, pt_aligned);
+    }
+
+private:
+    const SEALContext &context_;
+    Evaluator &evaluator_;
+    double max_scale_drift_;
+};
+
 int main() {
     EncryptionParameters parms(scheme_type::ckks);
     parms.set_poly_modulus_degree(8192);
@@ -23,6 +131,7 @@ int main() {
     Encryptor encryptor(context, public_key);
     Decryptor decryptor(context, secret_key);
     Evaluator evaluator(context);
+    AligningEvaluator aligning_evaluator(context, evaluator);
     CKKSEncoder encoder(context);
     double scale = pow(2.0, 40);
 
@@ -35,7 +144,6 @@ int main() {
     encryptor.encrypt(pt_input, ct_input);
 
     vector<Ciphertext> parts(kernel.size());
-    parms_id_type target_parms_id;
 
     for (size_t i = 0; i < kernel.size(); ++i) {
         Ciphertext shifted;
@@ -46,19 +154,16 @@ int main() {
             shifted = ct_input;
 
         Plaintext k_plain;
-        encoder.encode(kernel[i], scale, k_plain);
-        evaluator.multiply_plain(shifted, k_plain, parts[i]);
-        evaluator.rescale_to_next_inplace(parts[i]);
-
-        if (i == 0)
-            target_parms_id = parts[0].parms_id();
-        else
-            evaluator.mod_switch_to_inplace(parts[i], target_parms_id);
+        aligning_evaluator.encode_at(encoder, kernel[i], shifted, scale, k_plain);
+        parts[i] = shifted;
+        aligning_evaluator.multiply_plain_inplace(parts[i], k_plain);
     }
 
+    // Levels and scales are aligned by the wrapper; rescale once at the end
     Ciphertext result = parts[0];
     for (size_t i = 1; i < parts.size(); ++i)
-        evaluator.add_inplace(result, parts[i]);
+        aligning_evaluator.add_inplace(result, parts[i]);
+    evaluator.rescale_to_next_inplace(result);
 
     Plaintext plain_result;
     decryptor.decrypt(result, plain_result);
@@ -2,6 +2,15 @@
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <functional>
+#include "seal/util/uintarithsmallmod.h"
 
 using namespace std;
 using namespace seal;
@@ -17,6 +26,446 @@ void print_parameters(const SEALContext &context)
          << context.key_context_data()->total_coeff_modulus_bit_count() << " bits" << endl;
 }
 
+// Fused multiply-accumulate: accumulator += encrypted * plain, computed in the
+// NTT domain in one pass over the RNS limbs. An empty accumulator is
+// initialized with the product, so the inner loops of the kernels never create
+// a temporary ciphertext; a non-empty one must already be at the level of
+// encrypted. Callers rescale once at the end.
+void multiply_plain_accumulate(const SEALContext &context, const Ciphertext &encrypted,
+                               const Plaintext &plain, Ciphertext &accumulator)
+{
+    if (!encrypted.is_ntt_form() || !plain.is_ntt_form())
+        throw invalid_argument("multiply_plain_accumulate requires NTT-form operands");
+    if (encrypted.parms_id() != plain.parms_id())
+        throw invalid_argument("multiply_plain_accumulate: plaintext is at a different level");
+
+    auto context_data = context.get_context_data(encrypted.parms_id());
+    const auto &coeff_modulus = context_data->parms().coeff_modulus();
+    const size_t coeff_count = encrypted.poly_modulus_degree();
+    const double product_scale = encrypted.scale() * plain.scale();
+
+    bool overwrite = accumulator.size() == 0;
+    if (!overwrite && accumulator.parms_id() != encrypted.parms_id())
+        throw invalid_argument("multiply_plain_accumulate: accumulator is at a different level");
+    if (overwrite)
+    {
+        accumulator.resize(context, encrypted.parms_id(), encrypted.size());
+        accumulator.is_ntt_form() = true;
+        accumulator.scale() = product_scale;
+    }
+    else if (accumulator.size() != encrypted.size() || fabs(accumulator.scale() / product_scale - 1.0) > 1e-9)
+    {
+        throw invalid_argument("multiply_plain_accumulate: accumulator size or scale mismatch");
+    }
+
+    const uint64_t *pt = plain.data();
+    for (size_t j = 0; j < encrypted.size(); j++)
+    {
+        const uint64_t *src = encrypted.data(j);
+        uint64_t *dst = accumulator.data(j);
+        for (size_t i = 0; i < coeff_modulus.size(); i++)
+        {
+            const Modulus &q = coeff_modulus[i];
+            const size_t offset = i * coeff_count;
+            if (overwrite)
+            {
+                for (size_t k = offset; k < offset + coeff_count; k++)
+                    dst[k] = util::multiply_uint_mod(src[k], pt[k], q);
+            }
+            else
+            {
+                for (size_t k = offset; k < offset + coeff_count; k++)
+                    dst[k] = util::add_uint_mod(dst[k], util::multiply_uint_mod(src[k], pt[k], q), q);
+            }
+        }
+    }
+}
+
+// Evaluator wrapper that aligns levels and scales at the point an operation
+// needs it. The higher-level operand is brought down lazily: a rescale is used
+// when it also moves the scale toward the other operand, otherwise primes are
+// simply dropped. Scales that differ only by rounding drift are treated as equal.
+class AligningEvaluator
+{
+public:
+    AligningEvaluator(const SEALContext &context, Evaluator &evaluator, double max_scale_drift = 1e-4)
+        : context_(context), evaluator_(evaluator), max_scale_drift_(max_scale_drift)
+    {
+    }
+
+    size_t level(const Ciphertext &ct) const
+    {
+        return context_.get_context_data(ct.parms_id())->chain_index();
+    }
+
+    // Bring ct down to target_level using the cheapest step for each prime
+    void lower_to(Ciphertext &ct, size_t target_level, double target_scale) const
+    {
+        while (level(ct) > target_level)
+        {
+            auto context_data = context_.get_context_data(ct.parms_id());
+            double last_prime = static_cast<double>(context_data->parms().coeff_modulus().back().value());
+            double keep_gap = fabs(log2(ct.scale() / target_scale));
+            double rescale_gap = fabs(log2(ct.scale() / last_prime / target_scale));
+            if (rescale_gap < keep_gap)
+            {
+                evaluator_.rescale_to_next_inplace(ct);
+            }
+            else
+            {
+                // Dropping primes is free of NTTs in CKKS, so drop all at once
+                auto target = context_data;
+                while (target->chain_index() > target_level)
+                    target = target->next_context_data();
+                evaluator_.mod_switch_to_inplace(ct, target->parms_id());
+            }
+        }
+    }
+
+    void match_scale(Ciphertext &ct, double target_scale) const
+    {
+        if (ct.scale() == target_scale)
+            return;
+        if (fabs(ct.scale() / target_scale - 1.0) > max_scale_drift_)
+            throw invalid_argument("AligningEvaluator: operand scales differ beyond tolerance");
+        ct.scale() = target_scale;
+    }
+
+    // Aligns a in place; b is only copied when it is the one that must move
+    void add_inplace(Ciphertext &a, const Ciphertext &b) const
+    {
+        if (level(a) > level(b))
+            lower_to(a, level(b), b.scale());
+        if (level(b) > level(a))
+        {
+            Ciphertext b_aligned = b;
+            lower_to(b_aligned, level(a), a.scale());
+            match_scale(a, b_aligned.scale());
+            evaluator_.add_inplace(a, b_aligned);
+            return;
+        }
+        match_scale(a, b.scale());
+        evaluator_.add_inplace(a, b);
+    }
+
+    void multiply_inplace(Ciphertext &a, const Ciphertext &b) const
+    {
+        if (level(a) > level(b))
+            lower_to(a, level(b), b.scale());
+        if (level(b) > level(a))
+        {
+            Ciphertext b_aligned = b;
+            lower_to(b_aligned, level(a), a.scale());
+            evaluator_.multiply_inplace(a, b_aligned);
+            return;
+        }
+        evaluator_.multiply_inplace(a, b);
+    }
+
+    // Encode at exactly ct's level: the encoder's NTTs run over ct's primes
+    // only and the plaintext carries no limbs that would be dropped later
+    void encode_at(const CKKSEncoder &encoder, double value, const Ciphertext &ct, double scale,
+                   Plaintext &pt, MemoryPoolHandle pool = MemoryManager::GetPool()) const
+    {
+        encoder.encode(value, ct.parms_id(), scale, pt, pool);
+    }
+
+    void encode_at(const CKKSEncoder &encoder, const vector<double> &values, const Ciphertext &ct,
+                   double scale, Plaintext &pt, MemoryPoolHandle pool = MemoryManager::GetPool()) const
+    {
+        encoder.encode(values, ct.parms_id(), scale, pt, pool);
+    }
+
+    // Plaintexts encoded at a higher level just drop their extra primes
+    void multiply_plain_inplace(Ciphertext &ct, const Plaintext &pt) const
+    {
+        if (pt.parms_id() == ct.parms_id())
+        {
+            evaluator_.multiply_plain_inplace(ct, pt);
+            return;
+        }
+        Plaintext pt_aligned;
+        evaluator_.mod_switch_to(pt, ct.parms_id(), pt_aligned);
+        evaluator_.multiply_plain_inplace(ct, pt_aligned);
+    }
+
+    // acc += ct * pt through the fused kernel. Primes are dropped from the
+    // plaintext, the accumulator or a copy of ct until all three share a level.
+    void multiply_plain_accumulate(const Ciphertext &ct, const Plaintext &pt, Ciphertext &acc) const
+    {
+        if (acc.size() != 0 && level(acc) > level(ct))
+            evaluator_.mod_switch_to_inplace(acc, ct.parms_id());
+        if (acc.size() != 0 && level(acc) < level(ct))
+        {
+            Ciphertext ct_aligned;
+            evaluator_.mod_switch_to(ct, acc.parms_id(), ct_aligned);
+            multiply_plain_accumulate(ct_aligned, pt, acc);
+            return;
+        }
+        if (pt.parms_id() == ct.parms_id())
+        {
+            ::multiply_plain_accumulate(context_, ct, pt, acc);
+            return;
+        }
+        Plaintext pt_aligned;
+        evaluator_.mod_switch_to(pt, ct.parms_id(), pt_aligned);
+        ::multiply_plain_accumulate(context_, ct, pt_aligned, acc);
+    }
+
+    // Single-operand steps need no alignment and go straight through
+    void rescale_to_next_inplace(Ciphertext &ct) const
+    {
+        evaluator_.rescale_to_next_inplace(ct);
+    }
+
+    void rotate_vector_inplace(Ciphertext &ct, int steps, const GaloisKeys &galois_keys) const
+    {
+        evaluator_.rotate_vector_inplace(ct, steps, galois_keys);
+    }
+
+private:
+    const SEALContext &context_;
+    Evaluator &evaluator_;
+    double max_scale_drift_;
+};
+
+// Per-thread arena for kernel temporaries: a private SEAL memory pool plus a
+// set of reusable ciphertext/plaintext buffers allocated from it. Pools are
+// passed explicitly to every SEAL call rather than through MMProfGuard, since
+// memory manager profiles are process-wide and would serialize threads.
+// reset() at the end of a kernel hands the buffers back for the next call
+// without freeing them, so steady-state kernels neither contend on the global
+// pool nor fault in fresh pages.
+class KernelArena
+{
+public:
+    KernelArena() : pool_(MemoryPoolHandle::New()) {}
+
+    static KernelArena &for_this_thread()
+    {
+        thread_local KernelArena arena;
+        return arena;
+    }
+
+    MemoryPoolHandle pool() const { return pool_; }
+
+    Ciphertext &ciphertext()
+    {
+        if (next_ciphertext_ == ciphertexts_.size())
+        {
+            ciphertexts_.emplace_back(pool_);
+        }
+        return ciphertexts_[next_ciphertext_++];
+    }
+
+    Plaintext &plaintext()
+    {
+        if (next_plaintext_ == plaintexts_.size())
+        {
+            plaintexts_.emplace_back(pool_);
+        }
+        return plaintexts_[next_plaintext_++];
+    }
+
+    void reset()
+    {
+        next_ciphertext_ = 0;
+        next_plaintext_ = 0;
+    }
+
+    size_t bytes_reserved() const { return pool_.alloc_byte_count(); }
+
+private:
+    MemoryPoolHandle pool_;
+    deque<Ciphertext> ciphertexts_; // deque keeps handed-out references stable
+    deque<Plaintext> plaintexts_;
+    size_t next_ciphertext_ = 0;
+    size_t next_plaintext_ = 0;
+};
+
+// Resets the arena when a kernel invocation ends
+class ArenaScope
+{
+public:
+    explicit ArenaScope(KernelArena &arena) : arena_(arena) {}
+    ~ArenaScope() { arena_.reset(); }
+
+private:
+    KernelArena &arena_;
+};
+
+// Memo of rotate_vector results keyed by (source ciphertext, step). Window
+// kernels rotate one input by the same shift for many (window, tap) pairs;
+// with the memo each distinct shift pays for its key switch once. Sources are
+// identified by address and validated on every lookup against a fingerprint
+// (level, size, scale, buffer and sampled coefficients), so a source that was
+// modified or reused for another ciphertext drops its entries. Results are
+// evicted least recently used once max_bytes is exceeded. Thread-safe.
+class RotationCache
+{
+public:
+    RotationCache(const Evaluator &evaluator, const GaloisKeys &galois_keys, size_t max_bytes = size_t(256) << 20)
+        : evaluator_(evaluator), galois_keys_(galois_keys), max_bytes_(max_bytes)
+    {
+    }
+
+    shared_ptr<const Ciphertext> rotate(const Ciphertext &source, int step,
+                                        MemoryPoolHandle pool = MemoryManager::GetPool())
+    {
+        Fingerprint fingerprint = fingerprint_of(source);
+        Key key{&source, step};
+        {
+            lock_guard<mutex> lock(mutex_);
+            validate(source, fingerprint);
+            auto it = index_.find(key);
+            if (it != index_.end())
+            {
+                lru_.splice(lru_.begin(), lru_, it->second);
+                hits_++;
+                return it->second->result;
+            }
+            misses_++;
+        }
+
+        // Key switch outside the lock; a concurrent miss on the same key
+        // computes the same result and the later insert is dropped
+        auto result = make_shared<Ciphertext>(pool);
+        evaluator_.rotate_vector(source, step, galois_keys_, *result, pool);
+
+        lock_guard<mutex> lock(mutex_);
+        validate(source, fingerprint);
+        auto it = index_.find(key);
+        if (it != index_.end())
+            return it->second->result;
+        size_t bytes = result->size() * result->poly_modulus_degree() * result->coeff_modulus_size() * sizeof(uint64_t);
+        lru_.push_front(Entry{key, result, bytes});
+        index_[key] = lru_.begin();
+        bytes_ += bytes;
+        evict();
+        return result;
+    }
+
+    // Drops every cached rotation of source
+    void invalidate(const Ciphertext &source)
+    {
+        lock_guard<mutex> lock(mutex_);
+        drop_source(&source);
+    }
+
+    void clear()
+    {
+        lock_guard<mutex> lock(mutex_);
+        lru_.clear();
+        index_.clear();
+        fingerprints_.clear();
+        bytes_ = 0;
+    }
+
+    size_t hits() const { lock_guard<mutex> lock(mutex_); return hits_; }
+    size_t misses() const { lock_guard<mutex> lock(mutex_); return misses_; }
+    size_t evictions() const { lock_guard<mutex> lock(mutex_); return evictions_; }
+    size_t bytes() const { lock_guard<mutex> lock(mutex_); return bytes_; }
+
+private:
+    using Key = pair<const Ciphertext *, int>;
+
+    struct KeyHash
+    {
+        size_t operator()(const Key &key) const
+        {
+            return hash<const void *>()(key.first) * 31 + hash<int>()(key.second);
+        }
+    };
+
+    struct Fingerprint
+    {
+        parms_id_type parms_id;
+        size_t size;
+        double scale;
+        const uint64_t *data;
+        uint64_t sample;
+
+        bool operator==(const Fingerprint &other) const
+        {
+            return parms_id == other.parms_id && size == other.size && scale == other.scale &&
+                   data == other.data && sample == other.sample;
+        }
+    };
+
+    struct Entry
+    {
+        Key key;
+        shared_ptr<const Ciphertext> result;
+        size_t bytes;
+    };
+
+    // Any in-place operation rewrites every coefficient, so a few words from
+    // each polynomial are enough to notice a changed source
+    static Fingerprint fingerprint_of(const Ciphertext &ct)
+    {
+        Fingerprint fp{ct.parms_id(), ct.size(), ct.scale(), ct.size() ? ct.data() : nullptr, 0};
+        size_t words = ct.poly_modulus_degree() * ct.coeff_modulus_size();
+        for (size_t j = 0; j < ct.size() && words; j++)
+        {
+            const uint64_t *poly = ct.data(j);
+            for (size_t k : {size_t(0), words / 3, 2 * words / 3, words - 1})
+                fp.sample = (fp.sample ^ poly[k]) * 0x100000001b3ULL;
+        }
+        return fp;
+    }
+
+    void validate(const Ciphertext &source, const Fingerprint &fingerprint)
+    {
+        auto it = fingerprints_.find(&source);
+        if (it != fingerprints_.end() && it->second == fingerprint)
+            return;
+        drop_source(&source);
+        fingerprints_[&source] = fingerprint;
+    }
+
+    void drop_source(const Ciphertext *source)
+    {
+        for (auto it = lru_.begin(); it != lru_.end();)
+        {
+            if (it->key.first == source)
+            {
+                bytes_ -= it->bytes;
+                index_.erase(it->key);
+                it = lru_.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        fingerprints_.erase(source);
+    }
+
+    void evict()
+    {
+        while (bytes_ > max_bytes_ && lru_.size() > 1)
+        {
+            Entry &victim = lru_.back();
+            bytes_ -= victim.bytes;
+            index_.erase(victim.key);
+            lru_.pop_back();
+            evictions_++;
+        }
+    }
+
+    const Evaluator &evaluator_;
+    const GaloisKeys &galois_keys_;
+    size_t max_bytes_;
+    mutable mutex mutex_;
+    list<Entry> lru_;
+    unordered_map<Key, list<Entry>::iterator, KeyHash> index_;
+    unordered_map<const Ciphertext *, Fingerprint> fingerprints_;
+    size_t bytes_ = 0;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+    size_t evictions_ = 0;
+};
+
 // Helper function to compute the dot product for a sliding window at position (i,j)
 Ciphertext compute_window_dot_product(
     const Ciphertext &encrypted_matrix, 
@@ -25,38 +474,32 @@ Ciphertext compute_window_dot_product(
     const vector<double> &kernel, 
     int kernel_size, 
     CKKSEncoder &encoder, 
-    Evaluator &evaluator, 
-    const GaloisKeys &gal_keys, 
+    const AligningEvaluator &evaluator, 
+    RotationCache &rotations, 
     double scale)
 {
+    // Temporaries come from this thread's arena and are reused across taps;
+    // each term is fused into window_result. Rotations are shared with every
+    // other window through the cache.
+    KernelArena &arena = KernelArena::for_this_thread();
+    ArenaScope scope(arena);
+    MemoryPoolHandle pool = arena.pool();
+    Plaintext &plain_weight = arena.plaintext();
+
     Ciphertext window_result;
-    bool first = true;
     for (int ki = 0; ki < kernel_size; ++ki)
     {
         for (int kj = 0; kj < kernel_size; ++kj)
         {
             int shift = (i + ki) * cols + (j + kj);
-            Ciphertext rotated;
-            evaluator.rotate_vector(encrypted_matrix, shift, gal_keys, rotated);
-
-            Plaintext plain_weight;
-            encoder.encode(kernel[ki * kernel_size + kj], scale, plain_weight);
+            auto rotated = rotations.rotate(encrypted_matrix, shift);
 
-            evaluator.multiply_plain_inplace(rotated, plain_weight);
-            evaluator.rescale_to_next_inplace(rotated);
-
-            if (first)
-            {
-                window_result = rotated;
-                first = false;
-            }
-            else
-            {
-                evaluator.mod_switch_to_inplace(window_result, rotated.parms_id());
-                evaluator.add_inplace(window_result, rotated);
-            }
+            evaluator.encode_at(encoder, kernel[ki * kernel_size + kj], *rotated, scale, plain_weight, pool);
+            evaluator.multiply_plain_accumulate(*rotated, plain_weight, window_result);
         }
     }
+    // One rescale for the whole window instead of one per term
+    evaluator.rescale_to_next_inplace(window_result);
     return window_result;
 }
 
@@ -90,6 +533,7 @@ int main() {
     Encryptor encryptor(context, public_key);
     Decryptor decryptor(context, secret_key);
     Evaluator evaluator(context);
+    AligningEvaluator aligning_evaluator(context, evaluator);
     CKKSEncoder encoder(context);
 
     // Matrix and kernel definitions.
@@ -104,10 +548,22 @@ int main() {
     Ciphertext encrypted_matrix;
     encryptor.encrypt(plain_matrix, encrypted_matrix);
 
-    // Compute the convolution result for the window at (0,0)
-    Ciphertext conv_result = compute_window_dot_product(encrypted_matrix, 0, 0,
-                                                        rows, cols, kernel, kernel_size,
-                                                        encoder, evaluator, gal_keys, scale);
+    // Compute every valid window. Neighbouring windows share most of their
+    // shifts, so each distinct rotation is key-switched only once.
+    RotationCache rotations(evaluator, gal_keys);
+    vector<Ciphertext> window_results;
+    for (int i = 0; i + kernel_size <= rows; ++i)
+    {
+        for (int j = 0; j + kernel_size <= cols; ++j)
+        {
+            window_results.push_back(compute_window_dot_product(encrypted_matrix, i, j,
+                                                                rows, cols, kernel, kernel_size,
+                                                                encoder, aligning_evaluator, rotations, scale));
+        }
+    }
+    cout << "Rotations: " << rotations.misses() << " key switches, " << rotations.hits()
+         << " reused across " << window_results.size() << " windows" << endl;
+    const Ciphertext &conv_result = window_results.front();
 
     // Decrypt and decode the first result.
     Plaintext plain_result;
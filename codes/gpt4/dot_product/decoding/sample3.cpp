@@ -2,6 +2,13 @@
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <functional>
 
 using namespace std;
 using namespace seal;
@@ -16,6 +23,178 @@ void print_parameters(const SEALContext &context)
          << context.key_context_data()->total_coeff_modulus_bit_count() << " bits" << endl;
 }
 
+// Memo of rotate_vector results keyed by (source ciphertext, step). Window
+// kernels rotate one input by the same shift for many (window, tap) pairs;
+// with the memo each distinct shift pays for its key switch once. Sources are
+// identified by address and validated on every lookup against a fingerprint
+// (level, size, scale, buffer and sampled coefficients), so a source that was
+// modified or reused for another ciphertext drops its entries. Results are
+// evicted least recently used once max_bytes is exceeded. Thread-safe.
+class RotationCache
+{
+public:
+    RotationCache(const Evaluator &evaluator, const GaloisKeys &galois_keys, size_t max_bytes = size_t(256) << 20)
+        : evaluator_(evaluator), galois_keys_(galois_keys), max_bytes_(max_bytes)
+    {
+    }
+
+    shared_ptr<const Ciphertext> rotate(const Ciphertext &source, int step,
+                                        MemoryPoolHandle pool = MemoryManager::GetPool())
+    {
+        Fingerprint fingerprint = fingerprint_of(source);
+        Key key{&source, step};
+        {
+            lock_guard<mutex> lock(mutex_);
+            validate(source, fingerprint);
+            auto it = index_.find(key);
+            if (it != index_.end())
+            {
+                lru_.splice(lru_.begin(), lru_, it->second);
+                hits_++;
+                return it->second->result;
+            }
+            misses_++;
+        }
+
+        // Key switch outside the lock; a concurrent miss on the same key
+        // computes the same result and the later insert is dropped
+        auto result = make_shared<Ciphertext>(pool);
+        evaluator_.rotate_vector(source, step, galois_keys_, *result, pool);
+
+        lock_guard<mutex> lock(mutex_);
+        validate(source, fingerprint);
+        auto it = index_.find(key);
+        if (it != index_.end())
+            return it->second->result;
+        size_t bytes = result->size() * result->poly_modulus_degree() * result->coeff_modulus_size() * sizeof(uint64_t);
+        lru_.push_front(Entry{key, result, bytes});
+        index_[key] = lru_.begin();
+        bytes_ += bytes;
+        evict();
+        return result;
+    }
+
+    // Drops every cached rotation of source
+    void invalidate(const Ciphertext &source)
+    {
+        lock_guard<mutex> lock(mutex_);
+        drop_source(&source);
+    }
+
+    void clear()
+    {
+        lock_guard<mutex> lock(mutex_);
+        lru_.clear();
+        index_.clear();
+        fingerprints_.clear();
+        bytes_ = 0;
+    }
+
+    size_t hits() const { lock_guard<mutex> lock(mutex_); return hits_; }
+    size_t misses() const { lock_guard<mutex> lock(mutex_); return misses_; }
+    size_t evictions() const { lock_guard<mutex> lock(mutex_); return evictions_; }
+    size_t bytes() const { lock_guard<mutex> lock(mutex_); return bytes_; }
+
+private:
+    using Key = pair<const Ciphertext *, int>;
+
+    struct KeyHash
+    {
+        size_t operator()(const Key &key) const
+        {
+            return hash<const void *>()(key.first) * 31 + hash<int>()(key.second);
+        }
+    };
+
+    struct Fingerprint
+    {
+        parms_id_type parms_id;
+        size_t size;
+        double scale;
+        const uint64_t *data;
+        uint64_t sample;
+
+        bool operator==(const Fingerprint &other) const
+        {
+            return parms_id == other.parms_id && size == other.size && scale == other.scale &&
+                   data == other.data && sample == other.sample;
+        }
+    };
+
+    struct Entry
+    {
+        Key key;
+        shared_ptr<const Ciphertext> result;
+        size_t bytes;
+    };
+
+    // Any in-place operation rewrites every coefficient, so a few words from
+    // each polynomial are enough to notice a changed source
+    static Fingerprint fingerprint_of(const Ciphertext &ct)
+    {
+        Fingerprint fp{ct.parms_id(), ct.size(), ct.scale(), ct.size() ? ct.data() : nullptr, 0};
+        size_t words = ct.poly_modulus_degree() * ct.coeff_modulus_size();
+        for (size_t j = 0; j < ct.size() && words; j++)
+        {
+            const uint64_t *poly = ct.data(j);
+            for (size_t k : {size_t(0), words / 3, 2 * words / 3, words - 1})
+                fp.sample = (fp.sample ^ poly[k]) * 0x100000001b3ULL;
+        }
+        return fp;
+    }
+
+    void validate(const Ciphertext &source, const Fingerprint &fingerprint)
+    {
+        auto it = fingerprints_.find(&source);
+        if (it != fingerprints_.end() && it->second == fingerprint)
+            return;
+        drop_source(&source);
+        fingerprints_[&source] = fingerprint;
+    }
+
+    void drop_source(const Ciphertext *source)
+    {
+        for (auto it = lru_.begin(); it != lru_.end();)
+        {
+            if (it->key.first == source)
+            {
+                bytes_ -= it->bytes;
+                index_.erase(it->key);
+                it = lru_.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        fingerprints_.erase(source);
+    }
+
+    void evict()
+    {
+        while (bytes_ > max_bytes_ && lru_.size() > 1)
+        {
+            Entry &victim = lru_.back();
+            bytes_ -= victim.bytes;
+            index_.erase(victim.key);
+            lru_.pop_back();
+            evictions_++;
+        }
+    }
+
+    const Evaluator &evaluator_;
+    const GaloisKeys &galois_keys_;
+    size_t max_bytes_;
+    mutable mutex mutex_;
+    list<Entry> lru_;
+    unordered_map<Key, list<Entry>::iterator, KeyHash> index_;
+    unordered_map<const Ciphertext *, Fingerprint> fingerprints_;
+    size_t bytes_ = 0;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+    size_t evictions_ = 0;
+};
+
 int main() {
     size_t poly_modulus_degree = 8192;
     EncryptionParameters parms(scheme_type::ckks);
@@ -55,6 +234,9 @@ int main() {
     Ciphertext encrypted_matrix;
     encryptor.encrypt(plain_matrix, encrypted_matrix);
 
+    // Rotations of encrypted_matrix are shared by every window
+    RotationCache rotations(evaluator, gal_keys);
+
     // Lambda function to compute the convolution dot product at (i,j)
     auto compute_window = [&](int i, int j) -> Ciphertext {
         Ciphertext result;
@@ -64,8 +246,7 @@ int main() {
             for (int kj = 0; kj < kernel_size; ++kj)
             {
                 int shift = (i + ki) * cols + (j + kj);
-                Ciphertext rotated;
-                evaluator.rotate_vector(encrypted_matrix, shift, gal_keys, rotated);
+                Ciphertext rotated = *rotations.rotate(encrypted_matrix, shift);
                 Plaintext plain_weight;
                 encoder.encode(kernel[ki * kernel_size + kj], scale, plain_weight);
                 evaluator.multiply_plain_inplace(rotated, plain_weight);
@@ -85,8 +266,14 @@ int main() {
         return result;
     };
 
-    // Compute the result for the window at (0,0)
-    Ciphertext conv_result = compute_window(0, 0);
+    // Compute every valid window; overlapping windows reuse rotations
+    vector<Ciphertext> window_results;
+    for (int i = 0; i + kernel_size <= rows; ++i)
+        for (int j = 0; j + kernel_size <= cols; ++j)
+            window_results.push_back(compute_window(i, j));
+    cout << "Rotations: " << rotations.misses() << " key switches, " << rotations.hits()
+         << " reused across " << window_results.size() << " windows" << endl;
+    Ciphertext conv_result = window_results.front();
 
     Plaintext plain_result;
     vector<double> result_vector;